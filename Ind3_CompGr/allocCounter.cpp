@@ -0,0 +1,155 @@
+#include "allocCounter.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _MSC_VER
+#include <malloc.h>
+#endif
+
+namespace
+{
+    std::atomic<size_t> allocations{ 0 };
+    std::atomic<size_t> frees{ 0 };
+    std::atomic<size_t> bytes{ 0 };
+
+    allocCounter::FrameStats frameStart;
+
+    allocCounter::FrameStats Snapshot()
+    {
+        allocCounter::FrameStats s;
+        s.allocations = allocations.load(std::memory_order_relaxed);
+        s.frees = frees.load(std::memory_order_relaxed);
+        s.bytes = bytes.load(std::memory_order_relaxed);
+        return s;
+    }
+}
+
+namespace allocCounter
+{
+    bool Enabled()
+    {
+#ifdef ALLOC_COUNTER
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    void BeginFrame()
+    {
+        frameStart = Snapshot();
+    }
+
+    FrameStats EndFrame()
+    {
+        FrameStats now = Snapshot();
+        FrameStats frame;
+        frame.allocations = now.allocations - frameStart.allocations;
+        frame.frees = now.frees - frameStart.frees;
+        frame.bytes = now.bytes - frameStart.bytes;
+        return frame;
+    }
+
+    size_t TotalAllocations()
+    {
+        return allocations.load(std::memory_order_relaxed);
+    }
+}
+
+#ifdef ALLOC_COUNTER
+
+// подменённые глобальные операторы: считаем вызов и отдаём память через malloc/free
+static void* CountedAlloc(size_t size)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    return std::malloc(size ? size : 1);
+}
+
+static void CountedFree(void* ptr)
+{
+    if (!ptr)
+        return;
+    frees.fetch_add(1, std::memory_order_relaxed);
+    std::free(ptr);
+}
+
+// выделения с выравниванием больше стандартного (alignas больше 16): у MSVC нет aligned_alloc,
+// а память от _aligned_malloc освобождается только через _aligned_free
+static void* CountedAlignedAlloc(size_t size, std::align_val_t align)
+{
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    bytes.fetch_add(size, std::memory_order_relaxed);
+    size_t alignment = (size_t)align;
+    // aligned_alloc требует размер, кратный выравниванию
+    size_t rounded = ((size ? size : 1) + alignment - 1) / alignment * alignment;
+#ifdef _MSC_VER
+    return _aligned_malloc(rounded, alignment);
+#else
+    return std::aligned_alloc(alignment, rounded);
+#endif
+}
+
+static void CountedAlignedFree(void* ptr)
+{
+    if (!ptr)
+        return;
+    frees.fetch_add(1, std::memory_order_relaxed);
+#ifdef _MSC_VER
+    _aligned_free(ptr);
+#else
+    std::free(ptr);
+#endif
+}
+
+void* operator new(size_t size)
+{
+    if (void* ptr = CountedAlloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size)
+{
+    if (void* ptr = CountedAlloc(size))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+void* operator new[](size_t size, const std::nothrow_t&) noexcept { return CountedAlloc(size); }
+
+void operator delete(void* ptr) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr) noexcept { CountedFree(ptr); }
+void operator delete(void* ptr, size_t) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr, size_t) noexcept { CountedFree(ptr); }
+void operator delete(void* ptr, const std::nothrow_t&) noexcept { CountedFree(ptr); }
+void operator delete[](void* ptr, const std::nothrow_t&) noexcept { CountedFree(ptr); }
+
+void* operator new(size_t size, std::align_val_t align)
+{
+    if (void* ptr = CountedAlignedAlloc(size, align))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new[](size_t size, std::align_val_t align)
+{
+    if (void* ptr = CountedAlignedAlloc(size, align))
+        return ptr;
+    throw std::bad_alloc();
+}
+
+void* operator new(size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return CountedAlignedAlloc(size, align); }
+void* operator new[](size_t size, std::align_val_t align, const std::nothrow_t&) noexcept { return CountedAlignedAlloc(size, align); }
+
+void operator delete(void* ptr, std::align_val_t) noexcept { CountedAlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t) noexcept { CountedAlignedFree(ptr); }
+void operator delete(void* ptr, size_t, std::align_val_t) noexcept { CountedAlignedFree(ptr); }
+void operator delete[](void* ptr, size_t, std::align_val_t) noexcept { CountedAlignedFree(ptr); }
+void operator delete(void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { CountedAlignedFree(ptr); }
+void operator delete[](void* ptr, std::align_val_t, const std::nothrow_t&) noexcept { CountedAlignedFree(ptr); }
+
+#endif
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cstddef>
+
+// Счётчик выделений памяти в куче.
+// Если проект собран с ALLOC_COUNTER (cmake -DALLOC_COUNTER=ON или msbuild /p:AllocCounter=true),
+// глобальные operator new/delete подменяются (см. allocCounter.cpp) и каждое выделение учитывается; без этого определения все функции ничего не делают.
+// С ALLOC_COUNTER_STRICT программа сообщает об ошибке и вызывает abort, если в установившемся кадре была хоть одна аллокация
+// (в любой сборке, в том числе с NDEBUG).
+namespace allocCounter
+{
+    // статистика за кадр
+    struct FrameStats
+    {
+        size_t allocations = 0; // количество вызовов new
+        size_t frees = 0; // количество вызовов delete
+        size_t bytes = 0; // сколько байт запрошено
+    };
+
+    // включён ли подсчёт в этой сборке
+    bool Enabled();
+
+    // начало кадра: запоминаем текущие значения счётчиков
+    void BeginFrame();
+
+    // конец кадра: возвращаем, сколько выделений было с момента BeginFrame()
+    FrameStats EndFrame();
+
+    // общее количество выделений с запуска программы
+    size_t TotalAllocations();
+}
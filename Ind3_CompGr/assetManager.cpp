@@ -0,0 +1,300 @@
+#include "assetManager.h"
+#include "cpuProfiler.h"
+#include "model.h"
+#include "ktx.h"
+#include "textureCooker.h"
+#include "textureStreamer.h"
+#include "threadPool.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <vector>
+
+// хэш содержимого файла (FNV-1a, 64 бита)
+static uint64_t HashBytes(const vector<unsigned char>& bytes)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (unsigned char b : bytes)
+    {
+        hash ^= b;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool ReadFileBytes(const string& path, vector<unsigned char>& bytes)
+{
+    ifstream file(path, ios::binary);
+    if (!file)
+        return false;
+    bytes.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+    return true;
+}
+
+//  загружает текстуру из содержимого файла (с помощью заголовочного файла stb_image.h) и возвращает её.
+GlTexture TextureFromFile(const vector<unsigned char>& fileData, const string& path)
+{
+    CpuZone zone("TextureFromFile");
+    GlTexture texture = CreateTexture(GL_TEXTURE_2D);
+
+    int width, height, nrComponents;
+    unsigned char *data = stbi_load_from_memory(fileData.data(), (int)fileData.size(), &width, &height, &nrComponents, 0);
+    if (data)
+    {
+        GLenum format;
+        if (nrComponents == 1)
+            format = GL_RED;
+        else if (nrComponents == 3)
+            format = GL_RGB;
+        else if (nrComponents == 4)
+            format = GL_RGBA;
+
+        GlState::Instance().BindTexture(0, texture);
+        glTexImage2D(GL_TEXTURE_2D, 0, format, width, height, 0, format, GL_UNSIGNED_BYTE, data);
+        GlState::Instance().CountUpload((size_t)width * height * nrComponents);
+        glGenerateMipmap(GL_TEXTURE_2D);
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+
+        stbi_image_free(data);
+    }
+    else
+    {
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+        stbi_image_free(data);
+    }
+
+    return texture;
+}
+
+// загружает подготовленную текстуру (KTX со сжатыми мип-уровнями, см. textureCooker.h) без декодирования:
+// место под все уровни выделяется сразу (glTexStorage2D), уровни копируются как есть; пустая, если файл не разобран
+GlTexture TextureFromKtx(const vector<unsigned char>& fileData, const string& path)
+{
+    CpuZone zone("TextureFromKtx");
+    ktx::Header header;
+    vector<ktx::Level> levels;
+    if (!ktx::Read(fileData, header, levels))
+    {
+        std::cout << "Cooked texture is broken: " << path << std::endl;
+        return GlTexture();
+    }
+
+    GlTexture texture = CreateTexture(GL_TEXTURE_2D);
+    GlState::Instance().BindTexture(0, texture);
+    glTexStorage2D(GL_TEXTURE_2D, (GLsizei)levels.size(), header.glInternalFormat, header.pixelWidth, header.pixelHeight);
+    for (size_t i = 0; i < levels.size(); i++)
+    {
+        glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, levels[i].width, levels[i].height,
+            header.glInternalFormat, levels[i].size, levels[i].data);
+        GlState::Instance().CountUpload(levels[i].size);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levels.size() > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    return texture;
+}
+
+// подготовленный файл используем, только если он не старше исходной картинки
+static bool CookedIsFresh(const string& sourcePath, const string& cookedPath)
+{
+    error_code ec;
+    if (!filesystem::exists(cookedPath, ec))
+        return false;
+    if (!filesystem::exists(sourcePath, ec))
+        return true;
+    return filesystem::last_write_time(cookedPath, ec) >= filesystem::last_write_time(sourcePath, ec);
+}
+
+AssetManager& AssetManager::Instance()
+{
+    static AssetManager instance;
+    return instance;
+}
+
+string AssetManager::CanonicalPath(const string& path)
+{
+    error_code ec;
+    filesystem::path canonical = filesystem::weakly_canonical(filesystem::path(path), ec);
+    if (ec)
+        canonical = filesystem::absolute(filesystem::path(path), ec).lexically_normal();
+    return canonical.generic_string();
+}
+
+ModelHandle AssetManager::LoadModel(const string& path)
+{
+    CpuZone zone("LoadModel");
+    string key = CanonicalPath(path);
+
+    auto found = models.find(key);
+    if (found != models.end())
+    {
+        if (ModelHandle model = found->second.lock())
+        {
+            stats.modelHits++;
+            return model;
+        }
+    }
+
+    stats.modelMisses++;
+    ModelHandle model = make_shared<Model>(path);
+    models[key] = model;
+    return model;
+}
+
+vector<ModelHandle> AssetManager::LoadModels(const vector<string>& paths)
+{
+    CpuZone zone("LoadModels");
+    vector<ModelHandle> result(paths.size());
+
+    // какие файлы нужно импортировать (каждый один раз, даже если он повторяется в списке)
+    vector<string> keys(paths.size());
+    vector<size_t> missing;
+    for (size_t i = 0; i < paths.size(); i++)
+    {
+        keys[i] = CanonicalPath(paths[i]);
+        auto found = models.find(keys[i]);
+        if (found != models.end() && (result[i] = found->second.lock()))
+            stats.modelHits++;
+        else if (find_if(missing.begin(), missing.end(), [&](size_t m) { return keys[m] == keys[i]; }) == missing.end())
+            missing.push_back(i);
+    }
+
+    // импорт без OpenGL - параллельно
+    vector<ModelData> imported(missing.size());
+    ThreadPool::Instance().ParallelFor(missing.size(), [&](size_t i)
+    {
+        imported[i] = Model::Import(paths[missing[i]]);
+    });
+
+    // буферы и текстуры - в этом потоке
+    for (size_t i = 0; i < missing.size(); i++)
+    {
+        stats.modelMisses++;
+        ModelHandle model = make_shared<Model>(move(imported[i]));
+        models[keys[missing[i]]] = model;
+        result[missing[i]] = model;
+    }
+
+    // повторы одного файла в списке получают ту же модель
+    for (size_t i = 0; i < paths.size(); i++)
+        if (!result[i])
+        {
+            result[i] = models[keys[i]].lock();
+            stats.modelHits++;
+        }
+    return result;
+}
+
+TextureHandle AssetManager::LoadTexture(const string& path, const string& typeName)
+{
+    CpuZone zone("LoadTexture");
+    string key = CanonicalPath(path);
+
+    // сначала ищем по пути: файл даже не нужно читать
+    auto found = texturesByPath.find(key);
+    if (found != texturesByPath.end())
+    {
+        if (TextureHandle texture = found->second.lock())
+        {
+            stats.textureHits++;
+            return texture;
+        }
+    }
+
+    // если есть свежая подготовленная версия, читаем её вместо картинки
+    string cooked = textureCooker::CookedPath(key);
+    bool useCooked = CookedIsFresh(key, cooked);
+
+    vector<unsigned char> bytes;
+    if (!ReadFileBytes(useCooked ? cooked : key, bytes))
+        std::cout << "Texture failed to load at path: " << path << std::endl;
+    uint64_t hash = HashBytes(bytes);
+
+    // тот же файл под другим именем (копия, другой относительный путь): используем уже загруженную текстуру
+    auto sameContent = texturesByHash.find(hash);
+    if (!bytes.empty() && sameContent != texturesByHash.end())
+    {
+        if (TextureHandle texture = sameContent->second.lock())
+        {
+            stats.textureHashHits++;
+            texturesByPath[key] = texture;
+            return texture;
+        }
+    }
+
+    stats.textureMisses++;
+    TextureStreamer& streamer = TextureStreamer::Instance();
+    Texture* raw = new Texture();
+    if (streamer.Enabled() && !bytes.empty())
+    {
+        // декодирование уходит в фоновый поток, а пока меш рисуется с заглушкой
+        raw->textureID = streamer.Placeholder();
+    }
+    else
+    {
+        if (useCooked)
+            raw->texture = TextureFromKtx(bytes, cooked);
+        if (!raw->texture)
+        {
+            if (useCooked)
+                ReadFileBytes(key, bytes);
+            raw->texture = TextureFromFile(bytes, path);
+        }
+        raw->textureID = raw->texture;
+    }
+    raw->type = typeName;
+    raw->path = key;
+    raw->hash = hash;
+
+    // текстура видеокарты удаляется вместе с последней ссылкой на неё (заглушкой Texture не владеет)
+    TextureHandle texture(raw);
+    texturesByPath[key] = texture;
+    if (!bytes.empty())
+        texturesByHash[hash] = texture;
+    if (raw->textureID == streamer.Placeholder())
+        streamer.Request(texture, move(bytes), useCooked, useCooked ? cooked : path, key);
+    return texture;
+}
+
+void AssetManager::Collect()
+{
+    for (auto it = models.begin(); it != models.end();)
+        it = it->second.expired() ? models.erase(it) : next(it);
+    for (auto it = texturesByPath.begin(); it != texturesByPath.end();)
+        it = it->second.expired() ? texturesByPath.erase(it) : next(it);
+    for (auto it = texturesByHash.begin(); it != texturesByHash.end();)
+        it = it->second.expired() ? texturesByHash.erase(it) : next(it);
+}
+
+AssetManager::Stats AssetManager::GetStats()
+{
+    Collect();
+    stats.liveModels = models.size();
+    stats.liveTextures = texturesByHash.size();
+    stats.cpuGeometryBytes = 0;
+    for (auto& entry : models)
+        if (ModelHandle model = entry.second.lock())
+            for (const auto& mesh : model->meshes)
+                stats.cpuGeometryBytes += mesh.CpuBytes();
+    stats.gpuGeometryBytes = GeometryPool::Instance().VertexBytes() + GeometryPool::Instance().IndexBytes();
+    return stats;
+}
+
+void AssetManager::PrintStats()
+{
+    Stats s = GetStats();
+    std::cout << "assets: models " << s.liveModels << " live, " << s.modelHits << " hits, " << s.modelMisses << " misses; "
+        << "textures " << s.liveTextures << " live, " << s.textureHits << " path hits, " << s.textureHashHits << " content hits, "
+        << s.textureMisses << " misses" << std::endl;
+    std::cout << "geometry: " << s.gpuGeometryBytes / 1024 << " KB on GPU, " << s.cpuGeometryBytes / 1024 << " KB of CPU copies" << std::endl;
+}
@@ -0,0 +1,69 @@
+#pragma once
+
+#include "mesh.h"
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class Model;
+
+// ссылка на модель, выданную менеджером ресурсов
+typedef shared_ptr<Model> ModelHandle;
+
+// Общий на всю программу менеджер ресурсов.
+// Раздаёт ссылки (shared_ptr) на модели и текстуры: модели ищутся по каноническому пути к файлу,
+// текстуры - по каноническому пути, а если путь другой - по хэшу содержимого файла.
+// Кэш хранит только weak_ptr, поэтому ресурс удаляется, как только его перестают использовать.
+class AssetManager
+{
+public:
+    // счётчики попаданий/промахов кэша
+    struct Stats
+    {
+        size_t modelHits = 0;
+        size_t modelMisses = 0;
+        size_t textureHits = 0; // текстура найдена по пути
+        size_t textureHashHits = 0; // путь другой, но содержимое файла совпало с уже загруженной текстурой
+        size_t textureMisses = 0;
+        size_t liveModels = 0; // сколько моделей сейчас используется
+        size_t liveTextures = 0; // сколько текстур сейчас используется
+        size_t cpuGeometryBytes = 0; // копии вершин и индексов живых моделей в памяти CPU
+        size_t gpuGeometryBytes = 0; // вершины и индексы в общем буфере геометрии
+    };
+
+    static AssetManager& Instance();
+
+    // загрузка модели (Assimp + буферы видеокарты) или выдача уже загруженной
+    ModelHandle LoadModel(const string& path);
+
+    // загрузка нескольких моделей: ещё не загруженные файлы импортируются параллельно (каждый в своём потоке),
+    // а буферы и текстуры создаются по очереди в вызывающем потоке OpenGL
+    vector<ModelHandle> LoadModels(const vector<string>& paths);
+
+    // загрузка текстуры (stb_image + glTexImage2D) или выдача уже загруженной
+    TextureHandle LoadTexture(const string& path, const string& typeName);
+
+    Stats GetStats();
+    void PrintStats();
+
+    // удаляем из кэша записи о ресурсах, которые уже никем не используются
+    void Collect();
+
+    // канонический путь: абсолютный, без "." и "..", с одинаковыми разделителями
+    static string CanonicalPath(const string& path);
+
+private:
+    AssetManager() {}
+    AssetManager(const AssetManager&) = delete;
+    AssetManager& operator=(const AssetManager&) = delete;
+
+    map<string, weak_ptr<Model>> models;
+    map<string, weak_ptr<Texture>> texturesByPath;
+    map<uint64_t, weak_ptr<Texture>> texturesByHash;
+    Stats stats;
+};
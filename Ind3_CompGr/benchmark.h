@@ -0,0 +1,70 @@
+#pragma once
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+using namespace std;
+
+// Сбор времени кадров (или любых других замеров) для бенчмарков:
+// среднее, перцентили и максимум в миллисекундах.
+class FrameTimeStats
+{
+public:
+    void Clear() { samples.clear(); }
+    void Add(double ms) { samples.push_back(ms); }
+    size_t Count() const { return samples.size(); }
+
+    double Mean() const
+    {
+        if (samples.empty())
+            return 0.0;
+        double sum = 0.0;
+        for (double s : samples)
+            sum += s;
+        return sum / samples.size();
+    }
+
+    // p от 0 до 100
+    double Percentile(double p) const
+    {
+        if (samples.empty())
+            return 0.0;
+        vector<double> sorted = samples;
+        sort(sorted.begin(), sorted.end());
+        size_t index = (size_t)(p / 100.0 * (sorted.size() - 1) + 0.5);
+        return sorted[min(index, sorted.size() - 1)];
+    }
+
+    double Max() const
+    {
+        return samples.empty() ? 0.0 : *max_element(samples.begin(), samples.end());
+    }
+
+    void Print(const char* name) const
+    {
+        printf("%-32s mean %8.3f ms  p50 %8.3f  p95 %8.3f  p99 %8.3f  max %8.3f  (%zu samples)\n",
+            name, Mean(), Percentile(50), Percentile(95), Percentile(99), Max(), samples.size());
+    }
+
+private:
+    vector<double> samples;
+};
+
+// Простой таймер на steady_clock
+class ScopeTimer
+{
+public:
+    ScopeTimer() : start(chrono::steady_clock::now()) {}
+
+    double ElapsedMs() const
+    {
+        return chrono::duration<double, milli>(chrono::steady_clock::now() - start).count();
+    }
+
+    void Restart() { start = chrono::steady_clock::now(); }
+
+private:
+    chrono::steady_clock::time_point start;
+};
@@ -0,0 +1,44 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include <cmath>
+
+// Ограничивающий параллелепипед, выровненный по осям (AABB)
+struct BoundingBox
+{
+    glm::vec3 min = glm::vec3(0.0f);
+    glm::vec3 max = glm::vec3(0.0f);
+
+    glm::vec3 Center() const { return (min + max) * 0.5f; }
+    glm::vec3 Extent() const { return (max - min) * 0.5f; }
+
+    // расширяем параллелепипед, чтобы он содержал другой
+    void Merge(const BoundingBox& other)
+    {
+        min = glm::min(min, other.min);
+        max = glm::max(max, other.max);
+    }
+
+    // параллелепипед после преобразования matrix (снова выровненный по осям, метод Арво)
+    BoundingBox Transform(const glm::mat4& matrix) const
+    {
+        glm::vec3 center = glm::vec3(matrix * glm::vec4(Center(), 1.0f));
+        glm::vec3 extent = Extent();
+        glm::vec3 newExtent;
+        for (int row = 0; row < 3; row++)
+            newExtent[row] = fabsf(matrix[0][row]) * extent.x + fabsf(matrix[1][row]) * extent.y + fabsf(matrix[2][row]) * extent.z;
+
+        BoundingBox box;
+        box.min = center - newExtent;
+        box.max = center + newExtent;
+        return box;
+    }
+};
+
+// Ограничивающая сфера
+struct BoundingSphere
+{
+    glm::vec3 center = glm::vec3(0.0f);
+    float radius = 0.0f;
+};
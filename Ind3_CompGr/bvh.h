@@ -0,0 +1,301 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "frustum.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Иерархия ограничивающих объёмов (BVH) над параллелепипедами объектов сцены.
+// Строится сверху вниз делением по медиане вдоль самой длинной оси центров;
+// объекты переупорядочиваются так, что у каждого узла они лежат подряд в order[first, first + count).
+// Благодаря этому узел, целиком попавший в пирамиду видимости, добавляет свои объекты без проверок.
+// Если объект сдвинулся, Refit обновляет его лист и поднимается к корню (дерево не перестраивается).
+class Bvh
+{
+public:
+    // сколько объектов может лежать в одном листе
+    static const int LeafSize = 4;
+
+    void Build(const vector<BoundingBox>& objectBoxes)
+    {
+        boxes = objectBoxes;
+        nodes.clear();
+        order.resize(boxes.size());
+        objectLeaf.assign(boxes.size(), -1);
+        for (size_t i = 0; i < order.size(); i++)
+            order[i] = (int)i;
+        if (boxes.empty())
+            return;
+
+        nodes.reserve(boxes.size() * 2 / LeafSize + 1);
+        centers.resize(boxes.size());
+        for (size_t i = 0; i < boxes.size(); i++)
+            centers[i] = boxes[i].Center();
+
+        BuildNode(-1, 0, (int)boxes.size());
+    }
+
+    size_t ObjectCount() const { return boxes.size(); }
+    size_t NodeCount() const { return nodes.size(); }
+
+    // объект index получил новый параллелепипед: обновляем его лист и всех предков
+    void Refit(size_t index, const BoundingBox& box)
+    {
+        boxes[index] = box;
+        int node = objectLeaf[index];
+        while (node >= 0)
+        {
+            Node& n = nodes[node];
+            BoundingBox updated;
+            if (n.count > 0 && n.left < 0)
+            {
+                updated = boxes[order[n.first]];
+                for (int i = 1; i < n.count; i++)
+                    updated.Merge(boxes[order[n.first + i]]);
+            }
+            else
+            {
+                updated = nodes[n.left].box;
+                updated.Merge(nodes[n.right].box);
+            }
+
+            // предки не изменятся, если параллелепипед узла остался тем же
+            if (updated.min == n.box.min && updated.max == n.box.max)
+                break;
+            n.box = updated;
+            node = n.parent;
+        }
+    }
+
+    // отмечаем в visible (по индексу объекта) все объекты, пересекающие пирамиду видимости; возвращает их количество
+    size_t QueryFrustum(const Frustum& frustum, uint8_t* visible) const
+    {
+        fill(visible, visible + boxes.size(), (uint8_t)0);
+        if (nodes.empty())
+            return 0;
+
+        size_t found = 0;
+        // в стеке вместе с узлом хранится маска плоскостей, которые ещё нужно проверять.
+        // Стек растёт по необходимости (глубина дерева не ограничена), память остаётся от прошлых запросов
+        vector<StackEntry>& stack = frustumStack;
+        stack.clear();
+        stack.push_back(StackEntry{ 0, 0x3f });
+        while (!stack.empty())
+        {
+            StackEntry entry = stack.back();
+            stack.pop_back();
+            const Node& n = nodes[entry.node];
+
+            int mask = entry.planes;
+            bool outside = false;
+            for (int p = 0; p < 6 && !outside; p++)
+            {
+                if (!(mask & (1 << p)))
+                    continue;
+                int side = Classify(frustum.planes[p], n.box);
+                if (side < 0)
+                    outside = true;
+                else if (side > 0)
+                    mask &= ~(1 << p); // узел целиком по внутреннюю сторону плоскости: потомкам её проверять не нужно
+            }
+            if (outside)
+                continue;
+
+            if (mask == 0 || n.left < 0)
+            {
+                // узел целиком внутри пирамиды или это лист
+                for (int i = 0; i < n.count; i++)
+                {
+                    int object = order[n.first + i];
+                    if (mask == 0 || frustum.Intersects(boxes[object]))
+                    {
+                        visible[object] = 1;
+                        found++;
+                    }
+                }
+                continue;
+            }
+
+            stack.push_back(StackEntry{ n.left, mask });
+            stack.push_back(StackEntry{ n.right, mask });
+        }
+        return found;
+    }
+
+    // ближайший объект, чей параллелепипед пересекает луч; -1, если таких нет
+    int QueryRay(const glm::vec3& origin, const glm::vec3& direction, float maxDistance, float* hitDistance = NULL) const
+    {
+        if (nodes.empty())
+            return -1;
+
+        glm::vec3 invDir(1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z);
+        float closest = maxDistance;
+        int hit = -1;
+
+        vector<int>& stack = rayStack;
+        stack.clear();
+        stack.push_back(0);
+        while (!stack.empty())
+        {
+            const Node& n = nodes[stack.back()];
+            stack.pop_back();
+            float tNode;
+            if (!RayBox(origin, invDir, n.box, closest, tNode))
+                continue;
+
+            if (n.left < 0)
+            {
+                for (int i = 0; i < n.count; i++)
+                {
+                    int object = order[n.first + i];
+                    float t;
+                    if (RayBox(origin, invDir, boxes[object], closest, t))
+                    {
+                        closest = t;
+                        hit = object;
+                    }
+                }
+                continue;
+            }
+
+            // сначала обходим ближайшего потомка: тогда дальний чаще отсекается по closest
+            float tLeft, tRight;
+            bool hitLeft = RayBox(origin, invDir, nodes[n.left].box, closest, tLeft);
+            bool hitRight = RayBox(origin, invDir, nodes[n.right].box, closest, tRight);
+            if (hitLeft && hitRight)
+            {
+                if (tLeft < tRight)
+                {
+                    stack.push_back(n.right);
+                    stack.push_back(n.left);
+                }
+                else
+                {
+                    stack.push_back(n.left);
+                    stack.push_back(n.right);
+                }
+            }
+            else if (hitLeft)
+                stack.push_back(n.left);
+            else if (hitRight)
+                stack.push_back(n.right);
+        }
+
+        if (hitDistance)
+            *hitDistance = closest;
+        return hit;
+    }
+
+    // пересечение луча с параллелепипедом (метод плит); t - расстояние до входа
+    static bool RayBox(const glm::vec3& origin, const glm::vec3& invDir, const BoundingBox& box, float maxDistance, float& t)
+    {
+        float tmin = 0.0f, tmax = maxDistance;
+        for (int a = 0; a < 3; a++)
+        {
+            // луч параллелен плитам: 0 * inf дало бы NaN, если начало лежит на грани, - проверяем начало напрямую
+            if (std::isinf(invDir[a]))
+            {
+                if (origin[a] < box.min[a] || origin[a] > box.max[a])
+                    return false;
+                continue;
+            }
+            float t1 = (box.min[a] - origin[a]) * invDir[a];
+            float t2 = (box.max[a] - origin[a]) * invDir[a];
+            tmin = max(tmin, min(t1, t2));
+            tmax = min(tmax, max(t1, t2));
+        }
+        t = tmin;
+        return tmin <= tmax;
+    }
+
+private:
+    struct Node
+    {
+        BoundingBox box;
+        int first; // начало объектов узла в order
+        int count; // количество объектов узла
+        int left; // левый потомок (-1 у листа)
+        int right; // правый потомок
+        int parent; // родитель (-1 у корня)
+    };
+
+    struct StackEntry
+    {
+        int node;
+        int planes;
+    };
+
+    int BuildNode(int parent, int first, int count)
+    {
+        int index = (int)nodes.size();
+        nodes.push_back(Node());
+        Node node;
+        node.first = first;
+        node.count = count;
+        node.left = node.right = -1;
+        node.parent = parent;
+
+        node.box = boxes[order[first]];
+        BoundingBox centerBox;
+        centerBox.min = centerBox.max = centers[order[first]];
+        for (int i = 1; i < count; i++)
+        {
+            node.box.Merge(boxes[order[first + i]]);
+            centerBox.min = glm::min(centerBox.min, centers[order[first + i]]);
+            centerBox.max = glm::max(centerBox.max, centers[order[first + i]]);
+        }
+
+        if (count <= LeafSize)
+        {
+            for (int i = 0; i < count; i++)
+                objectLeaf[order[first + i]] = index;
+            nodes[index] = node;
+            return index;
+        }
+
+        // делим по медиане вдоль самой длинной оси центров
+        glm::vec3 size = centerBox.max - centerBox.min;
+        int axis = size.x > size.y ? (size.x > size.z ? 0 : 2) : (size.y > size.z ? 1 : 2);
+        int half = count / 2;
+        nth_element(order.begin() + first, order.begin() + first + half, order.begin() + first + count,
+            [&](int a, int b) { return centers[a][axis] < centers[b][axis]; });
+
+        nodes[index] = node;
+        int left = BuildNode(index, first, half);
+        int right = BuildNode(index, first + half, count - half);
+        nodes[index].left = left;
+        nodes[index].right = right;
+        return index;
+    }
+
+    // положение параллелепипеда относительно плоскости: -1 снаружи, 1 целиком внутри, 0 пересекает
+    static int Classify(const glm::vec4& plane, const BoundingBox& box)
+    {
+        glm::vec3 c = box.Center();
+        glm::vec3 e = box.Extent();
+        float d = plane.x * c.x + plane.y * c.y + plane.z * c.z + plane.w;
+        float r = fabsf(plane.x) * e.x + fabsf(plane.y) * e.y + fabsf(plane.z) * e.z;
+        if (d + r < 0.0f)
+            return -1;
+        if (d - r >= 0.0f)
+            return 1;
+        return 0;
+    }
+
+    vector<Node> nodes;
+    vector<BoundingBox> boxes; // параллелепипеды объектов (по индексу объекта)
+    vector<glm::vec3> centers; // центры параллелепипедов на момент построения
+    vector<int> order; // индексы объектов в порядке обхода дерева
+    vector<int> objectLeaf; // лист, в котором лежит объект
+    // стеки обхода (запросы константные, но память стеков переиспользуется; запросы из разных потоков не поддерживаются)
+    mutable vector<StackEntry> frustumStack;
+    mutable vector<int> rayStack;
+};
@@ -0,0 +1,188 @@
+#include "cpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+// событие зоны
+struct ZoneEvent
+{
+    const char* name;
+    uint64_t begin;
+    uint64_t end;
+};
+
+// буфер одного потока: пишет только его поток, читает выгрузка
+struct ThreadBuffer
+{
+    int id; // номер потока в трассе
+    atomic<const char*> name{ NULL };
+    atomic<unsigned> capture{ 0 }; // номер записи, к которой относятся события буфера
+    atomic<size_t> count{ 0 }; // сколько событий опубликовано
+    atomic<size_t> dropped{ 0 };
+    ZoneEvent events[cpuProfiler::EventsPerThread];
+};
+
+namespace cpuProfiler
+{
+    atomic<bool> recording{ false };
+}
+
+// номер текущей записи: поток, увидев новый номер, сам очищает свой буфер
+static atomic<unsigned> currentCapture{ 0 };
+
+// буферы всех потоков (живут до конца программы, потоки могут завершиться раньше)
+static mutex buffersMutex;
+static vector<unique_ptr<ThreadBuffer>> buffers;
+
+static thread_local ThreadBuffer* threadBuffer = NULL;
+// имя потока запоминается сразу, а буфер создаётся только при первой записанной зоне
+static thread_local const char* threadName = NULL;
+
+static ThreadBuffer* CurrentBuffer()
+{
+    if (!threadBuffer)
+    {
+        // единственное место с блокировкой: первая зона потока
+        lock_guard<mutex> lock(buffersMutex);
+        buffers.push_back(unique_ptr<ThreadBuffer>(new ThreadBuffer()));
+        threadBuffer = buffers.back().get();
+        threadBuffer->id = (int)buffers.size();
+        threadBuffer->name.store(threadName, memory_order_release);
+    }
+    unsigned capture = currentCapture.load(memory_order_acquire);
+    if (threadBuffer->capture.load(memory_order_relaxed) != capture)
+    {
+        threadBuffer->count.store(0, memory_order_relaxed);
+        threadBuffer->dropped.store(0, memory_order_relaxed);
+        threadBuffer->capture.store(capture, memory_order_release);
+    }
+    return threadBuffer;
+}
+
+// имя для JSON: кавычки и обратные косые черты экранируются
+static void WriteJsonString(FILE* file, const char* text)
+{
+    fputc('"', file);
+    for (const char* p = text; *p; p++)
+    {
+        if (*p == '"' || *p == '\\')
+            fputc('\\', file);
+        if ((unsigned char)*p >= 0x20)
+            fputc(*p, file);
+    }
+    fputc('"', file);
+}
+
+namespace cpuProfiler
+{
+    void Record(const char* name, uint64_t begin, uint64_t end)
+    {
+        ThreadBuffer* buffer = CurrentBuffer();
+        size_t count = buffer->count.load(memory_order_relaxed);
+        if (count == EventsPerThread)
+        {
+            buffer->dropped.fetch_add(1, memory_order_relaxed);
+            return;
+        }
+        buffer->events[count] = ZoneEvent{ name, begin, end };
+        // событие публикуется после записи
+        buffer->count.store(count + 1, memory_order_release);
+    }
+
+    void SetThreadName(const char* name)
+    {
+        threadName = name;
+        if (threadBuffer)
+            threadBuffer->name.store(name, memory_order_release);
+    }
+
+    void StartCapture()
+    {
+        currentCapture.fetch_add(1, memory_order_acq_rel);
+        recording = true;
+    }
+
+    void StopCapture()
+    {
+        recording = false;
+    }
+
+    bool ExportChromeTrace(const string& path)
+    {
+        FILE* file = fopen(path.c_str(), "w");
+        if (!file)
+            return false;
+
+        unsigned capture = currentCapture.load(memory_order_acquire);
+        lock_guard<mutex> lock(buffersMutex);
+
+        // время в трассе отсчитывается от самого раннего события
+        uint64_t origin = UINT64_MAX;
+        for (auto& buffer : buffers)
+        {
+            if (buffer->capture.load(memory_order_acquire) != capture)
+                continue;
+            size_t count = buffer->count.load(memory_order_acquire);
+            for (size_t i = 0; i < count; i++)
+                origin = min(origin, buffer->events[i].begin);
+        }
+        if (origin == UINT64_MAX)
+            origin = 0;
+
+        fprintf(file, "{\"traceEvents\":[\n");
+        bool first = true;
+        for (auto& buffer : buffers)
+        {
+            const char* name = buffer->name.load(memory_order_acquire);
+            if (name)
+            {
+                fprintf(file, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":", first ? "" : ",\n", buffer->id);
+                WriteJsonString(file, name);
+                fprintf(file, "}}");
+                first = false;
+            }
+            if (buffer->capture.load(memory_order_acquire) != capture)
+                continue;
+            size_t count = buffer->count.load(memory_order_acquire);
+            for (size_t i = 0; i < count; i++)
+            {
+                const ZoneEvent& e = buffer->events[i];
+                // полные события ("X"): начало и длительность в микросекундах
+                fprintf(file, "%s{\"name\":", first ? "" : ",\n");
+                WriteJsonString(file, e.name);
+                fprintf(file, ",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f}",
+                    buffer->id, (e.begin - origin) / 1000.0, (e.end - e.begin) / 1000.0);
+                first = false;
+            }
+        }
+        fprintf(file, "\n],\"displayTimeUnit\":\"ms\"}\n");
+        bool ok = !ferror(file);
+        fclose(file);
+        return ok;
+    }
+
+    size_t EventCount()
+    {
+        unsigned capture = currentCapture.load(memory_order_acquire);
+        lock_guard<mutex> lock(buffersMutex);
+        size_t total = 0;
+        for (auto& buffer : buffers)
+            if (buffer->capture.load(memory_order_acquire) == capture)
+                total += buffer->count.load(memory_order_acquire);
+        return total;
+    }
+
+    size_t DroppedEvents()
+    {
+        unsigned capture = currentCapture.load(memory_order_acquire);
+        lock_guard<mutex> lock(buffersMutex);
+        size_t total = 0;
+        for (auto& buffer : buffers)
+            if (buffer->capture.load(memory_order_acquire) == capture)
+                total += buffer->dropped.load(memory_order_relaxed);
+        return total;
+    }
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+// Профилировщик зон на CPU с выгрузкой в формат Chrome trace (chrome://tracing, Perfetto).
+// Зона - объект CpuZone на время работы участка кода. Пока запись не включена, зона только читает
+// один атомарный флаг. Во время записи зона при выходе кладёт (имя, начало, конец) в буфер своего потока:
+// у каждого потока свой буфер фиксированного размера, в который пишет только он сам, поэтому блокировок нет,
+// а выгрузка читает из буфера только уже опубликованные (счётчиком с release) события.
+// Имена зон - строковые литералы (хранится только указатель).
+namespace cpuProfiler
+{
+    // сколько событий помещается в буфер одного потока за одну запись (остальные отбрасываются)
+    const size_t EventsPerThread = 1 << 16;
+
+    extern atomic<bool> recording;
+
+    inline bool Recording() { return recording.load(memory_order_relaxed); }
+
+    // время в наносекундах (монотонные часы)
+    inline uint64_t Now()
+    {
+        return (uint64_t)chrono::duration_cast<chrono::nanoseconds>(chrono::steady_clock::now().time_since_epoch()).count();
+    }
+
+    // записываем завершённую зону в буфер текущего потока
+    void Record(const char* name, uint64_t begin, uint64_t end);
+
+    // имя текущего потока в трассе (литерал)
+    void SetThreadName(const char* name);
+
+    // начало записи: события прошлой записи забываются
+    void StartCapture();
+    // конец записи (записанное остаётся до следующего StartCapture)
+    void StopCapture();
+
+    // выгрузка записанных событий в JSON формата Chrome trace event; false, если файл не записался
+    bool ExportChromeTrace(const string& path);
+
+    // сколько событий записано и сколько отброшено из-за переполнения буферов
+    size_t EventCount();
+    size_t DroppedEvents();
+}
+
+// зона профилирования на время жизни объекта
+class CpuZone
+{
+public:
+    explicit CpuZone(const char* name) : name(cpuProfiler::Recording() ? name : NULL), begin(this->name ? cpuProfiler::Now() : 0) {}
+    ~CpuZone()
+    {
+        if (name)
+            cpuProfiler::Record(name, begin, cpuProfiler::Now());
+    }
+
+    CpuZone(const CpuZone&) = delete;
+    CpuZone& operator=(const CpuZone&) = delete;
+
+private:
+    const char* name;
+    uint64_t begin;
+};
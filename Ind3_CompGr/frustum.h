@@ -0,0 +1,231 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+#if defined(__AVX__)
+#include <immintrin.h>
+#define CULLING_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#include <emmintrin.h>
+#define CULLING_SSE 1
+#endif
+
+using namespace std;
+
+// Пирамида видимости камеры: 6 плоскостей (нормали смотрят внутрь), вида dot(n, p) + w >= 0 для точек внутри
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    // извлекаем плоскости из матрицы proj * view (метод Гриба-Хартмана)
+    void Extract(const glm::mat4& viewProj)
+    {
+        glm::vec4 row[4];
+        for (int i = 0; i < 4; i++)
+            row[i] = glm::vec4(viewProj[0][i], viewProj[1][i], viewProj[2][i], viewProj[3][i]);
+
+        planes[0] = row[3] + row[0]; // левая
+        planes[1] = row[3] - row[0]; // правая
+        planes[2] = row[3] + row[1]; // нижняя
+        planes[3] = row[3] - row[1]; // верхняя
+        planes[4] = row[3] + row[2]; // ближняя
+        planes[5] = row[3] - row[2]; // дальняя
+
+        for (auto& p : planes)
+        {
+            float len = glm::length(glm::vec3(p));
+            if (len > 0.0f)
+                p = p / len;
+        }
+    }
+
+    // виден ли параллелепипед (хотя бы частично)
+    bool Intersects(const BoundingBox& box) const
+    {
+        glm::vec3 c = box.Center();
+        glm::vec3 e = box.Extent();
+        for (const auto& p : planes)
+        {
+            float d = p.x * c.x + p.y * c.y + p.z * c.z + p.w;
+            float r = fabsf(p.x) * e.x + fabsf(p.y) * e.y + fabsf(p.z) * e.z;
+            if (d + r < 0.0f)
+                return false;
+        }
+        return true;
+    }
+};
+
+// Отсечение по пирамиде видимости для большого числа объектов.
+// Параллелепипеды хранятся в виде структуры массивов (центр и полуразмер по каждой оси отдельно),
+// поэтому проверка идёт пачками по 4 (SSE) или 8 (AVX) объектов за итерацию.
+class FrustumCuller
+{
+public:
+    // ширина пачки: массивы дополняются до кратного ей размера
+    static const size_t Lane = 8;
+
+    void Resize(size_t count)
+    {
+        if (count == this->count && !visible.empty())
+            return;
+        this->count = count;
+        size_t padded = (count + Lane - 1) / Lane * Lane;
+        for (int i = 0; i < 3; i++)
+        {
+            center[i].assign(padded, 0.0f);
+            // пустые хвостовые элементы никогда не видны: огромный отрицательный полуразмер
+            extent[i].assign(padded, -1e30f);
+        }
+        visible.assign(padded, 0);
+    }
+
+    size_t Count() const { return count; }
+
+    void SetBox(size_t index, const BoundingBox& box)
+    {
+        glm::vec3 c = box.Center();
+        glm::vec3 e = box.Extent();
+        for (int i = 0; i < 3; i++)
+        {
+            center[i][index] = c[i];
+            extent[i][index] = e[i];
+        }
+    }
+
+    // результат последнего Cull: 1 - объект виден, 0 - отсечён
+    bool IsVisible(size_t index) const { return visible[index] != 0; }
+    const uint8_t* Visible() const { return visible.data(); }
+
+    // проверяем все объекты; возвращает количество видимых
+    size_t Cull(const Frustum& frustum)
+    {
+#if defined(CULLING_AVX)
+        return CullAVX(frustum);
+#elif defined(CULLING_SSE)
+        return CullSSE(frustum);
+#else
+        return CullScalar(frustum);
+#endif
+    }
+
+    // та же проверка по одному объекту (для сравнения в бенчмарке и для платформ без SSE)
+    size_t CullScalar(const Frustum& frustum)
+    {
+        size_t visibleCount = 0;
+        for (size_t i = 0; i < count; i++)
+        {
+            bool inside = true;
+            for (const auto& p : frustum.planes)
+            {
+                // порядок операций тот же, что и в SIMD-версиях, чтобы результаты совпадали бит в бит
+                float d = (p.x * center[0][i] + p.y * center[1][i]) + (p.z * center[2][i] + p.w);
+                float r = (fabsf(p.x) * extent[0][i] + fabsf(p.y) * extent[1][i]) + fabsf(p.z) * extent[2][i];
+                if (d + r < 0.0f)
+                {
+                    inside = false;
+                    break;
+                }
+            }
+            visible[i] = inside;
+            visibleCount += inside;
+        }
+        return visibleCount;
+    }
+
+#if defined(CULLING_SSE) || defined(CULLING_AVX)
+    // 4 объекта за итерацию
+    size_t CullSSE(const Frustum& frustum)
+    {
+        __m128 pn[6][3], pa[6][3], pw[6];
+        for (int p = 0; p < 6; p++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                pn[p][k] = _mm_set1_ps(frustum.planes[p][k]);
+                pa[p][k] = _mm_set1_ps(fabsf(frustum.planes[p][k]));
+            }
+            pw[p] = _mm_set1_ps(frustum.planes[p].w);
+        }
+
+        size_t visibleCount = 0;
+        const __m128 zero = _mm_setzero_ps();
+        for (size_t i = 0; i < count; i += 4)
+        {
+            __m128 cx = _mm_loadu_ps(&center[0][i]), cy = _mm_loadu_ps(&center[1][i]), cz = _mm_loadu_ps(&center[2][i]);
+            __m128 ex = _mm_loadu_ps(&extent[0][i]), ey = _mm_loadu_ps(&extent[1][i]), ez = _mm_loadu_ps(&extent[2][i]);
+
+            __m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m128 d = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pn[p][0], cx), _mm_mul_ps(pn[p][1], cy)),
+                    _mm_add_ps(_mm_mul_ps(pn[p][2], cz), pw[p]));
+                __m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(pa[p][0], ex), _mm_mul_ps(pa[p][1], ey)), _mm_mul_ps(pa[p][2], ez));
+                inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(d, r), zero));
+            }
+
+            int mask = _mm_movemask_ps(inside);
+            for (int k = 0; k < 4; k++)
+                visible[i + k] = (mask >> k) & 1;
+            visibleCount += PopCount4(mask);
+        }
+        return visibleCount;
+    }
+#endif
+
+#if defined(CULLING_AVX)
+    // 8 объектов за итерацию
+    size_t CullAVX(const Frustum& frustum)
+    {
+        __m256 pn[6][3], pa[6][3], pw[6];
+        for (int p = 0; p < 6; p++)
+        {
+            for (int k = 0; k < 3; k++)
+            {
+                pn[p][k] = _mm256_set1_ps(frustum.planes[p][k]);
+                pa[p][k] = _mm256_set1_ps(fabsf(frustum.planes[p][k]));
+            }
+            pw[p] = _mm256_set1_ps(frustum.planes[p].w);
+        }
+
+        size_t visibleCount = 0;
+        const __m256 zero = _mm256_setzero_ps();
+        for (size_t i = 0; i < count; i += 8)
+        {
+            __m256 cx = _mm256_loadu_ps(&center[0][i]), cy = _mm256_loadu_ps(&center[1][i]), cz = _mm256_loadu_ps(&center[2][i]);
+            __m256 ex = _mm256_loadu_ps(&extent[0][i]), ey = _mm256_loadu_ps(&extent[1][i]), ez = _mm256_loadu_ps(&extent[2][i]);
+
+            __m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+            for (int p = 0; p < 6; p++)
+            {
+                __m256 d = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pn[p][0], cx), _mm256_mul_ps(pn[p][1], cy)),
+                    _mm256_add_ps(_mm256_mul_ps(pn[p][2], cz), pw[p]));
+                __m256 r = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(pa[p][0], ex), _mm256_mul_ps(pa[p][1], ey)), _mm256_mul_ps(pa[p][2], ez));
+                inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(d, r), zero, _CMP_GE_OQ));
+            }
+
+            int mask = _mm256_movemask_ps(inside);
+            for (int k = 0; k < 8; k++)
+                visible[i + k] = (mask >> k) & 1;
+            visibleCount += PopCount4(mask & 15) + PopCount4(mask >> 4);
+        }
+        return visibleCount;
+    }
+#endif
+
+private:
+    static int PopCount4(int mask)
+    {
+        return (mask & 1) + ((mask >> 1) & 1) + ((mask >> 2) & 1) + ((mask >> 3) & 1);
+    }
+
+    size_t count = 0;
+    vector<float> center[3];
+    vector<float> extent[3];
+    vector<uint8_t> visible;
+};
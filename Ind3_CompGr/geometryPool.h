@@ -0,0 +1,491 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glHandle.h"
+#include "vertex.h"
+#include "vertexPacking.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+using namespace std;
+
+// точки привязки вершинных буферов в общем VAO
+const GLuint VertexBinding = 0; // вершины (атрибуты 0-2; в VAO позиций - только позиции, атрибут 0)
+const GLuint InstanceIdBinding = 1; // номер экземпляра (атрибут 3, делитель 1)
+
+// формат вершин в общем буфере
+enum class VertexFormat
+{
+    Float, // Vertex, 32 байта
+    Packed // PackedVertex, 16 байт (см. vertexPacking.h)
+};
+
+// Общий буфер геометрии: вершины и индексы всех статических мешей лежат в одном VBO и одном EBO,
+// а меш хранит только своё место в них (baseVertex, firstIndex, indexCount).
+// Поэтому на всю сцену нужен один VAO, и вся сцена может рисоваться через glMultiDrawElementsIndirect.
+// Место, освобождённое мешами (Free), используется снова (первый подходящий промежуток), остальное выделяется
+// в конец буфера; при нехватке буфер увеличивается вдвое с копированием на GPU. Обратно буфер не уменьшается.
+// Формат вершин общий для всего буфера и выбирается до загрузки первой модели (SetFormat).
+// Индексы локальные для меша, поэтому у мешей меньше 65536 вершин они хранятся 16-битными в отдельном EBO;
+// рисующий код привязывает к VAO нужный EBO по indexType (BindIndices).
+// Для проходов без закраски (глубина, тени) есть второй поток - только позиции без швов (см. meshOptimize::BuildPositionStream)
+// в своём VBO и со своим VAO (BindPositions): 12 байт на позицию вместо 32 (8 вместо 16 в упакованном формате).
+// Индексы потока позиций лежат в тех же EBO, что и обычные, у них просто свои Range.
+class GeometryPool
+{
+public:
+    // место меша в общем буфере
+    struct Range
+    {
+        GLint baseVertex = 0; // номер первой вершины меша в общем VBO
+        GLuint firstIndex = 0; // номер первого индекса меша в общем EBO
+        GLsizei indexCount = 0; // количество индексов
+        GLenum indexType = GL_UNSIGNED_INT; // GL_UNSIGNED_SHORT - индексы в 16-битном EBO, firstIndex считается в нём
+        GLsizei vertexCount = 0; // сколько вершин (позиций) у меша, на которые ссылаются индексы
+        unsigned generation = 0; // поколение буфера (после Release старые места освобождать нельзя)
+
+        // смещение первого индекса в байтах (аргумент indices у glDrawElements*)
+        const void* IndexOffset() const { return (const void*)((size_t)firstIndex * IndexSize(indexType)); }
+    };
+
+    static size_t IndexSize(GLenum indexType) { return indexType == GL_UNSIGNED_SHORT ? sizeof(uint16_t) : sizeof(GLuint); }
+
+    static GeometryPool& Instance()
+    {
+        static GeometryPool instance;
+        return instance;
+    }
+
+    // копируем вершины и индексы меша в общий буфер (индексы остаются локальными для меша)
+    Range Add(const vector<Vertex>& vertices, const vector<int>& indices)
+    {
+        return Add(vertices.data(), vertices.size(), indices.data(), indices.size());
+    }
+
+    // то же из произвольной памяти (например, из отображённого в память кэша моделей).
+    // В упакованном формате позиции квантуются внутри параллелепипеда box (см. Model::PositionTransform)
+    Range Add(const Vertex* vertices, size_t vertexNumber, const int* indices, size_t indexNumber, const BoundingBox& box = BoundingBox())
+    {
+        if (!vao.handle)
+            Init();
+
+        size_t first;
+        if (!vertexSpans.Take(vertexNumber, first))
+        {
+            Reserve(vertexSpans.end + vertexNumber, indexSpans.end, shortIndexSpans.end);
+            first = vertexSpans.end;
+            vertexSpans.end += vertexNumber;
+        }
+        GLint baseVertex = (GLint)first;
+
+        if (format == VertexFormat::Packed)
+        {
+            packed.resize(vertexNumber);
+            vertexPacking::Pack(vertices, vertexNumber, box, packed.data(), packingError);
+            GlState::Instance().NamedBufferSubData(vbo, first * sizeof(PackedVertex), vertexNumber * sizeof(PackedVertex), packed.data());
+        }
+        else
+            GlState::Instance().NamedBufferSubData(vbo, first * sizeof(Vertex), vertexNumber * sizeof(Vertex), vertices);
+
+        Range range = AddIndices(indices, indexNumber, baseVertex);
+        range.vertexCount = (GLsizei)vertexNumber;
+        return range;
+    }
+
+    // поток позиций меша: уникальные позиции и индексы вершин, переведённые в номера позиций через remap.
+    // В упакованном формате позиции квантуются внутри того же box, что и вершины (числа совпадают)
+    Range AddPositions(const glm::vec3* positions, size_t positionNumber, const int* remap,
+        const int* indices, size_t indexNumber, const BoundingBox& box = BoundingBox())
+    {
+        if (!vao.handle)
+            Init();
+
+        size_t first;
+        if (!positionSpans.Take(positionNumber, first))
+        {
+            ReservePositions(positionSpans.end + positionNumber);
+            first = positionSpans.end;
+            positionSpans.end += positionNumber;
+        }
+        GLint basePosition = (GLint)first;
+
+        if (format == VertexFormat::Packed)
+        {
+            packedPositions.resize(positionNumber);
+            vertexPacking::PackPositions(positions, positionNumber, box, packedPositions.data());
+            GlState::Instance().NamedBufferSubData(positionVbo, first * sizeof(PackedPosition),
+                positionNumber * sizeof(PackedPosition), packedPositions.data());
+        }
+        else
+            GlState::Instance().NamedBufferSubData(positionVbo, first * sizeof(glm::vec3), positionNumber * sizeof(glm::vec3), positions);
+
+        Range range = AddPositionIndices(remap, indices, indexNumber, basePosition);
+        range.vertexCount = (GLsizei)positionNumber;
+        return range;
+    }
+
+    // индексы вершин (например, уровня детализации) в потоке позиций
+    Range AddPositionIndices(const int* remap, const int* indices, size_t indexNumber, GLint basePosition)
+    {
+        remapped.resize(indexNumber);
+        for (size_t i = 0; i < indexNumber; i++)
+            remapped[i] = remap[indices[i]];
+        return AddIndices(remapped.data(), indexNumber, basePosition);
+    }
+
+    // добавляем ещё один набор индексов к уже добавленным вершинам (например, упрощённый уровень детализации)
+    Range AddIndices(const vector<int>& indices, GLint baseVertex)
+    {
+        return AddIndices(indices.data(), indices.size(), baseVertex);
+    }
+
+    Range AddIndices(const int* indices, size_t indexNumber, GLint baseVertex)
+    {
+        if (!vao.handle)
+            Init();
+
+        Range range;
+        range.baseVertex = baseVertex;
+        range.indexCount = (GLsizei)indexNumber;
+        range.generation = generation;
+
+        // все индексы меньше 65536 - хватает 16 бит
+        bool fitsShort = true;
+        for (size_t i = 0; i < indexNumber && fitsShort; i++)
+            fitsShort = (unsigned)indices[i] <= 0xffff;
+
+        size_t first;
+        if (fitsShort)
+        {
+            if (!shortIndexSpans.Take(indexNumber, first))
+            {
+                Reserve(vertexSpans.end, indexSpans.end, shortIndexSpans.end + indexNumber);
+                first = shortIndexSpans.end;
+                shortIndexSpans.end += indexNumber;
+            }
+            range.indexType = GL_UNSIGNED_SHORT;
+            shortIndices.assign(indices, indices + indexNumber);
+            GlState::Instance().NamedBufferSubData(ebo16, first * sizeof(uint16_t), indexNumber * sizeof(uint16_t), shortIndices.data());
+        }
+        else
+        {
+            if (!indexSpans.Take(indexNumber, first))
+            {
+                Reserve(vertexSpans.end, indexSpans.end + indexNumber, shortIndexSpans.end);
+                first = indexSpans.end;
+                indexSpans.end += indexNumber;
+            }
+            GlState::Instance().NamedBufferSubData(ebo, first * sizeof(GLuint), indexNumber * sizeof(GLuint), indices);
+        }
+        range.firstIndex = (GLuint)first;
+        return range;
+    }
+
+    // место меша снова свободно (Mesh::Release): вершины lods[0] (или позиции, если positions) и индексы всех уровней.
+    // Места, выделенные до Release пула, уже не его - их пропускаем
+    void Free(const vector<Range>& lods, bool positions)
+    {
+        if (lods.empty() || lods[0].generation != generation)
+            return;
+        Spans& vertexPlace = positions ? positionSpans : vertexSpans;
+        vertexPlace.Free((size_t)lods[0].baseVertex, (size_t)lods[0].vertexCount);
+        for (const Range& lod : lods)
+            (lod.indexType == GL_UNSIGNED_SHORT ? shortIndexSpans : indexSpans).Free(lod.firstIndex, (size_t)lod.indexCount);
+    }
+
+    // привязываем общий VAO (вершины, индексы и номер экземпляра)
+    void Bind()
+    {
+        if (!vao.handle)
+            Init();
+        GlState::Instance().BindVertexArray(vao.handle);
+        bound = &vao;
+    }
+
+    // привязываем VAO потока позиций (позиции, индексы и номер экземпляра)
+    void BindPositions()
+    {
+        if (!vao.handle)
+            Init();
+        GlState::Instance().BindVertexArray(positionVao.handle);
+        bound = &positionVao;
+    }
+
+    // привязываем к текущему VAO буфер индексов нужной разрядности (вызывается после Bind/BindPositions, перед рисованием)
+    void BindIndices(GLenum indexType)
+    {
+        AttachIndices(*bound, indexType == GL_UNSIGNED_SHORT ? ebo16 : ebo);
+    }
+
+    // буфер с номерами экземпляров 0, 1, 2, ... для атрибута 3 (его создаёт рендерер, см. instancing.h)
+    void SetInstanceIdBuffer(GLuint buffer)
+    {
+        if (!vao.handle)
+            Init();
+        glVertexArrayVertexBuffer(vao.handle, InstanceIdBinding, buffer, 0, sizeof(GLuint));
+        glVertexArrayVertexBuffer(positionVao.handle, InstanceIdBinding, buffer, 0, sizeof(GLuint));
+    }
+
+    // сколько вершин и индексов занято (освобождённые места не считаются)
+    size_t VertexCount() const { return vertexSpans.Used(); }
+    size_t IndexCount() const { return indexSpans.Used() + shortIndexSpans.Used(); }
+
+    // формат вершин можно сменить только у пустого буфера (до загрузки моделей или после Release)
+    void SetFormat(VertexFormat newFormat)
+    {
+        if (vertexSpans.end == 0 && !vao.handle)
+            format = newFormat;
+    }
+    VertexFormat Format() const { return format; }
+    size_t VertexStride() const { return format == VertexFormat::Packed ? sizeof(PackedVertex) : sizeof(Vertex); }
+
+    size_t PositionStride() const { return format == VertexFormat::Packed ? sizeof(PackedPosition) : sizeof(glm::vec3); }
+
+    // сколько байт видеопамяти занимают вершины, позиции и индексы
+    size_t VertexBytes() const { return vertexSpans.Used() * VertexStride(); }
+    size_t PositionCount() const { return positionSpans.Used(); }
+    size_t PositionBytes() const { return positionSpans.Used() * PositionStride(); }
+    size_t IndexBytes() const { return indexSpans.Used() * sizeof(GLuint) + shortIndexSpans.Used() * sizeof(uint16_t); }
+
+    // ошибка квантования всех упакованных вершин
+    const QuantizationError& PackingError() const { return packingError; }
+
+    void Release()
+    {
+        vao = VertexArray();
+        positionVao = VertexArray();
+        bound = &vao;
+        vbo.Reset();
+        positionVbo.Reset();
+        ebo.Reset();
+        ebo16.Reset();
+        vertexSpans = positionSpans = indexSpans = shortIndexSpans = Spans();
+        generation++;
+        vertexCapacity = indexCapacity = shortIndexCapacity = positionCapacity = 0;
+        shortIndices.clear();
+        shortIndices.shrink_to_fit();
+        packingError = QuantizationError();
+        packed.clear();
+        packed.shrink_to_fit();
+        packedPositions.clear();
+        packedPositions.shrink_to_fit();
+        remapped.clear();
+        remapped.shrink_to_fit();
+    }
+
+private:
+    GeometryPool() {}
+    GeometryPool(const GeometryPool&) = delete;
+    GeometryPool& operator=(const GeometryPool&) = delete;
+
+    // места в одном буфере (в элементах): освобождённые промежутки занимаются снова, первый подходящий;
+    // если подходящего нет, место берётся с конца занятой части
+    struct Spans
+    {
+        size_t end = 0; // конец занятой части
+        size_t freeCount = 0; // сколько элементов в промежутках
+        vector<pair<size_t, size_t>> holes; // начало и длина, по возрастанию начала, соседние слиты
+
+        // место из промежутка; false - подходящего нет
+        bool Take(size_t count, size_t& first)
+        {
+            if (count == 0)
+                return false;
+            for (size_t i = 0; i < holes.size(); i++)
+            {
+                if (holes[i].second < count)
+                    continue;
+                first = holes[i].first;
+                holes[i].first += count;
+                holes[i].second -= count;
+                if (holes[i].second == 0)
+                    holes.erase(holes.begin() + i);
+                freeCount -= count;
+                return true;
+            }
+            return false;
+        }
+
+        void Free(size_t first, size_t count)
+        {
+            if (count == 0)
+                return;
+            size_t i = lower_bound(holes.begin(), holes.end(), make_pair(first, (size_t)0)) - holes.begin();
+            holes.insert(holes.begin() + i, make_pair(first, count));
+            freeCount += count;
+            if (i + 1 < holes.size() && holes[i].first + holes[i].second == holes[i + 1].first)
+            {
+                holes[i].second += holes[i + 1].second;
+                holes.erase(holes.begin() + i + 1);
+            }
+            if (i > 0 && holes[i - 1].first + holes[i - 1].second == holes[i].first)
+            {
+                holes[i - 1].second += holes[i].second;
+                holes.erase(holes.begin() + i);
+                i--;
+            }
+            // промежуток в конце - просто укорачиваем занятую часть
+            if (holes[i].first + holes[i].second == end)
+            {
+                end = holes[i].first;
+                freeCount -= holes[i].second;
+                holes.erase(holes.begin() + i);
+            }
+        }
+
+        size_t Used() const { return end - freeCount; }
+    };
+
+    // VAO и буфер индексов, который сейчас к нему привязан
+    struct VertexArray
+    {
+        GlVertexArray handle;
+        GLuint attachedIndices = 0;
+    };
+
+    void Init()
+    {
+        vao.handle = CreateVertexArray();
+        GLuint array = vao.handle;
+
+        // атрибуты вершины
+        glEnableVertexArrayAttrib(array, 0);
+        glEnableVertexArrayAttrib(array, 1);
+        glEnableVertexArrayAttrib(array, 2);
+        if (format == VertexFormat::Packed)
+        {
+            // позиция в [0, 1], октаэдрическая нормаль в [-1, 1] (распаковывает шейдер), half-float UV
+            glVertexArrayAttribFormat(array, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedVertex, position));
+            glVertexArrayAttribFormat(array, 1, 2, GL_SHORT, GL_TRUE, offsetof(PackedVertex, normal));
+            glVertexArrayAttribFormat(array, 2, 2, GL_HALF_FLOAT, GL_FALSE, offsetof(PackedVertex, textureCoord));
+        }
+        else
+        {
+            glVertexArrayAttribFormat(array, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, position));
+            glVertexArrayAttribFormat(array, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Vertex, normal));
+            glVertexArrayAttribFormat(array, 2, 2, GL_FLOAT, GL_FALSE, offsetof(Vertex, textureCoord));
+        }
+        glVertexArrayAttribBinding(array, 0, VertexBinding);
+        glVertexArrayAttribBinding(array, 1, VertexBinding);
+        glVertexArrayAttribBinding(array, 2, VertexBinding);
+        InitInstanceId(array);
+
+        // VAO потока позиций: только атрибут 0 (нормаль и текстурные координаты шейдер получит постоянными)
+        positionVao.handle = CreateVertexArray();
+        GLuint positions = positionVao.handle;
+        glEnableVertexArrayAttrib(positions, 0);
+        if (format == VertexFormat::Packed)
+            glVertexArrayAttribFormat(positions, 0, 3, GL_UNSIGNED_SHORT, GL_TRUE, offsetof(PackedPosition, position));
+        else
+            glVertexArrayAttribFormat(positions, 0, 3, GL_FLOAT, GL_FALSE, 0);
+        glVertexArrayAttribBinding(positions, 0, VertexBinding);
+        InitInstanceId(positions);
+
+        Reserve(1 << 16, 1 << 16, 1 << 18);
+        ReservePositions(1 << 16);
+    }
+
+    // номер экземпляра: с делителем 1 атрибут равен baseInstance + gl_InstanceID,
+    // поэтому по нему шейдер находит данные своего экземпляра в SSBO
+    static void InitInstanceId(GLuint array)
+    {
+        glEnableVertexArrayAttrib(array, 3);
+        glVertexArrayAttribIFormat(array, 3, 1, GL_UNSIGNED_INT, 0);
+        glVertexArrayAttribBinding(array, 3, InstanceIdBinding);
+        glVertexArrayBindingDivisor(array, InstanceIdBinding, 1);
+    }
+
+    // увеличиваем буферы, чтобы в них поместилось нужное количество вершин, 32- и 16-битных индексов
+    void Reserve(size_t vertices, size_t indices, size_t shorts)
+    {
+        if (vertices > vertexCapacity)
+        {
+            size_t capacity = vertexCapacity ? vertexCapacity : 1;
+            while (capacity < vertices)
+                capacity *= 2;
+            vbo = Grow(vbo, vertexSpans.end * VertexStride(), capacity * VertexStride());
+            vertexCapacity = capacity;
+            glVertexArrayVertexBuffer(vao.handle, VertexBinding, vbo, 0, (GLsizei)VertexStride());
+        }
+        if (indices > indexCapacity)
+        {
+            size_t capacity = indexCapacity ? indexCapacity : 1;
+            while (capacity < indices)
+                capacity *= 2;
+            GLuint old = ebo;
+            ebo = Grow(ebo, indexSpans.end * sizeof(GLuint), capacity * sizeof(GLuint));
+            indexCapacity = capacity;
+            ReattachIndices(old, ebo);
+        }
+        if (shorts > shortIndexCapacity)
+        {
+            size_t capacity = shortIndexCapacity ? shortIndexCapacity : 1;
+            while (capacity < shorts)
+                capacity *= 2;
+            GLuint old = ebo16;
+            ebo16 = Grow(ebo16, shortIndexSpans.end * sizeof(uint16_t), capacity * sizeof(uint16_t));
+            shortIndexCapacity = capacity;
+            ReattachIndices(old, ebo16);
+        }
+    }
+
+    void ReservePositions(size_t positions)
+    {
+        if (positions <= positionCapacity)
+            return;
+        size_t capacity = positionCapacity ? positionCapacity : 1;
+        while (capacity < positions)
+            capacity *= 2;
+        positionVbo = Grow(positionVbo, positionSpans.end * PositionStride(), capacity * PositionStride());
+        positionCapacity = capacity;
+        glVertexArrayVertexBuffer(positionVao.handle, VertexBinding, positionVbo, 0, (GLsizei)PositionStride());
+    }
+
+    void AttachIndices(VertexArray& array, GLuint buffer)
+    {
+        if (array.attachedIndices != buffer)
+        {
+            glVertexArrayElementBuffer(array.handle, buffer);
+            array.attachedIndices = buffer;
+        }
+    }
+
+    // EBO пересоздан при увеличении: VAO, к которым был привязан старый, получают новый
+    void ReattachIndices(GLuint old, GLuint buffer)
+    {
+        if (vao.attachedIndices == old)
+            AttachIndices(vao, buffer);
+        if (positionVao.attachedIndices == old)
+            AttachIndices(positionVao, buffer);
+    }
+
+    // новый буфер большего размера; уже записанные данные копируются на стороне GPU
+    // (старый буфер удаляется, когда ему присваивают результат)
+    static GlBuffer Grow(GLuint old, size_t usedBytes, size_t newBytes)
+    {
+        GlBuffer buffer = CreateBuffer();
+        glNamedBufferData(buffer, newBytes, NULL, GL_STATIC_DRAW);
+        if (old && usedBytes)
+            glCopyNamedBufferSubData(old, buffer, 0, 0, usedBytes);
+        return buffer;
+    }
+
+    VertexArray vao;
+    VertexArray positionVao;
+    VertexArray* bound = &vao; // к какому VAO BindIndices привязывает буфер индексов
+    GlBuffer vbo, positionVbo, ebo, ebo16;
+    vector<uint16_t> shortIndices; // место для перевода индексов в 16 бит перед загрузкой
+    vector<int> remapped; // место для перевода индексов в номера позиций
+    VertexFormat format = VertexFormat::Float;
+    vector<PackedVertex> packed; // место для упаковки перед загрузкой (не перевыделяется от меша к мешу)
+    vector<PackedPosition> packedPositions;
+    QuantizationError packingError;
+    Spans vertexSpans, positionSpans, indexSpans, shortIndexSpans;
+    size_t vertexCapacity = 0, positionCapacity = 0, indexCapacity = 0, shortIndexCapacity = 0;
+    unsigned generation = 0;
+};
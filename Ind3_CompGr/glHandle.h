@@ -0,0 +1,120 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glState.h"
+
+// Владеющая обёртка над именем объекта OpenGL: объект удаляется в деструкторе (или в Reset),
+// копировать обёртку нельзя, можно только перемещать, поэтому у каждого объекта ровно один владелец.
+// Неявно приводится к GLuint, чтобы передаваться в функции OpenGL как обычное имя.
+// Удалять объекты можно только в потоке OpenGL, пока контекст жив: владельцы-синглтоны
+// освобождают свои объекты в Release до glfwTerminate. Удалённые объекты вычёркиваются из тени состояния (glState.h).
+template <void (*Delete)(GLuint)>
+class GlHandle
+{
+public:
+    GlHandle() {}
+    explicit GlHandle(GLuint id) : id(id) {}
+    ~GlHandle() { Reset(); }
+
+    GlHandle(const GlHandle&) = delete;
+    GlHandle& operator=(const GlHandle&) = delete;
+
+    GlHandle(GlHandle&& other) noexcept : id(other.id) { other.id = 0; }
+    GlHandle& operator=(GlHandle&& other) noexcept
+    {
+        if (this != &other)
+        {
+            Reset();
+            id = other.id;
+            other.id = 0;
+        }
+        return *this;
+    }
+
+    operator GLuint() const { return id; }
+    GLuint Get() const { return id; }
+
+    // удаляем объект (и, если задано, становимся владельцем другого)
+    void Reset(GLuint newId = 0)
+    {
+        if (id)
+            Delete(id);
+        id = newId;
+    }
+
+    // отказываемся от владения, не удаляя объект
+    GLuint Detach()
+    {
+        GLuint result = id;
+        id = 0;
+        return result;
+    }
+
+private:
+    GLuint id = 0;
+};
+
+namespace glDelete
+{
+    inline void Buffer(GLuint id) { GlState::Instance().ForgetBuffer(id); glDeleteBuffers(1, &id); }
+    inline void VertexArray(GLuint id) { GlState::Instance().ForgetVertexArray(id); glDeleteVertexArrays(1, &id); }
+    inline void Texture(GLuint id) { GlState::Instance().ForgetTexture(id); glDeleteTextures(1, &id); }
+    inline void Shader(GLuint id) { glDeleteShader(id); }
+    inline void Program(GLuint id) { GlState::Instance().ForgetProgram(id); glDeleteProgram(id); }
+    inline void Query(GLuint id) { glDeleteQueries(1, &id); }
+    inline void Framebuffer(GLuint id) { GlState::Instance().ForgetFramebuffer(id); glDeleteFramebuffers(1, &id); }
+    inline void Renderbuffer(GLuint id) { glDeleteRenderbuffers(1, &id); }
+}
+
+typedef GlHandle<glDelete::Buffer> GlBuffer;
+typedef GlHandle<glDelete::VertexArray> GlVertexArray;
+typedef GlHandle<glDelete::Texture> GlTexture;
+typedef GlHandle<glDelete::Shader> GlShader;
+typedef GlHandle<glDelete::Program> GlProgram;
+typedef GlHandle<glDelete::Query> GlQuery;
+typedef GlHandle<glDelete::Framebuffer> GlFramebuffer;
+typedef GlHandle<glDelete::Renderbuffer> GlRenderbuffer;
+
+// создание объектов сразу с владельцем (DSA, OpenGL 4.5)
+inline GlBuffer CreateBuffer()
+{
+    GLuint id;
+    glCreateBuffers(1, &id);
+    return GlBuffer(id);
+}
+
+inline GlVertexArray CreateVertexArray()
+{
+    GLuint id;
+    glCreateVertexArrays(1, &id);
+    return GlVertexArray(id);
+}
+
+inline GlTexture CreateTexture(GLenum target)
+{
+    GLuint id;
+    glCreateTextures(target, 1, &id);
+    return GlTexture(id);
+}
+
+inline GlQuery CreateQuery(GLenum target)
+{
+    GLuint id;
+    glCreateQueries(target, 1, &id);
+    return GlQuery(id);
+}
+
+inline GlFramebuffer CreateFramebuffer()
+{
+    GLuint id;
+    glCreateFramebuffers(1, &id);
+    return GlFramebuffer(id);
+}
+
+inline GlRenderbuffer CreateRenderbuffer()
+{
+    GLuint id;
+    glCreateRenderbuffers(1, &id);
+    return GlRenderbuffer(id);
+}
@@ -0,0 +1,152 @@
+#include "glState.h"
+
+GlState& GlState::Instance()
+{
+    static GlState instance;
+    return instance;
+}
+
+void GlState::BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size)
+{
+    IndexedBinding* shadow = IndexedShadow(target, index);
+    if (shadow && shadow->buffer == buffer && shadow->offset == offset && shadow->size == size)
+    {
+        frame.filtered++;
+        return;
+    }
+    if (shadow)
+        *shadow = IndexedBinding{ buffer, offset, size };
+    // glBindBufferRange привязывает буфер и к обычной точке той же цели
+    GLuint* generic = BufferShadow(target);
+    if (generic)
+        *generic = buffer;
+    frame.issued++;
+    glBindBufferRange(target, index, buffer, offset, size);
+}
+
+void GlState::BindFramebuffer(GLenum target, GLuint framebuffer)
+{
+    bool draw = target == GL_FRAMEBUFFER || target == GL_DRAW_FRAMEBUFFER;
+    bool read = target == GL_FRAMEBUFFER || target == GL_READ_FRAMEBUFFER;
+    if ((!draw || drawFramebuffer == framebuffer) && (!read || readFramebuffer == framebuffer))
+    {
+        frame.filtered++;
+        return;
+    }
+    if (draw)
+        drawFramebuffer = framebuffer;
+    if (read)
+        readFramebuffer = framebuffer;
+    frame.issued++;
+    glBindFramebuffer(target, framebuffer);
+}
+
+void GlState::SetCapability(GLenum capability, bool enabled)
+{
+    Capability* shadow = NULL;
+    for (int i = 0; i < capabilityCount; i++)
+        if (capabilities[i].capability == capability)
+            shadow = &capabilities[i];
+    if (shadow && shadow->enabled == enabled)
+    {
+        frame.filtered++;
+        return;
+    }
+    if (!shadow && capabilityCount < MaxCapabilities)
+        shadow = &capabilities[capabilityCount++];
+    if (shadow)
+        *shadow = Capability{ capability, enabled };
+
+    frame.issued++;
+    if (enabled)
+        glEnable(capability);
+    else
+        glDisable(capability);
+}
+
+GLuint* GlState::BufferShadow(GLenum target)
+{
+    switch (target)
+    {
+    case GL_ARRAY_BUFFER: return &arrayBuffer;
+    case GL_DRAW_INDIRECT_BUFFER: return &drawIndirectBuffer;
+    case GL_PIXEL_UNPACK_BUFFER: return &pixelUnpackBuffer;
+    case GL_PIXEL_PACK_BUFFER: return &pixelPackBuffer;
+    case GL_COPY_READ_BUFFER: return &copyReadBuffer;
+    case GL_COPY_WRITE_BUFFER: return &copyWriteBuffer;
+    case GL_UNIFORM_BUFFER: return &uniformBuffer;
+    case GL_SHADER_STORAGE_BUFFER: return &shaderStorageBuffer;
+    default: return NULL;
+    }
+}
+
+GlState::IndexedBinding* GlState::IndexedShadow(GLenum target, GLuint index)
+{
+    if (index >= MaxIndexedBindings)
+        return NULL;
+    if (target == GL_UNIFORM_BUFFER)
+        return &uniformBindings[index];
+    if (target == GL_SHADER_STORAGE_BUFFER)
+        return &storageBindings[index];
+    return NULL;
+}
+
+void GlState::Invalidate()
+{
+    program = Unknown;
+    vertexArray = Unknown;
+    for (auto& texture : textures)
+        texture = Unknown;
+    arrayBuffer = drawIndirectBuffer = pixelUnpackBuffer = pixelPackBuffer = copyReadBuffer = copyWriteBuffer = Unknown;
+    uniformBuffer = shaderStorageBuffer = Unknown;
+    for (int i = 0; i < MaxIndexedBindings; i++)
+        uniformBindings[i] = storageBindings[i] = IndexedBinding{ Unknown, 0, 0 };
+    drawFramebuffer = readFramebuffer = Unknown;
+    capabilityCount = 0;
+    depthFunc = depthWrite = colorWrite = Unknown;
+}
+
+void GlState::ForgetProgram(GLuint id)
+{
+    // текущая программа удаляется только после glUseProgram другой, но имя может быть занято снова
+    if (program == id)
+        program = Unknown;
+}
+
+void GlState::ForgetVertexArray(GLuint id)
+{
+    if (vertexArray == id)
+        vertexArray = 0;
+}
+
+void GlState::ForgetTexture(GLuint id)
+{
+    for (auto& texture : textures)
+        if (texture == id)
+            texture = 0;
+}
+
+void GlState::ForgetBuffer(GLuint id)
+{
+    GLuint* generic[] = { &arrayBuffer, &drawIndirectBuffer, &pixelUnpackBuffer, &pixelPackBuffer,
+        &copyReadBuffer, &copyWriteBuffer, &uniformBuffer, &shaderStorageBuffer };
+    for (GLuint* shadow : generic)
+        if (*shadow == id)
+            *shadow = 0;
+    // что стало с индексированными привязками, проще не угадывать
+    for (int i = 0; i < MaxIndexedBindings; i++)
+    {
+        if (uniformBindings[i].buffer == id)
+            uniformBindings[i].buffer = Unknown;
+        if (storageBindings[i].buffer == id)
+            storageBindings[i].buffer = Unknown;
+    }
+}
+
+void GlState::ForgetFramebuffer(GLuint id)
+{
+    if (drawFramebuffer == id)
+        drawFramebuffer = 0;
+    if (readFramebuffer == id)
+        readFramebuffer = 0;
+}
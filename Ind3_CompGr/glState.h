@@ -0,0 +1,195 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include <cstddef>
+
+// Тень состояния OpenGL: привязки программы, VAO, текстурных блоков, буферов, буфера кадра,
+// включённые возможности (glEnable) и маски записи глубины и цвета. Вызов, который ничего не меняет, не доходит до драйвера.
+// Все привязки в программе идут через GlState: если состояние поменять в обход, тень устареет
+// (тогда нужен Invalidate). Удалённые объекты GlHandle сам вычёркивает из тени (см. Forget*),
+// потому что OpenGL при удалении отвязывает объект, а его имя может достаться новому.
+// Счётчики кадра показывают цену смены состояния: сколько вызовов ушло в драйвер и сколько отфильтровано,
+// сколько было вызовов рисования и сколько байт данных отправлено видеокарте.
+class GlState
+{
+public:
+    static const int MaxTextureUnits = 16;
+    static const int MaxIndexedBindings = 16;
+    static const int MaxCapabilities = 16;
+
+    // счётчики одного кадра
+    struct FrameStats
+    {
+        size_t drawCalls = 0;
+        size_t issued = 0; // привязки и glEnable/glDisable, дошедшие до драйвера
+        size_t filtered = 0; // лишние, которые отброшены
+        size_t bytesUploaded = 0; // данные буферов и текстур, записанные для видеокарты
+    };
+
+    static GlState& Instance();
+
+    void UseProgram(GLuint program)
+    {
+        if (Filter(this->program, program))
+            glUseProgram(program);
+    }
+
+    void BindVertexArray(GLuint vao)
+    {
+        if (Filter(vertexArray, vao))
+            glBindVertexArray(vao);
+    }
+
+    // текстура в текстурный блок unit (glBindTextureUnit: активный блок не меняется и не нужен)
+    void BindTexture(GLuint unit, GLuint texture)
+    {
+        if (unit >= MaxTextureUnits)
+        {
+            Issue();
+            glBindTextureUnit(unit, texture);
+        }
+        else if (Filter(textures[unit], texture))
+            glBindTextureUnit(unit, texture);
+    }
+
+    void BindBuffer(GLenum target, GLuint buffer)
+    {
+        GLuint* shadow = BufferShadow(target);
+        if (!shadow)
+        {
+            Issue();
+            glBindBuffer(target, buffer);
+        }
+        else if (Filter(*shadow, buffer))
+            glBindBuffer(target, buffer);
+    }
+
+    // диапазон буфера в индексированную точку привязки (GL_UNIFORM_BUFFER, GL_SHADER_STORAGE_BUFFER)
+    void BindBufferRange(GLenum target, GLuint index, GLuint buffer, GLintptr offset, GLsizeiptr size);
+
+    void BindFramebuffer(GLenum target, GLuint framebuffer);
+
+    void Enable(GLenum capability) { SetCapability(capability, true); }
+    void Disable(GLenum capability) { SetCapability(capability, false); }
+
+    // запись и сравнение глубины, запись цвета (все четыре канала сразу)
+    void DepthFunc(GLenum func)
+    {
+        if (Filter(depthFunc, func))
+            glDepthFunc(func);
+    }
+
+    void DepthMask(bool write)
+    {
+        if (Filter(depthWrite, write ? 1 : 0))
+            glDepthMask(write ? GL_TRUE : GL_FALSE);
+    }
+
+    void ColorMask(bool write)
+    {
+        GLboolean value = write ? GL_TRUE : GL_FALSE;
+        if (Filter(colorWrite, write ? 1 : 0))
+            glColorMask(value, value, value, value);
+    }
+
+    // вызовы рисования (считаются в счётчиках кадра)
+    void DrawElementsBaseVertex(GLenum mode, GLsizei count, GLenum type, const void* indices, GLint baseVertex)
+    {
+        frame.drawCalls++;
+        glDrawElementsBaseVertex(mode, count, type, indices, baseVertex);
+    }
+
+    void DrawArraysInstancedBaseInstance(GLenum mode, GLint first, GLsizei count, GLsizei instanceCount, GLuint baseInstance)
+    {
+        frame.drawCalls++;
+        glDrawArraysInstancedBaseInstance(mode, first, count, instanceCount, baseInstance);
+    }
+
+    void MultiDrawElementsIndirect(GLenum mode, GLenum type, const void* indirect, GLsizei drawCount, GLsizei stride)
+    {
+        frame.drawCalls++;
+        glMultiDrawElementsIndirect(mode, type, indirect, drawCount, stride);
+    }
+
+    // данные, отправленные видеокарте мимо GlState (glTexSubImage2D, запись в отображённый буфер)
+    void CountUpload(size_t bytes) { frame.bytesUploaded += bytes; }
+
+    void NamedBufferSubData(GLuint buffer, GLintptr offset, GLsizeiptr size, const void* data)
+    {
+        frame.bytesUploaded += (size_t)size;
+        glNamedBufferSubData(buffer, offset, size, data);
+    }
+
+    // тень больше не верна (состояние меняли в обход или контекст новый): следующие вызовы пройдут все
+    void Invalidate();
+
+    // объект удалён: OpenGL отвязал его везде, где он был привязан
+    void ForgetProgram(GLuint program);
+    void ForgetVertexArray(GLuint vao);
+    void ForgetTexture(GLuint texture);
+    void ForgetBuffer(GLuint buffer);
+    void ForgetFramebuffer(GLuint framebuffer);
+
+    // счётчики: BeginFrame обнуляет, EndFrame запоминает кадр
+    void BeginFrame() { frame = FrameStats(); }
+    void EndFrame() { lastFrame = frame; }
+    const FrameStats& LastFrame() const { return lastFrame; }
+    const FrameStats& CurrentFrame() const { return frame; }
+
+private:
+    GlState() { Invalidate(); }
+    GlState(const GlState&) = delete;
+    GlState& operator=(const GlState&) = delete;
+
+    // состояние ещё неизвестно (такого имени у объектов OpenGL не бывает)
+    static const GLuint Unknown = 0xffffffffu;
+
+    struct IndexedBinding
+    {
+        GLuint buffer;
+        GLintptr offset;
+        GLsizeiptr size;
+    };
+
+    struct Capability
+    {
+        GLenum capability;
+        bool enabled;
+    };
+
+    // true - значение новое и вызов надо выполнить
+    bool Filter(GLuint& shadow, GLuint value)
+    {
+        if (shadow == value)
+        {
+            frame.filtered++;
+            return false;
+        }
+        shadow = value;
+        frame.issued++;
+        return true;
+    }
+
+    void Issue() { frame.issued++; }
+
+    GLuint* BufferShadow(GLenum target);
+    IndexedBinding* IndexedShadow(GLenum target, GLuint index);
+    void SetCapability(GLenum capability, bool enabled);
+
+    GLuint program;
+    GLuint vertexArray;
+    GLuint textures[MaxTextureUnits];
+    // обычные точки привязки буферов
+    GLuint arrayBuffer, drawIndirectBuffer, pixelUnpackBuffer, pixelPackBuffer, copyReadBuffer, copyWriteBuffer;
+    GLuint uniformBuffer, shaderStorageBuffer;
+    IndexedBinding uniformBindings[MaxIndexedBindings];
+    IndexedBinding storageBindings[MaxIndexedBindings];
+    GLuint drawFramebuffer, readFramebuffer;
+    Capability capabilities[MaxCapabilities];
+    GLuint depthFunc, depthWrite, colorWrite;
+    int capabilityCount = 0;
+
+    FrameStats frame;
+    FrameStats lastFrame;
+};
@@ -0,0 +1,197 @@
+#include "gpuProfiler.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+
+GpuProfiler& GpuProfiler::Instance()
+{
+    static GpuProfiler instance;
+    return instance;
+}
+
+void GpuProfiler::Init()
+{
+    Release();
+    queries.reserve(FramesInFlight * MaxScopesPerFrame * 2);
+    for (int i = 0; i < FramesInFlight * MaxScopesPerFrame * 2; i++)
+        queries.push_back(CreateQuery(GL_TIMESTAMP));
+}
+
+void GpuProfiler::Release()
+{
+    queries.clear();
+    for (auto& frame : frames)
+        frame.recordCount = frame.queryCount = 0;
+    regions.clear();
+    current = 0;
+    depth = 0;
+    frameOpen = false;
+    droppedFrames = 0;
+}
+
+void GpuProfiler::BeginFrame()
+{
+    if (frameOpen)
+        EndFrame();
+
+    current = (current + 1) % FramesInFlight;
+    Frame& frame = frames[current];
+    // этот кадр был отправлен FramesInFlight кадров назад
+    if (frame.recordCount > 0)
+        Collect(frame);
+    frame.recordCount = frame.queryCount = 0;
+    depth = 0;
+
+    frameOpen = true;
+    Begin("frame");
+}
+
+void GpuProfiler::EndFrame()
+{
+    if (!frameOpen)
+        return;
+    // незакрытые области закрываем вместе с кадром
+    while (depth > 0)
+        End();
+    frameOpen = false;
+}
+
+void GpuProfiler::Begin(const char* name)
+{
+    if (!frameOpen)
+        return;
+
+    // если место в кадре кончилось или вложенность слишком глубокая, область не меряется,
+    // но место в стеке за ней остаётся, чтобы End закрыл именно её
+    int slot = -1;
+    Frame& frame = frames[current];
+    if (Enabled() && depth < MaxDepth && frame.recordCount < MaxScopesPerFrame)
+    {
+        Record& record = frame.records[frame.recordCount];
+        record.region = FindRegion(name, depth);
+        record.beginQuery = frame.queryCount++;
+        record.endQuery = -1;
+        glQueryCounter(Query(current, record.beginQuery), GL_TIMESTAMP);
+        slot = frame.recordCount++;
+    }
+    if (depth < MaxDepth)
+        stack[depth] = slot;
+    depth++;
+}
+
+void GpuProfiler::End()
+{
+    if (!frameOpen || depth == 0)
+        return;
+    depth--;
+    if (depth >= MaxDepth || stack[depth] < 0)
+        return;
+
+    Frame& frame = frames[current];
+    Record& record = frame.records[stack[depth]];
+    record.endQuery = frame.queryCount++;
+    glQueryCounter(Query(current, record.endQuery), GL_TIMESTAMP);
+}
+
+void GpuProfiler::Collect(Frame& frame)
+{
+    if (queries.empty())
+        return;
+    int frameIndex = (int)(&frame - frames);
+
+    // отметки записываются по порядку: если готова последняя, готовы все
+    GLint available = 0;
+    glGetQueryObjectiv(Query(frameIndex, frame.queryCount - 1), GL_QUERY_RESULT_AVAILABLE, &available);
+    if (!available)
+    {
+        droppedFrames++;
+        return;
+    }
+
+    for (int i = 0; i < frame.recordCount; i++)
+    {
+        const Record& record = frame.records[i];
+        if (record.endQuery < 0)
+            continue;
+        GLuint64 begin = 0, end = 0;
+        glGetQueryObjectui64v(Query(frameIndex, record.beginQuery), GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(Query(frameIndex, record.endQuery), GL_QUERY_RESULT, &end);
+
+        Region& region = regions[record.region];
+        region.history[region.count % HistorySize] = end > begin ? (end - begin) / 1e6 : 0.0;
+        region.count++;
+    }
+}
+
+int GpuProfiler::FindRegion(const char* name, int regionDepth)
+{
+    // обычно совпадает указатель на литерал; strcmp - для одинаковых литералов из разных файлов
+    for (size_t i = 0; i < regions.size(); i++)
+        if (regions[i].depth == regionDepth && (regions[i].name == name || strcmp(regions[i].name, name) == 0))
+            return (int)i;
+
+    Region region;
+    region.name = name;
+    region.depth = regionDepth;
+    region.count = 0;
+    regions.push_back(region);
+    return (int)regions.size() - 1;
+}
+
+GpuProfiler::RegionStats GpuProfiler::Summarize(const Region& region) const
+{
+    RegionStats stats;
+    stats.name = region.name;
+    stats.depth = region.depth;
+    stats.samples = min(region.count, (size_t)HistorySize);
+    if (stats.samples == 0)
+        return stats;
+
+    stats.lastMs = region.history[(region.count - 1) % HistorySize];
+    vector<double> sorted(region.history, region.history + stats.samples);
+    sort(sorted.begin(), sorted.end());
+    double sum = 0.0;
+    for (double ms : sorted)
+        sum += ms;
+    stats.averageMs = sum / stats.samples;
+    stats.minMs = sorted.front();
+    stats.maxMs = sorted.back();
+    // процентиль - ближайший сверху замер
+    auto percentile = [&](double p) { return sorted[min(stats.samples - 1, (size_t)(p * stats.samples))]; };
+    stats.p50Ms = percentile(0.50);
+    stats.p95Ms = percentile(0.95);
+    stats.p99Ms = percentile(0.99);
+    return stats;
+}
+
+bool GpuProfiler::Stats(const char* name, RegionStats& stats) const
+{
+    for (const auto& region : regions)
+        if (region.name == name || strcmp(region.name, name) == 0)
+        {
+            stats = Summarize(region);
+            return true;
+        }
+    return false;
+}
+
+vector<GpuProfiler::RegionStats> GpuProfiler::AllStats() const
+{
+    vector<GpuProfiler::RegionStats> result;
+    for (const auto& region : regions)
+        result.push_back(Summarize(region));
+    return result;
+}
+
+void GpuProfiler::Print() const
+{
+    printf("gpu time, ms (last %d frames, %zu dropped):\n", HistorySize, droppedFrames);
+    printf("%-28s %8s %8s %8s %8s %8s\n", "region", "avg", "p50", "p95", "p99", "max");
+    for (const auto& stats : AllStats())
+    {
+        char name[64];
+        snprintf(name, sizeof(name), "%*s%s", stats.depth * 2, "", stats.name);
+        printf("%-28s %8.3f %8.3f %8.3f %8.3f %8.3f\n", name, stats.averageMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs);
+    }
+}
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glHandle.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// Профилировщик времени GPU на запросах GL_TIMESTAMP.
+// Каждая область (Begin/End или GpuScope) ставит две отметки времени в поток команд;
+// результаты кадра читаются через FramesInFlight кадров, когда GPU их уже точно записал,
+// поэтому чтение никогда не ждёт видеокарту (если результат всё же не готов, кадр пропускается).
+// Отметки времени, в отличие от GL_TIME_ELAPSED, можно вкладывать друг в друга.
+// По каждой области хранится скользящее окно последних HistorySize замеров: среднее, минимум, максимум и процентили.
+// Имена областей - строковые литералы: они сравниваются по указателю, и в установившемся кадре нет выделений памяти.
+class GpuProfiler
+{
+public:
+    static const int FramesInFlight = 4;
+    static const int MaxScopesPerFrame = 64;
+    static const int MaxDepth = 16;
+    static const int HistorySize = 240;
+
+    // сводка по области за последние HistorySize кадров (в миллисекундах)
+    struct RegionStats
+    {
+        const char* name = "";
+        int depth = 0; // вложенность (0 - весь кадр)
+        size_t samples = 0;
+        double lastMs = 0.0;
+        double averageMs = 0.0;
+        double minMs = 0.0;
+        double maxMs = 0.0;
+        double p50Ms = 0.0;
+        double p95Ms = 0.0;
+        double p99Ms = 0.0;
+    };
+
+    static GpuProfiler& Instance();
+
+    void Init();
+    void Release();
+
+    // выключенный профилировщик не ставит запросов (области можно не убирать из кода)
+    void SetEnabled(bool value) { enabled = value; }
+    bool Enabled() const { return enabled && !queries.empty(); }
+
+    // начало кадра: читаем результаты кадра FramesInFlight назад и открываем область "frame"
+    void BeginFrame();
+    // конец кадра: закрываем область "frame"
+    void EndFrame();
+
+    // область внутри кадра (name - строковый литерал)
+    void Begin(const char* name);
+    void End();
+
+    // сводка по одной области; false, если такой области ещё не было
+    bool Stats(const char* name, RegionStats& stats) const;
+    // сводка по всем областям в порядке первого появления
+    vector<RegionStats> AllStats() const;
+    // печать сводки (по запросу, например по клавише)
+    void Print() const;
+
+    // сколько кадров пропущено, потому что результаты ещё не были готовы
+    size_t DroppedFrames() const { return droppedFrames; }
+
+private:
+    GpuProfiler() {}
+    GpuProfiler(const GpuProfiler&) = delete;
+    GpuProfiler& operator=(const GpuProfiler&) = delete;
+
+    // область в кадре: номера её запросов
+    struct Record
+    {
+        int region;
+        int beginQuery;
+        int endQuery;
+    };
+
+    struct Frame
+    {
+        Record records[MaxScopesPerFrame];
+        int recordCount = 0;
+        int queryCount = 0;
+    };
+
+    struct Region
+    {
+        const char* name;
+        int depth;
+        double history[HistorySize]; // кольцо последних замеров
+        size_t count; // сколько всего замеров
+    };
+
+    void Collect(Frame& frame);
+    int FindRegion(const char* name, int depth);
+    RegionStats Summarize(const Region& region) const;
+    GLuint Query(int frameIndex, int query) const { return queries[frameIndex * MaxScopesPerFrame * 2 + query]; }
+
+    vector<GlQuery> queries; // FramesInFlight * MaxScopesPerFrame * 2 отметок времени
+    Frame frames[FramesInFlight];
+    int current = 0;
+    bool frameOpen = false;
+    vector<Region> regions;
+    int stack[MaxDepth]; // открытые области (номер записи в кадре или -1, если место кончилось)
+    int depth = 0;
+    bool enabled = true;
+    size_t droppedFrames = 0;
+};
+
+// область профилирования на время жизни объекта
+class GpuScope
+{
+public:
+    explicit GpuScope(const char* name) { GpuProfiler::Instance().Begin(name); }
+    ~GpuScope() { GpuProfiler::Instance().End(); }
+
+    GpuScope(const GpuScope&) = delete;
+    GpuScope& operator=(const GpuScope&) = delete;
+};
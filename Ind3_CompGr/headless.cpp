@@ -0,0 +1,115 @@
+#include "headless.h"
+
+#include <cstdio>
+
+#ifdef HEADLESS_EGL
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <cstring>
+
+static EGLDisplay display = EGL_NO_DISPLAY;
+static EGLContext context = EGL_NO_CONTEXT;
+
+// дисплей без оконной системы: платформа surfaceless Mesa, если есть, иначе дисплей по умолчанию
+static EGLDisplay OpenDisplay()
+{
+    const char* extensions = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (extensions && strstr(extensions, "EGL_MESA_platform_surfaceless"))
+    {
+        auto getPlatformDisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+        if (getPlatformDisplay)
+        {
+            EGLDisplay result = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+            if (result != EGL_NO_DISPLAY)
+                return result;
+        }
+    }
+    return eglGetDisplay(EGL_DEFAULT_DISPLAY);
+}
+
+namespace headless
+{
+    bool CreateContext()
+    {
+        display = OpenDisplay();
+        EGLint major, minor;
+        if (display == EGL_NO_DISPLAY || !eglInitialize(display, &major, &minor))
+        {
+            printf("headless: no EGL display\n");
+            return false;
+        }
+        const char* extensions = eglQueryString(display, EGL_EXTENSIONS);
+        if (!extensions || !strstr(extensions, "EGL_KHR_surfaceless_context"))
+        {
+            printf("headless: EGL %d.%d without EGL_KHR_surfaceless_context\n", major, minor);
+            DestroyContext();
+            return false;
+        }
+
+        // поверхность не нужна, конфигурация - только ради типа API
+        const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+        EGLConfig config;
+        EGLint configCount = 0;
+        if (!eglBindAPI(EGL_OPENGL_API) || !eglChooseConfig(display, configAttributes, &config, 1, &configCount) || configCount == 0)
+        {
+            printf("headless: no EGL config for desktop OpenGL\n");
+            DestroyContext();
+            return false;
+        }
+
+        // как и окну, контексту нужен OpenGL 4.5 core (DSA, glBufferStorage)
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, 4,
+            EGL_CONTEXT_MINOR_VERSION, 5,
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE
+        };
+        context = eglCreateContext(display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (context == EGL_NO_CONTEXT || !eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, context))
+        {
+            printf("headless: can't create OpenGL 4.5 core context (EGL error 0x%x)\n", eglGetError());
+            DestroyContext();
+            return false;
+        }
+        return true;
+    }
+
+    void DestroyContext()
+    {
+        if (display == EGL_NO_DISPLAY)
+            return;
+        eglMakeCurrent(display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (context != EGL_NO_CONTEXT)
+            eglDestroyContext(display, context);
+        eglTerminate(display);
+        context = EGL_NO_CONTEXT;
+        display = EGL_NO_DISPLAY;
+    }
+
+    void* ProcAddress(const char* name)
+    {
+        return (void*)eglGetProcAddress(name);
+    }
+}
+
+#else
+
+namespace headless
+{
+    bool CreateContext()
+    {
+        printf("headless: built without EGL (use the CMake build on Linux)\n");
+        return false;
+    }
+
+    void DestroyContext() {}
+
+    void* ProcAddress(const char*)
+    {
+        return NULL;
+    }
+}
+
+#endif
@@ -0,0 +1,64 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glHandle.h"
+
+// Контекст OpenGL без окна и без дисплея: для бенчмарков на машинах сборки (в том числе без GPU, на Mesa llvmpipe).
+// Контекст создаётся через EGL без поверхности (EGL_KHR_surfaceless_context, платформа surfaceless Mesa),
+// поэтому рисовать можно только в свой буфер кадра (OffscreenTarget).
+// EGL есть только в сборке CMake (HEADLESS_EGL); без него CreateContext сообщает, что режим недоступен.
+namespace headless
+{
+    // создаём контекст OpenGL 4.5 core и делаем его текущим для потока
+    bool CreateContext();
+    void DestroyContext();
+
+    // адреса функций OpenGL для gladLoadGLLoader
+    void* ProcAddress(const char* name);
+}
+
+// Буфер кадра вне экрана: цвет RGBA8 и глубина заданного размера
+class OffscreenTarget
+{
+public:
+    void Init(int targetWidth, int targetHeight)
+    {
+        width = targetWidth;
+        height = targetHeight;
+
+        color = CreateRenderbuffer();
+        glNamedRenderbufferStorage(color, GL_RGBA8, width, height);
+        depth = CreateRenderbuffer();
+        glNamedRenderbufferStorage(depth, GL_DEPTH_COMPONENT24, width, height);
+
+        framebuffer = CreateFramebuffer();
+        glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depth);
+    }
+
+    bool Complete() const
+    {
+        return framebuffer && glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    }
+
+    // рисование и glClear дальше идут в этот буфер
+    void Bind() const
+    {
+        GlState::Instance().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    void Release()
+    {
+        framebuffer.Reset();
+        color.Reset();
+        depth.Reset();
+    }
+
+private:
+    GlFramebuffer framebuffer;
+    GlRenderbuffer color;
+    GlRenderbuffer depth;
+    int width = 0, height = 0;
+};
@@ -0,0 +1,313 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gameObject.h"
+#include "geometryPool.h"
+#include "ringBuffer.h"
+
+#include <algorithm>
+#include <vector>
+
+using namespace std;
+
+// данные одного экземпляра (раскладка std430 элемента массива instances в шейдере)
+struct InstanceData
+{
+    glm::mat4 model; // матрица преобразования экземпляра
+    glm::vec4 normalMat[3]; // столбцы матрицы нормалей (mat3, дополненная до vec4)
+    glm::vec4 tint; // цвет, на который умножается текстура
+};
+
+// команда непрямого рисования (раскладка задана OpenGL, см. glMultiDrawElementsIndirect)
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// точка привязки SSBO с данными экземпляров
+const GLuint InstanceBufferBinding = 0;
+
+// Инстансное рисование через glMultiDrawElementsIndirect.
+// Объекты сцены с общей моделью собираются в одну группу; данные всех экземпляров кадра
+// одним массивом пишутся в кольцевой буфер и читаются шейдером как SSBO.
+// Для каждого меша каждой группы строится одна команда (instanceCount = размер группы,
+// baseInstance = начало группы в массиве), команды сортируются по разрядности индексов и текстуре,
+// и на каждую пару (разрядность, текстура) выполняется один вызов glMultiDrawElementsIndirect.
+// Для прохода глубины строится второй набор команд (SubmitDepth): по потоку позиций мешей, без текстур.
+class InstanceRenderer
+{
+public:
+    // maxInstances - сколько экземпляров можно нарисовать за кадр
+    void Init(size_t maxInstances)
+    {
+        this->maxInstances = maxInstances;
+
+        GLint alignment;
+        glGetIntegerv(GL_SHADER_STORAGE_BUFFER_OFFSET_ALIGNMENT, &alignment);
+        // на кадр: массив экземпляров и команды обоих проходов (не больше одной команды на экземпляр и меш)
+        GLsizeiptr commandsSize = (GLsizeiptr)((maxInstances + 64) * 4 * 2 * sizeof(DrawElementsIndirectCommand));
+        instanceRing.Init((GLsizeiptr)(maxInstances * sizeof(InstanceData)) + commandsSize + alignment * 4, alignment);
+
+        // номера экземпляров 0, 1, 2, ... для атрибута 3 общего VAO
+        vector<GLuint> ids(maxInstances + 1);
+        for (size_t i = 0; i < ids.size(); i++)
+            ids[i] = (GLuint)i;
+        instanceIdBuffer = CreateBuffer();
+        glNamedBufferStorage(instanceIdBuffer, ids.size() * sizeof(GLuint), ids.data(), 0);
+        GeometryPool::Instance().SetInstanceIdBuffer(instanceIdBuffer);
+    }
+
+    // начало кадра: группы остаются (их векторы не перевыделяются), обнуляется только число экземпляров
+    void Begin()
+    {
+        for (auto& batch : batches)
+            batch.instances.clear();
+        drawCalls = 0;
+        instanceCount = 0;
+        triangleCount = 0;
+    }
+
+    // добавляем объект в группу его модели и уровня детализации
+    void Add(const GameObject& go, const glm::vec4& tint = glm::vec4(1.0f))
+    {
+        if (!go.model)
+            return;
+
+        InstanceData data;
+        data.model = go.DrawMatrix();
+        glm::mat3 normalMat = glm::transpose(glm::inverse(glm::mat3(go.matr)));
+        for (int i = 0; i < 3; i++)
+            data.normalMat[i] = glm::vec4(normalMat[i], 0.0f);
+        data.tint = tint;
+
+        FindBatch(go.model.get(), go.lod).instances.push_back(data);
+    }
+
+    // рисуем все группы: один glMultiDrawElementsIndirect на каждую текстуру
+    void Draw()
+    {
+        if (Prepare())
+            Submit();
+        Finish();
+    }
+
+    // Draw по частям, чтобы нарисовать кадр несколько раз разными программами (например, сначала только глубину):
+    // Prepare пишет экземпляры и команды в кольцевой буфер (false - рисовать нечего),
+    // Submit рисует их текущей программой (сколько угодно раз), SubmitDepth - только глубину,
+    // Finish закрывает кадр кольцевого буфера
+    bool Prepare()
+    {
+        instanceRing.BeginFrame();
+        commands.clear();
+        depthCommands.clear();
+
+        size_t total = 0;
+        for (auto& batch : batches)
+            total += batch.instances.size();
+        if (total == 0 || total > maxInstances)
+            return false;
+
+        // один массив экземпляров на кадр
+        InstanceData* instances = (InstanceData*)instanceRing.Allocate((GLsizeiptr)(total * sizeof(InstanceData)));
+        if (!instances)
+            return false;
+        instancesOffset = instanceRing.LastOffset();
+        instancesSize = (GLsizeiptr)(total * sizeof(InstanceData));
+
+        // команды рисования: по одной на меш группы
+        GLuint first = 0;
+        for (auto& batch : batches)
+        {
+            if (batch.instances.empty())
+                continue;
+            copy(batch.instances.begin(), batch.instances.end(), instances + first);
+
+            for (auto& mesh : batch.model->meshes)
+            {
+                const GeometryPool::Range& range = mesh.Lod(batch.lod);
+                Command c;
+                c.texture = mesh.TextureID();
+                c.indexType = range.indexType;
+                c.cmd.count = (GLuint)range.indexCount;
+                c.cmd.instanceCount = (GLuint)batch.instances.size();
+                c.cmd.firstIndex = range.firstIndex;
+                c.cmd.baseVertex = range.baseVertex;
+                c.cmd.baseInstance = first;
+                commands.push_back(c);
+                triangleCount += (size_t)range.indexCount / 3 * batch.instances.size();
+
+                // та же команда для прохода глубины: текстура не нужна, вершины - из потока позиций, если он есть
+                const GeometryPool::Range& depthRange = mesh.DepthLod(batch.lod);
+                c.texture = 0;
+                c.positions = mesh.DrawsPositions();
+                c.indexType = depthRange.indexType;
+                c.cmd.count = (GLuint)depthRange.indexCount;
+                c.cmd.firstIndex = depthRange.firstIndex;
+                c.cmd.baseVertex = depthRange.baseVertex;
+                depthCommands.push_back(c);
+            }
+            first += (GLuint)batch.instances.size();
+        }
+        instanceCount = total;
+
+        // команды с одной разрядностью индексов и текстурой должны идти подряд
+        sort(commands.begin(), commands.end(), [](const Command& a, const Command& b)
+        {
+            return a.indexType != b.indexType ? a.indexType < b.indexType : a.texture < b.texture;
+        });
+        // команды глубины с одной разрядностью индексов и одним VAO
+        sort(depthCommands.begin(), depthCommands.end(), [](const Command& a, const Command& b)
+        {
+            return a.indexType != b.indexType ? a.indexType < b.indexType : a.positions < b.positions;
+        });
+
+        if (!WriteCommands(commands, commandsOffset) || !WriteCommands(depthCommands, depthCommandsOffset))
+        {
+            commands.clear();
+            depthCommands.clear();
+            return false;
+        }
+        return true;
+    }
+
+    void Submit()
+    {
+        GlState& state = GlState::Instance();
+        BindInstances();
+        GeometryPool::Instance().Bind();
+
+        // один вызов на группу команд с общими разрядностью индексов и текстурой
+        size_t start = 0;
+        while (start < commands.size())
+        {
+            size_t end = start + 1;
+            while (end < commands.size() && commands[end].texture == commands[start].texture
+                && commands[end].indexType == commands[start].indexType)
+                end++;
+
+            GeometryPool::Instance().BindIndices(commands[start].indexType);
+            state.BindTexture(0, commands[start].texture);
+            state.MultiDrawElementsIndirect(GL_TRIANGLES, commands[start].indexType,
+                (void*)(commandsOffset + start * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - start), 0);
+            drawCalls++;
+            start = end;
+        }
+    }
+
+    // только глубина: один вызов на группу команд с общими разрядностью индексов и VAO (поток позиций или полные вершины)
+    void SubmitDepth()
+    {
+        GlState& state = GlState::Instance();
+        BindInstances();
+
+        size_t start = 0;
+        while (start < depthCommands.size())
+        {
+            size_t end = start + 1;
+            while (end < depthCommands.size() && depthCommands[end].positions == depthCommands[start].positions
+                && depthCommands[end].indexType == depthCommands[start].indexType)
+                end++;
+
+            if (depthCommands[start].positions)
+                GeometryPool::Instance().BindPositions();
+            else
+                GeometryPool::Instance().Bind();
+            GeometryPool::Instance().BindIndices(depthCommands[start].indexType);
+            state.MultiDrawElementsIndirect(GL_TRIANGLES, depthCommands[start].indexType,
+                (void*)(depthCommandsOffset + start * sizeof(DrawElementsIndirectCommand)), (GLsizei)(end - start), 0);
+            drawCalls++;
+            start = end;
+        }
+    }
+
+    // данные кадра прочитаны всеми Submit: помечаем сегмент кольцевого буфера fence-ом
+    void Finish()
+    {
+        instanceRing.EndFrame();
+    }
+
+    // сколько вызовов рисования, экземпляров и треугольников было в последнем кадре
+    size_t DrawCalls() const { return drawCalls; }
+    size_t InstanceCount() const { return instanceCount; }
+    size_t TriangleCount() const { return triangleCount; }
+    size_t MaxInstances() const { return maxInstances; }
+
+    void Release()
+    {
+        batches.clear();
+        commands.clear();
+        depthCommands.clear();
+        instanceRing.Release();
+        instanceIdBuffer.Reset();
+    }
+
+private:
+    struct Batch
+    {
+        Model* model;
+        int lod;
+        vector<InstanceData> instances;
+    };
+
+    struct Command
+    {
+        GLuint texture;
+        GLenum indexType;
+        bool positions = false; // команда глубины из потока позиций
+        DrawElementsIndirectCommand cmd;
+    };
+
+    // команды в кольцевой буфер; offset - где они оказались
+    bool WriteCommands(const vector<Command>& list, GLintptr& offset)
+    {
+        if (list.empty())
+            return true;
+        DrawElementsIndirectCommand* indirect = (DrawElementsIndirectCommand*)instanceRing.Allocate(
+            (GLsizeiptr)(list.size() * sizeof(DrawElementsIndirectCommand)));
+        if (!indirect)
+            return false;
+        offset = instanceRing.LastOffset();
+        for (size_t i = 0; i < list.size(); i++)
+            indirect[i] = list[i].cmd;
+        return true;
+    }
+
+    // массив экземпляров кадра и буфер команд
+    void BindInstances()
+    {
+        GlState& state = GlState::Instance();
+        state.BindBufferRange(GL_SHADER_STORAGE_BUFFER, InstanceBufferBinding, instanceRing.Buffer(),
+            instancesOffset, instancesSize);
+        state.BindBuffer(GL_DRAW_INDIRECT_BUFFER, instanceRing.Buffer());
+    }
+
+    // моделей в сцене немного, поэтому группа ищется линейным поиском
+    Batch& FindBatch(Model* model, int lod)
+    {
+        for (auto& batch : batches)
+            if (batch.model == model && batch.lod == lod)
+                return batch;
+        batches.push_back(Batch{ model, lod, {} });
+        return batches.back();
+    }
+
+    vector<Batch> batches;
+    vector<Command> commands;
+    vector<Command> depthCommands;
+    RingBuffer instanceRing;
+    GLintptr instancesOffset = 0;
+    GLsizeiptr instancesSize = 0;
+    GLintptr commandsOffset = 0;
+    GLintptr depthCommandsOffset = 0;
+    GlBuffer instanceIdBuffer;
+    size_t maxInstances = 0;
+    size_t drawCalls = 0;
+    size_t instanceCount = 0;
+    size_t triangleCount = 0;
+};
@@ -0,0 +1,114 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+// форматы блочного сжатия S3TC (в заголовках core-профиля их нет)
+#ifndef GL_COMPRESSED_RGB_S3TC_DXT1_EXT
+#define GL_COMPRESSED_RGB_S3TC_DXT1_EXT 0x83F0
+#endif
+#ifndef GL_COMPRESSED_RGBA_S3TC_DXT5_EXT
+#define GL_COMPRESSED_RGBA_S3TC_DXT5_EXT 0x83F3
+#endif
+
+// Контейнер KTX 1.1 для сжатых текстур с готовой цепочкой мип-уровней.
+// Записываются только двумерные текстуры без массивов и граней куба, без пар ключ-значение;
+// данные уровней лежат в файле подряд, поэтому при загрузке их можно отдавать в OpenGL без копирования.
+namespace ktx
+{
+    const unsigned char Identifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    const uint32_t Endianness = 0x04030201;
+
+    struct Header
+    {
+        unsigned char identifier[12];
+        uint32_t endianness;
+        uint32_t glType; // 0 для сжатых форматов
+        uint32_t glTypeSize;
+        uint32_t glFormat; // 0 для сжатых форматов
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+    // один мип-уровень: размер и указатель на сжатые данные внутри файла
+    struct Level
+    {
+        uint32_t width;
+        uint32_t height;
+        uint32_t size;
+        const unsigned char* data;
+    };
+
+    // собираем файл из сжатых мип-уровней (levels[0] - самый крупный)
+    inline vector<unsigned char> Write(uint32_t internalFormat, uint32_t baseFormat, uint32_t width, uint32_t height,
+        const vector<vector<unsigned char>>& levels)
+    {
+        Header header = {};
+        memcpy(header.identifier, Identifier, sizeof(Identifier));
+        header.endianness = Endianness;
+        header.glTypeSize = 1;
+        header.glInternalFormat = internalFormat;
+        header.glBaseInternalFormat = baseFormat;
+        header.pixelWidth = width;
+        header.pixelHeight = height;
+        header.numberOfFaces = 1;
+        header.numberOfMipmapLevels = (uint32_t)levels.size();
+
+        vector<unsigned char> file((const unsigned char*)&header, (const unsigned char*)&header + sizeof(header));
+        for (const auto& level : levels)
+        {
+            uint32_t size = (uint32_t)level.size();
+            file.insert(file.end(), (const unsigned char*)&size, (const unsigned char*)&size + sizeof(size));
+            file.insert(file.end(), level.begin(), level.end());
+            // данные уровня выравниваются на 4 байта
+            file.resize((file.size() + 3) & ~(size_t)3);
+        }
+        return file;
+    }
+
+    // разбираем файл; false, если это не KTX или файл обрезан
+    inline bool Read(const vector<unsigned char>& file, Header& header, vector<Level>& levels)
+    {
+        if (file.size() < sizeof(Header))
+            return false;
+        memcpy(&header, file.data(), sizeof(Header));
+        if (memcmp(header.identifier, Identifier, sizeof(Identifier)) != 0 || header.endianness != Endianness)
+            return false;
+        if (header.glType != 0 || header.numberOfFaces != 1 || header.pixelDepth > 1 || header.numberOfArrayElements > 1)
+            return false;
+
+        size_t offset = sizeof(Header) + header.bytesOfKeyValueData;
+        uint32_t levelCount = header.numberOfMipmapLevels ? header.numberOfMipmapLevels : 1;
+        levels.clear();
+        for (uint32_t i = 0; i < levelCount; i++)
+        {
+            uint32_t size;
+            if (offset + sizeof(size) > file.size())
+                return false;
+            memcpy(&size, file.data() + offset, sizeof(size));
+            offset += sizeof(size);
+            if (offset + size > file.size())
+                return false;
+
+            Level level;
+            level.width = header.pixelWidth >> i ? header.pixelWidth >> i : 1;
+            level.height = header.pixelHeight >> i ? header.pixelHeight >> i : 1;
+            level.size = size;
+            level.data = file.data() + offset;
+            levels.push_back(level);
+            offset = (offset + size + 3) & ~(size_t)3;
+        }
+        return true;
+    }
+}
@@ -7,88 +7,262 @@
 
 #include "camera.h"
 #include "gameObject.h"
+#include "allocCounter.h"
+#include "ringBuffer.h"
+#include "instancing.h"
+#include "renderQueue.h"
+#include "overdraw.h"
+#include "occlusion.h"
+#include "benchmark.h"
+#include "frustum.h"
+#include "bvh.h"
+#include "textureCooker.h"
+#include "textureStreamer.h"
+#include "threadPool.h"
+#include "gpuProfiler.h"
+#include "cpuProfiler.h"
+#include "headless.h"
+#include "softwareRenderer.h"
 
+#include <cmath>
+#include <cstdlib>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
 #include <iostream>
+#include <thread>
 #include "stb_image.h"
 
-// ID шейдерной программы
-GLuint Program;
+// шейдерная программа
+GlProgram Program;
+// шейдерная программа для инстансного рисования
+GlProgram InstProgram;
+// программы предварительного прохода глубины (те же вершинные шейдеры, фрагментный шейдер пустой)
+GlProgram DepthProgram;
+GlProgram InstDepthProgram;
+// программа проверки видимости: параллелепипеды объектов без записи цвета и глубины
+GlProgram OcclusionProgram;
 
-GLuint Unif_posx;
-GLuint Unif_posy;
-GLuint Unif_posz;
+// точки привязки uniform-блоков
+const GLuint FrameDataBinding = 0;
+const GLuint ObjectDataBinding = 1;
+
+// данные кадра (раскладка std140 блока FrameData в шейдере)
+struct FrameData
+{
+    glm::mat4 view;
+    glm::mat4 proj;
+    glm::mat4 viewProj;
+    glm::vec4 lightPos;
+};
+
+// данные объекта (раскладка std140 блока ObjectData в шейдере)
+// матрица нормалей хранится как mat4: mat3 в std140 всё равно выравнивается по столбцам из vec4
+struct ObjectData
+{
+    glm::mat4 model;
+    glm::mat4 normalMat;
+};
+
+// кольцевой буфер для uniform-блоков кадра и объектов
+RingBuffer uniformRing;
+
+// инстансное рисование объектов с общей моделью
+InstanceRenderer instanceRenderer;
+bool useInstancing = true;
+
+// очередь рисования по одному объекту: меши сортируются по ключам (R - рисовать в порядке объектов сцены)
+RenderQueue renderQueue;
+bool useRenderQueue = true;
+// сколько миллисекунд CPU заняла отправка команд рисования в последнем кадре (вместе с сортировкой)
+double drawSubmitMs = 0.0;
+// данные объектов кадра в кольцевом буфере (при рисовании в порядке сцены)
+vector<GLintptr> objectOffsets;
+
+// предварительный проход глубины перед закраской (Z)
+bool useDepthPrepass = false;
+// замер перерисовки: фрагментов на пиксель (O)
+OverdrawMeter overdraw;
+bool measureOverdraw = false;
+
+// отсечение заслонённых объектов запросами видимости (H); сколько объектов в пирамиде видимости отсечено в кадре
+OcclusionCuller occlusion;
+bool useOcclusion = false;
+size_t occludedObjects = 0;
+
+// отсечение объектов по пирамиде видимости
+FrustumCuller culler;
+bool useCulling = true;
+size_t visibleObjects = 0;
+// иерархия ограничивающих объёмов над объектами сцены (B - отсечение через неё вместо плоского обхода)
+Bvh sceneBvh;
+vector<uint8_t> bvhVisible;
+bool useBvh = false;
+// матрица proj * view текущего кадра
+glm::mat4 viewProjection;
+
+// уровни детализации по размеру объекта на экране (L - всегда самый детальный)
+bool useLod = true;
+// сколько треугольников отправлено на рисование в последнем кадре
+size_t trianglesDrawn = 0;
+
+// сколько миллисекунд кадра можно тратить на создание текстур, пришедших из фоновой загрузки
+const double textureUploadBudgetMs = 2.0;
+
+// запись трассы CPU (T - следующие traceFrames кадров, --trace [файл] - с запуска, вместе с загрузкой)
+const unsigned long long traceFrames = 120;
+const unsigned long long startupTraceFrames = 300;
+unsigned long long traceFramesLeft = 0;
+string traceFile = "trace.json";
 
 // размер окна
 int width = 800, height = 600;
+// вертикальный угол обзора камеры (в градусах)
+const float fieldOfView = 50.0f;
+// ближняя и дальняя плоскости отсечения
+const float nearPlane = 0.1f;
+const float farPlane = 100.0f;
 
 // камера
 Camera camera(glm::vec3(0.0f, 20.0f, 30.0f));
 
+// матрица проекции
+glm::mat4 projection;
+
 // сцена с объектами
 std::vector <GameObject> gameObjects;
 
-// источник света
-float lpos[4] = { 0.0f,0.0f,0.0f,1.0f };
+// Исходный код шейдеров без строки #version: её и нужные #define добавляет CreateProgram
+// (PACKED_VERTICES - вершины в упакованном формате, см. vertexPacking.h)
 
 // Исходный код вершинного шейдера
 const char* VertexShaderSource = R"(
-    #version 330 core
+    layout (location = 0) in vec3 vertCoord;
+#ifdef PACKED_VERTICES
+    // нормаль в октаэдрической развёртке, позиция уже в [0, 1] (масштаб и сдвиг - в матрице модели)
+    layout (location = 1) in vec2 packedNormal;
+
+    vec3 OctDecode(vec2 e)
+    {
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+        if (n.z < 0.0)
+            n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        return normalize(n);
+    }
+#else
+    layout (location = 1) in vec3 normal;
+#endif
+    layout (location = 2) in vec2 textCoord;
+
+    out vec2 tCoord;
+    out vec3 lightp;
+    out vec3 vnormal;
+    out vec4 vtint;
+
+    layout (std140) uniform FrameData
+    {
+        mat4 view;
+        mat4 proj;
+        mat4 viewProj;
+        vec4 lightPos;
+    };
+
+    layout (std140) uniform ObjectData
+    {
+        mat4 model;
+        mat4 normalMat;
+    };
+
+    // глубина должна совпадать бит в бит с предварительным проходом (сравнение GL_EQUAL)
+    invariant gl_Position;
+
+    void main()
+    {
+      tCoord = textCoord;
+
+      vec4 worldPos = model * vec4(vertCoord, 1.0);
+      gl_Position = viewProj * worldPos;
+
+#ifdef PACKED_VERTICES
+      vec3 normal = OctDecode(packedNormal);
+#endif
+      vnormal = mat3(normalMat) * normal;
+      lightp = lightPos.xyz - worldPos.xyz;
+      vtint = vec4(1.0);
+    }
+)";
 
+// Исходный код вершинного шейдера для инстансного рисования:
+// матрицы и цвет объекта берутся из SSBO экземпляров по номеру экземпляра (атрибут 3 = baseInstance + gl_InstanceID)
+const char* InstancedVertexShaderSource = R"(
     layout (location = 0) in vec3 vertCoord;
+#ifdef PACKED_VERTICES
+    // нормаль в октаэдрической развёртке, позиция уже в [0, 1] (масштаб и сдвиг - в матрице модели)
+    layout (location = 1) in vec2 packedNormal;
+
+    vec3 OctDecode(vec2 e)
+    {
+        vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+        if (n.z < 0.0)
+            n.xy = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+        return normalize(n);
+    }
+#else
     layout (location = 1) in vec3 normal;
+#endif
     layout (location = 2) in vec2 textCoord;
+    layout (location = 3) in uint instanceIndex;
 
     out vec2 tCoord;
     out vec3 lightp;
     out vec3 vnormal;
-    out vec4 vPosition;
+    out vec4 vtint;
 
-    uniform float xpos;
-    uniform float ypos;
-    uniform float zpos;
+    layout (std140) uniform FrameData
+    {
+        mat4 view;
+        mat4 proj;
+        mat4 viewProj;
+        vec4 lightPos;
+    };
+
+    struct InstanceData
+    {
+        mat4 model;
+        vec4 normalMat[3];
+        vec4 tint;
+    };
+
+    layout (std430, binding = 0) readonly buffer Instances
+    {
+        InstanceData instances[];
+    };
 
-    uniform mat4 object;
-    uniform mat4 view;
-    uniform mat4 proj;
+    invariant gl_Position;
 
     void main()
     {
-      tCoord = textCoord; 
-
-mat3 aff=mat3(
-1, 0, 0,
-0, cos(1), -sin(1),
-0, sin(1), cos(1)
-) * mat3(
-cos(1), 0, sin(1),
-0, 1, 0,
--sin(1), 0, cos(1)
-)* mat3(
-            cos(1), sin(1),0,
-            -sin(1),cos(1) , 0,
-            0, 0, 1
-        ); 
-
-      vec3 newNormale = mat3(transpose(inverse(aff))) *  normal;
-      vec3 lposition=vec3(xpos,ypos,zpos);
-      vec3 temp=lposition; 
- 
-      gl_Position = proj * view * object * vec4(vertCoord, 1.0);
-
-      vPosition=proj * view * object * vec4(vertCoord, 1.0);
-      vnormal=newNormale;
-      lightp=  temp-vertCoord;
+      InstanceData inst = instances[instanceIndex];
+      tCoord = textCoord;
+
+      vec4 worldPos = inst.model * vec4(vertCoord, 1.0);
+      gl_Position = viewProj * worldPos;
+
+#ifdef PACKED_VERTICES
+      vec3 normal = OctDecode(packedNormal);
+#endif
+      vnormal = mat3(inst.normalMat[0].xyz, inst.normalMat[1].xyz, inst.normalMat[2].xyz) * normal;
+      lightp = lightPos.xyz - worldPos.xyz;
+      vtint = inst.tint;
     }
 )";
 
 // Исходный код фрагментного шейдера
 const char* FragShaderSource = R"(
-    #version 330 core
-
-    in vec3 vCoord;  
     in vec3 vnormal;  
     in vec3 lightp;
     in vec2 tCoord;
+    in vec4 vtint;
 
     out vec4 color;
     const vec4 diffColor = vec4 ( 0.9, 0.9, 0.9, 1.0 );
@@ -100,7 +274,36 @@ const char* FragShaderSource = R"(
        vec3 n2   = normalize ( vnormal );
        vec3 l2   = normalize ( lightp );
        vec4 diff = diffColor * max ( dot ( n2, l2 ), 0.0 );
-       color = texture(ourTexture, tCoord) * diff;
+       color = texture(ourTexture, tCoord) * vtint * diff;
+    }
+)";
+
+// Вершинный шейдер проверки видимости: параллелепипед объекта (min, max - атрибуты экземпляра)
+// полосой из 14 вершин, углы куба берутся из битов масок по gl_VertexID
+const char* OcclusionVertexShaderSource = R"(
+    layout (location = 0) in vec3 boxMin;
+    layout (location = 1) in vec3 boxMax;
+
+    layout (std140) uniform FrameData
+    {
+        mat4 view;
+        mat4 proj;
+        mat4 viewProj;
+        vec4 lightPos;
+    };
+
+    void main()
+    {
+      uint bit = 1u << uint(gl_VertexID);
+      vec3 corner = vec3((0x287au & bit) != 0u, (0x02afu & bit) != 0u, (0x31e3u & bit) != 0u);
+      gl_Position = viewProj * vec4(mix(boxMin, boxMax, corner), 1.0);
+    }
+)";
+
+// Фрагментный шейдер предварительного прохода: цвет не пишется, нужна только глубина
+const char* DepthFragShaderSource = R"(
+    void main()
+    {
     }
 )";
 
@@ -121,9 +324,29 @@ void ChangePos(float x, float y, float z)
 
 }
 
+// Нажатие клавиши в этом кадре (а не удержание): для переключателей
+bool KeyPressed(GLFWwindow* window, int key)
+{
+    static bool wasDown[512] = {};
+    bool down = glfwGetKey(window, key) == GLFW_PRESS;
+    bool pressed = down && !wasDown[key];
+    wasDown[key] = down;
+    return pressed;
+}
+
+// Включение и выключение отсечения запросами видимости. Наборы запросов, ещё не прочитанные при переключении,
+// сбрасываются: после паузы их результаты устарели бы на много кадров и прятали бы уже видимые объекты
+void SetOcclusion(bool enabled)
+{
+    if (enabled != useOcclusion)
+        occlusion.Init(gameObjects.size());
+    useOcclusion = enabled;
+}
+
 // Обработка всех событий ввода: запрос GLFW о нажатии/отпускании кнопки мыши в данном кадре и соответствующая обработка данных событий
 void processInput(GLFWwindow* window)
 {
+    CpuZone zone("processInput");
     if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
         glfwSetWindowShouldClose(window, true);
 
@@ -144,6 +367,54 @@ void processInput(GLFWwindow* window)
         ChangePos(0.0f, 0.0f, -1.1f);
     if (glfwGetKey(window, GLFW_KEY_E) == GLFW_PRESS)
         ChangePos(0.0f, 0.0f, 1.1f);
+
+    // C - включение/выключение отсечения по пирамиде видимости
+    if (KeyPressed(window, GLFW_KEY_C))
+        useCulling = !useCulling;
+
+    // B - отсечение через BVH вместо плоского обхода всех объектов
+    if (KeyPressed(window, GLFW_KEY_B))
+        useBvh = !useBvh;
+
+    // I - переключение между непрямым инстансным рисованием и рисованием по одному объекту
+    if (KeyPressed(window, GLFW_KEY_I))
+        useInstancing = !useInstancing;
+
+    // R - сортировка мешей по ключам (очередь рисования) или порядок объектов сцены
+    if (KeyPressed(window, GLFW_KEY_R))
+        useRenderQueue = !useRenderQueue;
+
+    // Z - предварительный проход глубины
+    if (KeyPressed(window, GLFW_KEY_Z))
+        useDepthPrepass = !useDepthPrepass;
+
+    // V - проход глубины из потока позиций или из полных вершин
+    if (KeyPressed(window, GLFW_KEY_V))
+        Mesh::UsePositionStream() = !Mesh::UsePositionStream();
+
+    // H - отсечение заслонённых объектов запросами видимости
+    if (KeyPressed(window, GLFW_KEY_H))
+        SetOcclusion(!useOcclusion);
+
+    // O - замер перерисовки (выводится раз в секунду)
+    if (KeyPressed(window, GLFW_KEY_O))
+        measureOverdraw = !measureOverdraw;
+
+    // L - включение/выключение уровней детализации
+    if (KeyPressed(window, GLFW_KEY_L))
+        useLod = !useLod;
+
+    // P - сводка времени GPU по областям кадра
+    if (KeyPressed(window, GLFW_KEY_P))
+        GpuProfiler::Instance().Print();
+
+    // T - запись трассы CPU следующих кадров
+    if (KeyPressed(window, GLFW_KEY_T) && traceFramesLeft == 0)
+    {
+        cpuProfiler::StartCapture();
+        traceFramesLeft = traceFrames;
+        printf("trace: recording %llu frames\n", traceFrames);
+    }
 }
 
 // Проверка ошибок OpenGL, если есть то вывод в консоль тип ошибки
@@ -176,137 +447,1439 @@ void ShaderLog(unsigned int shader)
     }
 }
 
-void setMat4(unsigned int program, const std::string& name, const glm::mat4& mat)
+// связываем uniform-блок программы с точкой привязки (индекс блока ищется один раз после линковки)
+bool BindUniformBlock(GLuint program, const char* name, GLuint binding)
 {
-    glUniformMatrix4fv(glGetUniformLocation(program, name.c_str()), 1, GL_FALSE, &mat[0][0]);
+    GLuint index = glGetUniformBlockIndex(program, name);
+    if (index == GL_INVALID_INDEX)
+    {
+        std::cout << "could not bind uniform block " << name << std::endl;
+        return false;
+    }
+    glUniformBlockBinding(program, index, binding);
+    return true;
 }
 
-void InitShader() {
+// Сборка шейдерной программы из вершинного и фрагментного шейдеров (пустая, если линковка не удалась);
+// textured - у фрагментного шейдера есть сэмплер ourTexture
+GlProgram CreateProgram(const char* vertexSource, const char* fragmentSource, bool textured = true)
+{
+    // Перед исходным кодом: версия GLSL и определения, зависящие от формата вершин
+    const char* header = "#version 450 core\n";
+    const char* defines = GeometryPool::Instance().Format() == VertexFormat::Packed ? "#define PACKED_VERTICES\n" : "";
+
     // Создаем вершинный шейдер
-    GLuint vShader = glCreateShader(GL_VERTEX_SHADER);
+    GlShader vShader(glCreateShader(GL_VERTEX_SHADER));
     // Передаем исходный код
-    glShaderSource(vShader, 1, &VertexShaderSource, NULL);
+    const char* vertexStrings[] = { header, defines, vertexSource };
+    glShaderSource(vShader, 3, vertexStrings, NULL);
     // Компилируем шейдер
     glCompileShader(vShader);
     ShaderLog(vShader);
 
     // Создаем фрагментный шейдер
-    GLuint fShader = glCreateShader(GL_FRAGMENT_SHADER);
+    GlShader fShader(glCreateShader(GL_FRAGMENT_SHADER));
     // Передаем исходный код
-    glShaderSource(fShader, 1, &FragShaderSource, NULL);
+    const char* fragmentStrings[] = { header, defines, fragmentSource };
+    glShaderSource(fShader, 3, fragmentStrings, NULL);
     // Компилируем шейдер
     glCompileShader(fShader);
     ShaderLog(fShader);
 
     // Создаем программу и прикрепляем шейдеры к ней
-    Program = glCreateProgram();
-    glAttachShader(Program, vShader);
-    glAttachShader(Program, fShader);
+    GlProgram program(glCreateProgram());
+    glAttachShader(program, vShader);
+    glAttachShader(program, fShader);
 
     // Линкуем шейдерную программу
-    glLinkProgram(Program);
+    glLinkProgram(program);
+
+    // Шейдеры после линковки не нужны: они удалятся при выходе из функции (GlShader)
+
     // Проверяем статус сборки
     int link_ok;
-    glGetProgramiv(Program, GL_LINK_STATUS, &link_ok);
+    glGetProgramiv(program, GL_LINK_STATUS, &link_ok);
     if (!link_ok)
     {
         std::cout << "error attach shaders \n";
-        return;
+        return GlProgram();
     }
     checkOpenGLerror();
 
-    const char* unif_name = "xpos";
-    Unif_posx = glGetUniformLocation(Program, unif_name);
-    if (Unif_posx == -1)
-    {
+    if (!textured)
+        return program;
+
+    // сэмплер всегда читает из текстурного блока 0, задаём его один раз
+    const char* unif_name = "ourTexture";
+    GLint unif_texture = glGetUniformLocation(program, unif_name);
+    if (unif_texture == -1)
         std::cout << "could not bind uniform " << unif_name << std::endl;
-        return;
-    }
-    unif_name = "ypos";
-    Unif_posy = glGetUniformLocation(Program, unif_name);
-    if (Unif_posy == -1)
+    else
+        glProgramUniform1i(program, unif_texture, 0);
+
+    return program;
+}
+
+void InitShader() {
+    Program = CreateProgram(VertexShaderSource, FragShaderSource);
+    if (Program)
     {
-        std::cout << "could not bind uniform " << unif_name << std::endl;
-        return;
+        BindUniformBlock(Program, "FrameData", FrameDataBinding);
+        BindUniformBlock(Program, "ObjectData", ObjectDataBinding);
     }
-    unif_name = "zpos";
-    Unif_posz = glGetUniformLocation(Program, unif_name);
-    if (Unif_posz == -1)
+
+    InstProgram = CreateProgram(InstancedVertexShaderSource, FragShaderSource);
+    if (InstProgram)
+        BindUniformBlock(InstProgram, "FrameData", FrameDataBinding);
+
+    DepthProgram = CreateProgram(VertexShaderSource, DepthFragShaderSource, false);
+    if (DepthProgram)
     {
-        std::cout << "could not bind uniform " << unif_name << std::endl;
-        return;
+        BindUniformBlock(DepthProgram, "FrameData", FrameDataBinding);
+        BindUniformBlock(DepthProgram, "ObjectData", ObjectDataBinding);
     }
 
-    // смещение света
-    glUniform1f(Unif_posx, xpos);
-    glUniform1f(Unif_posy, ypos);
-    glUniform1f(Unif_posz, zpos);
+    InstDepthProgram = CreateProgram(InstancedVertexShaderSource, DepthFragShaderSource, false);
+    if (InstDepthProgram)
+        BindUniformBlock(InstDepthProgram, "FrameData", FrameDataBinding);
 
-    // После того, как мы связали шейдеры с нашей программой, удаляем их, т.к. они нам больше не нужны
-    glDeleteShader(vShader);
-    glDeleteShader(fShader);
+    OcclusionProgram = CreateProgram(OcclusionVertexShaderSource, DepthFragShaderSource, false);
+    if (OcclusionProgram)
+        BindUniformBlock(OcclusionProgram, "FrameData", FrameDataBinding);
 }
 
-void InitObjects()
+// Строим BVH над текущими объектами сцены
+void BuildSceneBvh()
 {
-    // вид камеры
-    setMat4(Program, "view", camera.viewMatrix());
+    vector<BoundingBox> boxes(gameObjects.size());
+    for (size_t i = 0; i < gameObjects.size(); i++)
+        boxes[i] = gameObjects[i].WorldBounds();
+    sceneBvh.Build(boxes);
+    bvhVisible.assign(gameObjects.size(), 0);
+}
 
-    // проекция
-    setMat4(Program, "proj", glm::perspective(glm::radians(50.0f), (float)width / (float)height, 0.1f, 100.0f));
+// Объект сцены до загрузки: файл модели и матрица
+struct ScenePlacement
+{
+    string path;
+    glm::mat4 matr;
+};
 
-    // загрузка объектов
-    GameObject car("objects/car.obj");
-    GameObject road("objects/road.obj");
-    GameObject grass("objects/grass.obj");
+// Расстановка объектов сцены (общая для OpenGL и программного рендерера): машина, дорога, трава
+vector<ScenePlacement> SceneLayout()
+{
+    // приближаем и уменьшаем машину
+    glm::mat4 objCar = glm::mat4(1.0f);
+    objCar = glm::translate(objCar, glm::vec3(0.0f, 0.0f, 10.0f));
+    objCar = glm::scale(objCar, glm::vec3(0.8f, 0.6f, 0.7f));
+
+    // опускаем и уменьшаем дорогу
+    glm::mat4 objRoad = glm::mat4(1.0f);
+    objRoad = glm::translate(objRoad, glm::vec3(0.0f, -1.0f, 0.0f));
+    objRoad = glm::scale(objRoad, glm::vec3(0.88f, 1.0f, 1.0f));
 
     // двигаем и увеличиваем траву
     glm::mat4 objGrass = glm::mat4(1.0f);
     objGrass = glm::translate(objGrass, glm::vec3(20.0f, -31.0f, -40.0f));
     objGrass = glm::scale(objGrass, glm::vec3(3.0f, 1.5f, 1.0f));
-    grass.matr = objGrass;
 
-    // опускаем и уменьшаем дорогу
-    glm::mat4 objRoad = glm::mat4(1.0f);
-    objRoad = glm::translate(objRoad, glm::vec3(0.0f, -1.0f, 0.0f));
-    objRoad = glm::scale(objRoad, glm::vec3(0.88f, 1.0f, 1.0f));
-    road.matr = objRoad;
+    return { { "objects/car.obj", objCar }, { "objects/road.obj", objRoad }, { "objects/grass.obj", objGrass } };
+}
 
-    // приближаем и уменьшаем машину
-    glm::mat4 objCar = glm::mat4(1.0f);
-    objCar = glm::translate(objCar, glm::vec3(0.0f, 0.0f, 10.0f));
-    objCar = glm::scale(objCar, glm::vec3(0.8f, 0.6f, 0.7f));
-    car.matr = objCar;
+void InitObjects()
+{
+    CpuZone zone("load scene");
+    // проекция (не меняется, поэтому считается один раз)
+    projection = (glm::perspective(glm::radians(fieldOfView), (float)width / (float)height, nearPlane, farPlane));
+
+    // загрузка объектов: файлы импортируются параллельно, объекты сцены получат уже загруженные модели
+    vector<ScenePlacement> layout = SceneLayout();
+    vector<string> paths;
+    for (const auto& placement : layout)
+        paths.push_back(placement.path);
+    vector<ModelHandle> models = AssetManager::Instance().LoadModels(paths);
 
     // добавляем полученные модели в объекты сцены
-    gameObjects.push_back(car);
-    gameObjects.push_back(road);
-    gameObjects.push_back(grass);
+    for (const auto& placement : layout)
+    {
+        GameObject go(placement.path);
+        go.matr = placement.matr;
+        gameObjects.push_back(go);
+    }
+
+    AssetManager::Instance().PrintStats();
+    // в упакованном формате - насколько квантование исказило вершины
+    GeometryPool::Instance().PackingError().Print();
+    BuildSceneBvh();
+}
+
+// Буферы для данных кадра: места хватает на objectCount объектов
+void InitFrameBuffers(size_t objectCount)
+{
+    uniformRing.Release();
+    instanceRenderer.Release();
 
+    // места в сегменте кольцевого буфера хватает на данные кадра и всех объектов сцены
+    GLint alignment;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    GLsizeiptr align = alignment;
+    GLsizeiptr perObject = (sizeof(ObjectData) + align - 1) / align * align;
+    uniformRing.Init(perObject * (objectCount + 1) + (GLsizeiptr)sizeof(FrameData) + align, alignment);
+
+    instanceRenderer.Init(objectCount);
+    // номера объектов поменялись: старые результаты проверок видимости не годятся
+    occlusion.Init(objectCount);
 }
 
+// Загрузка сцены: вызывается один раз перед циклом рендеринга
 void Init()
 {
+    CpuZone zone("init");
     InitShader();
+    // текстуры декодируются в фоне, первый кадр рисуется с заглушками
+    TextureStreamer::Instance().Init();
+    // потоки для импорта моделей
+    ThreadPool::Instance().Init();
+    // запросы времени GPU
+    GpuProfiler::Instance().Init();
     InitObjects();
+    InitFrameBuffers(gameObjects.size());
+
     // Включаем проверку глубины
-    glEnable(GL_DEPTH_TEST);
+    GlState::Instance().Enable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+}
+
+// Обновление кадра: записываем в кольцевой буфер то, что могло измениться (вид камеры и положение света)
+void Update()
+{
+    CpuZone zone("update");
+    uniformRing.BeginFrame();
+
+    FrameData frameData;
+    frameData.view = camera.viewMatrix();
+    frameData.proj = projection;
+    frameData.viewProj = projection * frameData.view;
+    viewProjection = frameData.viewProj;
+    frameData.lightPos = glm::vec4(xpos, ypos, zpos, 1.0f);
+
+    GLintptr offset = uniformRing.Push(&frameData, sizeof(FrameData));
+    GlState::Instance().BindBufferRange(GL_UNIFORM_BUFFER, FrameDataBinding, uniformRing.Buffer(), offset, sizeof(FrameData));
+}
+
+// Матрицы объекта в кольцевой буфер: смещение блока ObjectData (-1, если место кончилось)
+GLintptr PushObjectData(const GameObject& go)
+{
+    ObjectData objectData;
+    objectData.model = go.DrawMatrix();
+    objectData.normalMat = glm::mat4(glm::transpose(glm::inverse(glm::mat3(go.matr))));
+    return uniformRing.Push(&objectData, sizeof(ObjectData));
+}
+
+// Рисуем объект: его матрицы (по смещению offset в кольцевом буфере) привязываются к блоку ObjectData
+// (depthOnly - только глубина, из потока позиций)
+void DrawObject(GameObject& go, GLintptr offset, bool depthOnly = false)
+{
+    GlState::Instance().BindBufferRange(GL_UNIFORM_BUFFER, ObjectDataBinding, uniformRing.Buffer(), offset, sizeof(ObjectData));
+    if (depthOnly)
+        go.DrawDepth();
+    else
+        go.Draw();
+}
+
+// Объект в очередь рисования: матрицы пишутся в кольцевой буфер сразу, меши рисуются после сортировки
+void QueueObject(GameObject& go)
+{
+    GLintptr offset = PushObjectData(go);
+    if (offset < 0)
+        return;
+    if (useDepthPrepass)
+        renderQueue.Add(RenderPass::Depth, DepthProgram, go, offset);
+    renderQueue.Add(RenderPass::Opaque, Program, go, offset);
+    trianglesDrawn += go.model ? go.model->TriangleCount(go.lod) : 0;
+}
+
+// Предварительный проход глубины: пишется только глубина
+void BeginDepthPrepass()
+{
+    GlState& state = GlState::Instance();
+    state.ColorMask(false);
+    state.DepthMask(true);
+    state.DepthFunc(GL_LESS);
+}
+
+// Проход закраски. После предварительного прохода глубина уже готова: закрашиваются только фрагменты
+// с той же глубиной (по одному на пиксель), глубина больше не пишется
+void BeginShadingPass()
+{
+    GlState& state = GlState::Instance();
+    state.ColorMask(true);
+    state.DepthMask(!useDepthPrepass);
+    state.DepthFunc(useDepthPrepass ? GL_EQUAL : GL_LESS);
+    if (measureOverdraw)
+        overdraw.BeginCounting();
+}
+
+void EndShadingPass()
+{
+    // glClear очищает глубину, только если её запись включена
+    GlState::Instance().DepthMask(true);
+    if (measureOverdraw)
+        overdraw.EndCounting();
+}
+
+// Отсечение по пирамиде видимости: параллелепипеды объектов переводятся в мировые координаты
+// (матрицы объектов могут меняться каждый кадр) и проверяются пачками
+void CullScene()
+{
+    CpuZone zone("cull");
+    if (useBvh)
+    {
+        Frustum frustum;
+        frustum.Extract(viewProjection);
+        visibleObjects = sceneBvh.QueryFrustum(frustum, bvhVisible.data());
+        return;
+    }
+
+    culler.Resize(gameObjects.size());
+    for (size_t i = 0; i < gameObjects.size(); i++)
+        culler.SetBox(i, gameObjects[i].WorldBounds());
+
+    Frustum frustum;
+    frustum.Extract(viewProjection);
+    visibleObjects = culler.Cull(frustum);
+}
+
+// В пирамиде видимости ли объект по результатам последнего отсечения
+bool InFrustum(size_t index)
+{
+    if (!useCulling)
+        return true;
+    return useBvh ? bvhVisible[index] != 0 : culler.IsVisible(index);
+}
+
+// Виден ли объект: в пирамиде видимости и не заслонён по последним готовым запросам видимости
+bool ObjectVisible(size_t index)
+{
+    return InFrustum(index) && !(useOcclusion && occlusion.Occluded(index));
+}
+
+// Результаты запросов видимости прошлых кадров (без ожидания) и сколько объектов в пирамиде они отсекают
+void CollectOcclusion()
+{
+    occludedObjects = 0;
+    if (!useOcclusion)
+        return;
+    CpuZone zone("occlusion collect");
+    occlusion.Collect();
+    for (size_t i = 0; i < gameObjects.size(); i++)
+        occludedObjects += InFrustum(i) && occlusion.Occluded(i);
+}
+
+// Запросы видимости кадра: после закраски в буфере глубины всё нарисованное, против него проверяются
+// параллелепипеды всех объектов в пирамиде видимости (и отсечённых, чтобы заметить, когда они выглянут)
+void TestOcclusion()
+{
+    GpuScope scope("occlusion queries");
+    CpuZone zone("occlusion queries");
+    occlusion.Begin(camera.position, nearPlane * 2.0f);
+    for (size_t i = 0; i < gameObjects.size(); i++)
+        if (InFrustum(i) && gameObjects[i].model)
+            occlusion.Add(i, gameObjects[i].WorldBounds());
+    occlusion.Test(OcclusionProgram);
+}
+
+// Выбираем уровни детализации видимых объектов по их радиусу на экране
+void SelectLods()
+{
+    CpuZone zone("select lods");
+    // сколько пикселей по вертикали занимает единица длины на расстоянии 1 от камеры
+    float pixelsPerUnit = (float)height / (2.0f * tanf(glm::radians(fieldOfView) * 0.5f));
+    for (size_t i = 0; i < gameObjects.size(); i++)
+    {
+        if (!useLod)
+            gameObjects[i].lod = 0;
+        else if (ObjectVisible(i))
+            gameObjects[i].SelectLod(camera.position, pixelsPerUnit);
+    }
+}
+
+// Рисуем сцену: либо группами экземпляров, либо по одному объекту
+void RenderScene()
+{
+    CpuZone zone("render scene");
+    GpuProfiler::Instance().BeginFrame();
+    GlState::Instance().BeginFrame();
+
+    // текстуры, декодированные в фоне с прошлого кадра
+    {
+        GpuScope scope("texture upload");
+        CpuZone zone("texture upload");
+        TextureStreamer::Instance().Update(textureUploadBudgetMs);
+    }
+
+    // обновляем камеру и свет
+    Update();
+
+    if (useCulling)
+        CullScene();
+    else
+        visibleObjects = gameObjects.size();
+
+    CollectOcclusion();
+    SelectLods();
+
+    // при замере перерисовки кадр рисуется в буфер замера и потом копируется в окно
+    if (measureOverdraw)
+    {
+        if (!overdraw.Ready())
+            overdraw.Init(width, height);
+        overdraw.BeginFrame();
+    }
+
+    // рендеринг
+    {
+        GpuScope scope("clear");
+        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+    }
+
+    trianglesDrawn = 0;
+    ScopeTimer submitTimer;
+    if (useInstancing)
+    {
+        GpuScope scope("draw instanced");
+        CpuZone drawZone("draw instanced");
+        instanceRenderer.Begin();
+        for (size_t i = 0; i < gameObjects.size(); i++)
+            if (ObjectVisible(i))
+                instanceRenderer.Add(gameObjects[i]);
+        // экземпляры и команды пишутся один раз, рисуются на каждый проход
+        if (instanceRenderer.Prepare())
+        {
+            if (useDepthPrepass)
+            {
+                GpuScope scope("depth prepass");
+                BeginDepthPrepass();
+                GlState::Instance().UseProgram(InstDepthProgram);
+                instanceRenderer.SubmitDepth();
+            }
+            BeginShadingPass();
+            GlState::Instance().UseProgram(InstProgram);
+            instanceRenderer.Submit();
+            EndShadingPass();
+        }
+        instanceRenderer.Finish();
+        trianglesDrawn = instanceRenderer.TriangleCount();
+    }
+    else
+    {
+        GpuScope scope("draw per object");
+        CpuZone drawZone("draw per object");
+        // по ссылке, чтобы не копировать объекты вместе с их вершинами и текстурами
+        if (useRenderQueue)
+        {
+            renderQueue.Begin(camera.position, farPlane);
+            for (size_t i = 0; i < gameObjects.size(); i++)
+                if (ObjectVisible(i))
+                    QueueObject(gameObjects[i]);
+            renderQueue.Sort();
+            if (useDepthPrepass)
+            {
+                GpuScope scope("depth prepass");
+                BeginDepthPrepass();
+                renderQueue.Draw(RenderPass::Depth, uniformRing.Buffer(), ObjectDataBinding, sizeof(ObjectData));
+            }
+            BeginShadingPass();
+            renderQueue.Draw(RenderPass::Opaque, uniformRing.Buffer(), ObjectDataBinding, sizeof(ObjectData));
+            EndShadingPass();
+        }
+        else
+        {
+            objectOffsets.resize(gameObjects.size());
+            for (size_t i = 0; i < gameObjects.size(); i++)
+                objectOffsets[i] = ObjectVisible(i) ? PushObjectData(gameObjects[i]) : -1;
+
+            if (useDepthPrepass)
+            {
+                GpuScope scope("depth prepass");
+                BeginDepthPrepass();
+                GlState::Instance().UseProgram(DepthProgram);
+                for (size_t i = 0; i < gameObjects.size(); i++)
+                    if (objectOffsets[i] >= 0)
+                        DrawObject(gameObjects[i], objectOffsets[i], true);
+            }
+            BeginShadingPass();
+            GlState::Instance().UseProgram(Program);
+            for (size_t i = 0; i < gameObjects.size(); i++)
+            {
+                if (objectOffsets[i] < 0)
+                    continue;
+                DrawObject(gameObjects[i], objectOffsets[i]);
+                trianglesDrawn += gameObjects[i].model ? gameObjects[i].model->TriangleCount(gameObjects[i].lod) : 0;
+            }
+            EndShadingPass();
+        }
+    }
+    drawSubmitMs = submitTimer.ElapsedMs();
+
+    if (useOcclusion)
+        TestOcclusion();
+
+    if (measureOverdraw)
+        overdraw.EndFrame(0);
+
+    // данные кадра записаны, помечаем сегмент кольцевого буфера fence-ом
+    uniformRing.EndFrame();
+    GpuProfiler::Instance().EndFrame();
+    GlState::Instance().EndFrame();
+}
+
+// Сцена из baseScene и count копий машины car: ряды по 8 полос, уходящие вдаль
+void SpawnTraffic(const GameObject& car, const vector<GameObject>& baseScene, size_t count)
+{
+    gameObjects = baseScene;
+    gameObjects.reserve(baseScene.size() + count);
+    for (size_t i = 0; i < count; i++)
+    {
+        GameObject go = car;
+        float lane = (float)(i % 8) - 3.5f;
+        float row = (float)(i / 8);
+        go.matr = glm::translate(glm::mat4(1.0f), glm::vec3(lane * 4.0f, 0.0f, 10.0f - row * 6.0f));
+        go.matr = glm::scale(go.matr, glm::vec3(0.8f, 0.6f, 0.7f));
+        gameObjects.push_back(go);
+    }
+    InitFrameBuffers(gameObjects.size());
+    BuildSceneBvh();
+}
+
+// Стресс-тест инстансного рисования: сцена с растущим числом машин на дороге,
+// для каждого размера меряем время кадра (с glFinish) по одному объекту и через glMultiDrawElementsIndirect
+void BenchInstancing(GLFWwindow* window)
+{
+    const size_t counts[] = { 100, 1000, 10000, 20000, 50000 };
+    const int frames = 200;
+    // дальше по одному объекту рисовать слишком долго, сравниваем только до этого размера
+    const size_t maxPerObject = 10000;
+
+    // дорога и трава остаются, машины добавляются копиями первой
+    GameObject car = gameObjects[0];
+    vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+
+    for (size_t count : counts)
+    {
+        SpawnTraffic(car, baseScene, count);
+
+        for (int instanced = 0; instanced < 2; instanced++)
+        {
+            if (!instanced && count > maxPerObject)
+                continue;
+            useInstancing = instanced != 0;
+
+            FrameTimeStats stats;
+            for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+            {
+                ScopeTimer timer;
+                RenderScene();
+                glfwSwapBuffers(window);
+                glFinish();
+                glfwPollEvents();
+                stats.Add(timer.ElapsedMs());
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "%zu cars, %s", count, instanced ? "instanced" : "per-object");
+            stats.Print(name);
+            if (instanced)
+                printf("%32s draw calls %zu\n", "", instanceRenderer.DrawCalls());
+        }
+    }
+
+    useInstancing = true;
+    gameObjects = baseScene;
+    gameObjects.insert(gameObjects.begin(), car);
+    BuildSceneBvh();
 }
 
-// Освобождение шейдеров и glwf реcурсов
+// Бенчмарк уровней детализации: плотный поток машин, уходящий вдаль,
+// сравниваем число треугольников и время кадра с уровнями детализации и без них
+void BenchLod(GLFWwindow* window)
+{
+    const size_t count = 5000;
+    const int frames = 200;
+
+    // сколько треугольников в каждом уровне детализации машины
+    GameObject car = gameObjects[0];
+    for (int lod = 0; lod < car.model->lodCount; lod++)
+        printf("car lod %d: %zu triangles\n", lod, car.model->TriangleCount(lod));
+
+    vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+    SpawnTraffic(car, baseScene, count);
+
+    for (int lods = 0; lods < 2; lods++)
+    {
+        useLod = lods != 0;
+
+        FrameTimeStats stats;
+        size_t triangles = 0;
+        for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+        {
+            ScopeTimer timer;
+            RenderScene();
+            glfwSwapBuffers(window);
+            glFinish();
+            glfwPollEvents();
+            stats.Add(timer.ElapsedMs());
+            triangles = trianglesDrawn;
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "%zu cars, lod %s", count, useLod ? "on" : "off");
+        stats.Print(name);
+        printf("%32s triangles per frame %zu\n", "", triangles);
+    }
+
+    useLod = true;
+    gameObjects = baseScene;
+    gameObjects.insert(gameObjects.begin(), car);
+    BuildSceneBvh();
+}
+
+// Бенчмарк очереди рисования: count объектов вперемешку (машина, дорога, трава в случайном порядке),
+// рисуем по одному объекту в порядке сцены и через очередь с сортировкой по ключам.
+// Сравниваем время отправки команд на CPU, время кадра и число смен состояния, дошедших до драйвера
+void BenchRenderQueue(GLFWwindow* window)
+{
+    const size_t count = 10000;
+    const int frames = 200;
+
+    vector<GameObject> original = gameObjects;
+    // объекты сетки 100 x 100 перед камерой; дорога и трава уменьшены, чтобы кадр не упирался в закраску
+    gameObjects.clear();
+    gameObjects.reserve(count);
+    for (size_t i = 0; i < count; i++)
+    {
+        // модель выбирается псевдослучайно, чтобы соседние объекты сцены были с разными текстурами
+        size_t pick = ((i * 2654435761u) >> 16) % original.size();
+        GameObject go = original[pick];
+        float x = (float)(i % 100) - 49.5f;
+        float z = -(float)(i / 100);
+        glm::mat4 matr = glm::translate(glm::mat4(1.0f), glm::vec3(x * 2.0f, 0.0f, 10.0f + z * 2.0f));
+        go.matr = glm::scale(matr, pick == 0 ? glm::vec3(0.2f) : glm::vec3(0.02f));
+        gameObjects.push_back(go);
+    }
+    InitFrameBuffers(gameObjects.size());
+    BuildSceneBvh();
+
+    // ждём текстуры: пока вместо них заглушка, текстура у всех мешей одна
+    while (TextureStreamer::Instance().Pending() > 0 && !glfwWindowShouldClose(window))
+    {
+        RenderScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    useInstancing = false;
+    for (int queued = 0; queued < 2; queued++)
+    {
+        useRenderQueue = queued != 0;
+
+        FrameTimeStats stats;
+        FrameTimeStats submit;
+        for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+        {
+            ScopeTimer timer;
+            RenderScene();
+            glfwSwapBuffers(window);
+            glFinish();
+            glfwPollEvents();
+            stats.Add(timer.ElapsedMs());
+            submit.Add(drawSubmitMs);
+        }
+
+        const GlState::FrameStats& gl = GlState::Instance().LastFrame();
+        char name[64];
+        snprintf(name, sizeof(name), "%zu mixed, %s", count, queued ? "sorted queue" : "scene order");
+        stats.Print(name);
+        snprintf(name, sizeof(name), "%zu mixed, %s submit", count, queued ? "sorted queue" : "scene order");
+        submit.Print(name);
+        printf("%32s draw calls %zu, state changes %zu (filtered %zu)\n", "", gl.drawCalls, gl.issued, gl.filtered);
+    }
+
+    useInstancing = true;
+    useRenderQueue = true;
+    gameObjects = original;
+    InitFrameBuffers(gameObjects.size());
+    BuildSceneBvh();
+}
+
+// Бенчмарк предварительного прохода глубины: исходная сцена и плотный поток машин,
+// рисование через очередь (от ближних к дальним) и инстансное (без порядка по глубине), с проходом и без.
+// Время кадра меряется без замера перерисовки, затем несколько кадров - с ним (на копирование трафарета уходит время)
+void BenchDepthPrepass(GLFWwindow* window)
+{
+    const size_t trafficCount = 5000;
+    const int frames = 200;
+    const int overdrawFrames = 10;
+
+    GameObject car = gameObjects[0];
+    vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+    vector<GameObject> original = gameObjects;
+
+    // ждём текстуры, чтобы в замер не попала их загрузка
+    while (TextureStreamer::Instance().Pending() > 0 && !glfwWindowShouldClose(window))
+    {
+        RenderScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    for (int scene = 0; scene < 2; scene++)
+    {
+        if (scene == 1)
+            SpawnTraffic(car, baseScene, trafficCount);
+
+        for (int instanced = 0; instanced < 2; instanced++)
+        {
+            useInstancing = instanced != 0;
+            for (int prepass = 0; prepass < 2; prepass++)
+            {
+                useDepthPrepass = prepass != 0;
+
+                FrameTimeStats stats;
+                for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+                {
+                    ScopeTimer timer;
+                    RenderScene();
+                    glfwSwapBuffers(window);
+                    glFinish();
+                    glfwPollEvents();
+                    stats.Add(timer.ElapsedMs());
+                }
+
+                measureOverdraw = true;
+                for (int f = 0; f < overdrawFrames && !glfwWindowShouldClose(window); f++)
+                {
+                    RenderScene();
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                }
+                measureOverdraw = false;
+
+                char name[64];
+                snprintf(name, sizeof(name), "%s, %s, prepass %s", scene ? "traffic" : "scene",
+                    instanced ? "instanced" : "queue", prepass ? "on" : "off");
+                stats.Print(name);
+                const OverdrawMeter::Result& result = overdraw.Last();
+                printf("%32s overdraw %.2f per pixel, %.2f per covered pixel (%.0f%% covered)\n", "",
+                    result.perPixel, result.perCoveredPixel, result.coverage * 100.0);
+            }
+        }
+    }
+    GpuProfiler::Instance().Print();
+
+    useInstancing = true;
+    useDepthPrepass = false;
+    gameObjects = original;
+    BuildSceneBvh();
+}
+
+// Оценка вершин, которые прочитает проход глубины кадра: вершины каждого нарисованного меша по одному разу
+// (кэш вершин повторно их не читает), в байтах потока, из которого меш рисуется
+size_t DepthVertexBytes()
+{
+    const GeometryPool& pool = GeometryPool::Instance();
+    size_t bytes = 0;
+    for (size_t i = 0; i < gameObjects.size(); i++)
+    {
+        if (!ObjectVisible(i) || !gameObjects[i].model)
+            continue;
+        for (const Mesh& mesh : gameObjects[i].model->meshes)
+        {
+            size_t stride = mesh.DrawsPositions() ? pool.PositionStride() : pool.VertexStride();
+            bytes += (size_t)mesh.DepthLod(gameObjects[i].lod).vertexCount * stride;
+        }
+    }
+    return bytes;
+}
+
+// Бенчмарк потока позиций: плотный поток машин с предварительным проходом глубины,
+// проход рисуется из полных вершин и из потока позиций (через очередь и инстансно).
+// Время прохода - по GpuProfiler (окно его истории вмещает все кадры одного замера)
+void BenchPositionStream(GLFWwindow* window)
+{
+    const size_t trafficCount = 5000;
+    const int frames = GpuProfiler::HistorySize;
+
+    GameObject car = gameObjects[0];
+    vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+    vector<GameObject> original = gameObjects;
+    bool initialStream = Mesh::UsePositionStream();
+
+    while (TextureStreamer::Instance().Pending() > 0 && !glfwWindowShouldClose(window))
+    {
+        RenderScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    SpawnTraffic(car, baseScene, trafficCount);
+    useDepthPrepass = true;
+    const GeometryPool& pool = GeometryPool::Instance();
+    printf("%32s pool vertices %.1f MB, positions %.1f MB\n", "",
+        pool.VertexBytes() / (1024.0 * 1024.0), pool.PositionBytes() / (1024.0 * 1024.0));
+
+    for (int instanced = 0; instanced < 2; instanced++)
+    {
+        useInstancing = instanced != 0;
+        for (int stream = 0; stream < 2; stream++)
+        {
+            Mesh::UsePositionStream() = stream != 0;
+
+            FrameTimeStats stats;
+            for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+            {
+                ScopeTimer timer;
+                RenderScene();
+                glfwSwapBuffers(window);
+                glFinish();
+                glfwPollEvents();
+                stats.Add(timer.ElapsedMs());
+            }
+
+            char name[64];
+            snprintf(name, sizeof(name), "traffic, %s, depth from %s", instanced ? "instanced" : "queue",
+                stream ? "positions" : "vertices");
+            stats.Print(name);
+            GpuProfiler::RegionStats prepass;
+            if (GpuProfiler::Instance().Stats("depth prepass", prepass))
+                printf("%32s depth prepass gpu %.3f ms avg, %.3f ms p95\n", "", prepass.averageMs, prepass.p95Ms);
+            printf("%32s depth pass vertex fetch ~%.1f MB per frame\n", "", DepthVertexBytes() / (1024.0 * 1024.0));
+        }
+    }
+
+    useInstancing = true;
+    useDepthPrepass = false;
+    Mesh::UsePositionStream() = initialStream;
+    gameObjects = original;
+    BuildSceneBvh();
+}
+
+// Бенчмарк отсечения запросами видимости: пробка из машин (ряды вплотную друг к другу), камера сверху, как в сцене,
+// и на уровне машин, откуда ближние ряды заслоняют дальние; рисование инстансное и через очередь, с отсечением и без.
+// Первые кадры с отсечением не меряются: результатов запросов ещё нет
+void BenchOcclusion(GLFWwindow* window)
+{
+    const size_t jamCount = 5000;
+    const int frames = 200;
+    const int warmupFrames = 10;
+
+    GameObject car = gameObjects[0];
+    vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+    vector<GameObject> original = gameObjects;
+    glm::vec3 startPosition = camera.position;
+    glm::vec3 startDirection = camera.direction;
+
+    while (TextureStreamer::Instance().Pending() > 0 && !glfwWindowShouldClose(window))
+    {
+        RenderScene();
+        glfwSwapBuffers(window);
+        glfwPollEvents();
+    }
+
+    // пробка: машины стоят плотнее, чем в SpawnTraffic
+    SpawnTraffic(car, baseScene, jamCount);
+    for (size_t i = baseScene.size(); i < gameObjects.size(); i++)
+    {
+        size_t n = i - baseScene.size();
+        float lane = (float)(n % 8) - 3.5f;
+        float row = (float)(n / 8);
+        gameObjects[i].matr = glm::translate(glm::mat4(1.0f), glm::vec3(lane * 3.0f, 0.0f, 10.0f - row * 3.5f));
+        gameObjects[i].matr = glm::scale(gameObjects[i].matr, glm::vec3(0.8f, 0.6f, 0.7f));
+    }
+    BuildSceneBvh();
+
+    for (int view = 0; view < 2; view++)
+    {
+        if (view == 1)
+        {
+            camera.position = glm::vec3(0.0f, 2.5f, 16.0f);
+            camera.direction = glm::normalize(glm::vec3(0.0f, -0.1f, -1.0f));
+        }
+
+        for (int instanced = 0; instanced < 2; instanced++)
+        {
+            useInstancing = instanced != 0;
+            for (int occlusionOn = 0; occlusionOn < 2; occlusionOn++)
+            {
+                SetOcclusion(occlusionOn != 0);
+                for (int f = 0; f < warmupFrames && !glfwWindowShouldClose(window); f++)
+                {
+                    RenderScene();
+                    glfwSwapBuffers(window);
+                    glfwPollEvents();
+                }
+
+                FrameTimeStats stats;
+                size_t occluded = 0, visible = 0, triangles = 0;
+                int measured = 0;
+                for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+                {
+                    ScopeTimer timer;
+                    RenderScene();
+                    glfwSwapBuffers(window);
+                    glFinish();
+                    glfwPollEvents();
+                    stats.Add(timer.ElapsedMs());
+                    occluded += occludedObjects;
+                    visible += visibleObjects;
+                    triangles += trianglesDrawn;
+                    measured++;
+                }
+
+                char name[64];
+                snprintf(name, sizeof(name), "jam, %s view, %s, occlusion %s", view ? "street" : "top",
+                    instanced ? "instanced" : "queue", occlusionOn ? "on" : "off");
+                stats.Print(name);
+                if (measured == 0)
+                    continue;
+                printf("%32s in frustum %zu, occluded %zu, triangles %zu per frame\n", "",
+                    visible / measured, occluded / measured, triangles / measured);
+            }
+        }
+    }
+    printf("%32s occlusion frames dropped (all query sets busy) %zu\n", "", occlusion.DroppedFrames());
+    GpuProfiler::Instance().Print();
+
+    useInstancing = true;
+    SetOcclusion(false);
+    camera.position = startPosition;
+    camera.direction = startDirection;
+    gameObjects = original;
+    InitFrameBuffers(gameObjects.size());
+    BuildSceneBvh();
+}
+
+// Сравнение форматов вершин: сцена загружается заново в обычном и упакованном формате,
+// для каждого меряем объём вершин в видеопамяти и время кадра на плотном потоке машин
+void BenchVertexFormat(GLFWwindow* window)
+{
+    const size_t count = 5000;
+    const int frames = 200;
+    const VertexFormat formats[] = { VertexFormat::Float, VertexFormat::Packed };
+    VertexFormat initial = GeometryPool::Instance().Format();
+
+    for (VertexFormat format : formats)
+    {
+        // формат общий для всего буфера геометрии, поэтому модели и шейдеры создаются заново
+        gameObjects.clear();
+        instanceRenderer.Release();
+        GeometryPool::Instance().Release();
+        GeometryPool::Instance().SetFormat(format);
+        // старые программы удаляются при присваивании новых
+        InitShader();
+        InitObjects();
+
+        GameObject car = gameObjects[0];
+        vector<GameObject> baseScene(gameObjects.begin() + 1, gameObjects.end());
+        SpawnTraffic(car, baseScene, count);
+
+        // ждём текстуры, чтобы в замер не попала их загрузка
+        while (TextureStreamer::Instance().Pending() > 0 && !glfwWindowShouldClose(window))
+        {
+            RenderScene();
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
+
+        FrameTimeStats stats;
+        for (int f = 0; f < frames && !glfwWindowShouldClose(window); f++)
+        {
+            ScopeTimer timer;
+            RenderScene();
+            glfwSwapBuffers(window);
+            glFinish();
+            glfwPollEvents();
+            stats.Add(timer.ElapsedMs());
+        }
+
+        const GeometryPool& pool = GeometryPool::Instance();
+        char name[64];
+        snprintf(name, sizeof(name), "%zu cars, %s vertices", count, format == VertexFormat::Packed ? "packed" : "float");
+        stats.Print(name);
+        printf("%32s %zu vertices, %zu bytes each, %.2f MB of vertex data\n", "",
+            pool.VertexCount(), pool.VertexStride(), pool.VertexBytes() / (1024.0 * 1024.0));
+    }
+
+    // возвращаем исходный формат
+    gameObjects.clear();
+    instanceRenderer.Release();
+    GeometryPool::Instance().Release();
+    GeometryPool::Instance().SetFormat(initial);
+    InitShader();
+    InitObjects();
+    InitFrameBuffers(gameObjects.size());
+}
+
+// Бенчмарк загрузки моделей: все .obj папки (каждый по copies раз, чтобы работы было достаточно)
+// загружаются последовательно и через пул потоков без кэша, а затем из двоичного кэша;
+// отдельно меряем импорт (Assimp, меши, уровни детализации) и создание объектов OpenGL, которое всегда идёт в одном потоке
+void BenchImport(const string& directory)
+{
+    const int copies = 8;
+    const int runs = 3;
+
+    vector<string> files;
+    error_code ec;
+    for (const auto& entry : filesystem::directory_iterator(directory, ec))
+        if (entry.is_regular_file() && entry.path().extension() == ".obj")
+            files.push_back(entry.path().generic_string());
+    if (files.empty())
+    {
+        printf("no .obj files in %s\n", directory.c_str());
+        return;
+    }
+    printf("%zu files x %d copies, %zu threads\n", files.size(), copies, ThreadPool::Instance().ThreadCount() + 1);
+
+    // режимы: 0 - последовательно, 1 - параллельно, 2 - параллельно из кэша
+    for (int mode = 0; mode < 3; mode++)
+    {
+        bool parallel = mode > 0;
+        bool cached = mode == 2;
+        ThreadPool::Instance().SetParallel(parallel);
+        meshCache::SetEnabled(cached);
+        // кэш заполняется одним импортом заранее
+        if (cached)
+            for (const auto& file : files)
+                Model::Import(file);
+
+        FrameTimeStats importStats, createStats;
+        for (int run = 0; run < runs; run++)
+        {
+            vector<ModelData> imported(files.size() * copies);
+            ScopeTimer timer;
+            ThreadPool::Instance().ParallelFor(imported.size(), [&](size_t i)
+            {
+                imported[i] = Model::Import(files[i % files.size()]);
+            });
+            importStats.Add(timer.ElapsedMs());
+
+            timer.Restart();
+            vector<shared_ptr<Model>> models;
+            for (auto& data : imported)
+                models.push_back(make_shared<Model>(move(data)));
+            glFinish();
+            createStats.Add(timer.ElapsedMs());
+        }
+
+        printf("%s: import %.1f ms, create GL objects %.1f ms (mean of %d)\n",
+            cached ? "parallel, cached" : parallel ? "parallel" : "serial", importStats.Mean(), createStats.Mean(), runs);
+    }
+    ThreadPool::Instance().SetParallel(true);
+    meshCache::SetEnabled(true);
+}
+
+// Бенчмарк BVH (без OpenGL): запросы по пирамиде видимости и лучом через BVH и перебором всех объектов,
+// а также обновление BVH после перемещения 1% объектов
+void BenchBvh()
+{
+    const size_t counts[] = { 1000, 10000, 100000 };
+    const int iterations = 100;
+    const int rays = 1000;
+
+    Camera benchCamera(glm::vec3(0.0f, 20.0f, 30.0f));
+    Frustum frustum;
+    frustum.Extract(glm::perspective(glm::radians(50.0f), (float)width / (float)height, 0.1f, 200.0f) * benchCamera.viewMatrix());
+
+    for (size_t count : counts)
+    {
+        // объекты разбросаны по квадрату, сторона которого растёт с их числом (плотность постоянная)
+        srand(1);
+        float side = sqrtf((float)count) * 8.0f;
+        vector<BoundingBox> boxes(count);
+        for (auto& box : boxes)
+        {
+            glm::vec3 center(((float)rand() / RAND_MAX - 0.5f) * side, 0.0f, ((float)rand() / RAND_MAX - 0.5f) * side);
+            glm::vec3 half(1.5f, 1.0f, 3.0f);
+            box.min = center - half;
+            box.max = center + half;
+        }
+
+        ScopeTimer buildTimer;
+        Bvh bvh;
+        bvh.Build(boxes);
+        double buildMs = buildTimer.ElapsedMs();
+        vector<uint8_t> visible(count);
+
+        FrameTimeStats bvhFrustum, bruteFrustum, bvhRay, bruteRay, refit;
+        size_t foundBvh = 0, foundBrute = 0;
+        for (int it = 0; it < iterations; it++)
+        {
+            ScopeTimer timer;
+            foundBvh = bvh.QueryFrustum(frustum, visible.data());
+            bvhFrustum.Add(timer.ElapsedMs());
+
+            timer.Restart();
+            foundBrute = 0;
+            for (size_t i = 0; i < count; i++)
+                foundBrute += frustum.Intersects(boxes[i]);
+            bruteFrustum.Add(timer.ElapsedMs());
+
+            // лучи из камеры в случайных направлениях вниз
+            srand(it);
+            timer.Restart();
+            for (int r = 0; r < rays; r++)
+            {
+                glm::vec3 dir = glm::normalize(glm::vec3((float)rand() / RAND_MAX - 0.5f, -0.5f, (float)rand() / RAND_MAX - 0.5f));
+                bvh.QueryRay(benchCamera.position, dir, 1e9f);
+            }
+            bvhRay.Add(timer.ElapsedMs());
+
+            srand(it);
+            timer.Restart();
+            for (int r = 0; r < rays; r++)
+            {
+                glm::vec3 dir = glm::normalize(glm::vec3((float)rand() / RAND_MAX - 0.5f, -0.5f, (float)rand() / RAND_MAX - 0.5f));
+                glm::vec3 invDir(1.0f / dir.x, 1.0f / dir.y, 1.0f / dir.z);
+                float closest = 1e9f, t;
+                for (size_t i = 0; i < count; i++)
+                    if (Bvh::RayBox(benchCamera.position, invDir, boxes[i], closest, t))
+                        closest = t;
+            }
+            bruteRay.Add(timer.ElapsedMs());
+
+            // двигаем 1% объектов
+            timer.Restart();
+            for (size_t i = 0; i < count / 100; i++)
+            {
+                size_t index = (size_t)rand() % count;
+                boxes[index].min.x += 0.5f;
+                boxes[index].max.x += 0.5f;
+                bvh.Refit(index, boxes[index]);
+            }
+            refit.Add(timer.ElapsedMs());
+        }
+
+        printf("%zu objects: build %.3f ms, %zu nodes, frustum finds %zu (brute force %zu)\n", count, buildMs, bvh.NodeCount(), foundBvh, foundBrute);
+        bvhFrustum.Print("  frustum query, bvh");
+        bruteFrustum.Print("  frustum query, brute force");
+        bvhRay.Print("  1000 rays, bvh");
+        bruteRay.Print("  1000 rays, brute force");
+        refit.Print("  refit 1% of objects");
+    }
+}
+
+// Бенчмарк отсечения (без OpenGL): 100 тысяч случайных параллелепипедов,
+// проверка по одному объекту и пачками SIMD
+void BenchCulling()
+{
+    const size_t count = 100000;
+    const int iterations = 200;
+
+    FrustumCuller bench;
+    bench.Resize(count);
+    srand(1);
+    for (size_t i = 0; i < count; i++)
+    {
+        glm::vec3 center((float)(rand() % 2000 - 1000), (float)(rand() % 100 - 50), (float)(rand() % 2000 - 1000));
+        glm::vec3 half(1.0f + (float)(rand() % 40) / 10.0f);
+        BoundingBox box;
+        box.min = center - half;
+        box.max = center + half;
+        bench.SetBox(i, box);
+    }
+
+    Camera benchCamera(glm::vec3(0.0f, 20.0f, 30.0f));
+    Frustum frustum;
+    frustum.Extract(glm::perspective(glm::radians(50.0f), (float)width / (float)height, 0.1f, 1000.0f) * benchCamera.viewMatrix());
+
+    FrameTimeStats scalar, simd;
+    size_t visibleScalar = 0, visibleSimd = 0;
+    for (int i = 0; i < iterations; i++)
+    {
+        ScopeTimer timer;
+        visibleScalar = bench.CullScalar(frustum);
+        scalar.Add(timer.ElapsedMs());
+
+        timer.Restart();
+        visibleSimd = bench.Cull(frustum);
+        simd.Add(timer.ElapsedMs());
+    }
+
+    printf("culling %zu boxes: %zu visible (scalar), %zu visible (simd)\n", count, visibleScalar, visibleSimd);
+    scalar.Print("scalar");
+#if defined(CULLING_AVX)
+    simd.Print("simd (AVX, 8 per iteration)");
+#elif defined(CULLING_SSE)
+    simd.Print("simd (SSE, 4 per iteration)");
+#else
+    simd.Print("simd (not available, scalar)");
+#endif
+}
+
+// Кадр записи трассы закончен: после последнего (или при выходе) выгружаем её в traceFile
+void FinishTraceFrame(bool force)
+{
+    if (traceFramesLeft == 0 || (--traceFramesLeft > 0 && !force))
+        return;
+    traceFramesLeft = 0;
+    cpuProfiler::StopCapture();
+    if (cpuProfiler::ExportChromeTrace(traceFile))
+        printf("trace: %zu events (%zu dropped) written to %s\n", cpuProfiler::EventCount(), cpuProfiler::DroppedEvents(), traceFile.c_str());
+    else
+        printf("trace: can't write %s\n", traceFile.c_str());
+}
+
+// Положение камеры на заданном пути (t от 0 до 1): пролёт вдоль дороги с покачиванием из стороны в сторону,
+// с постепенным снижением, - всегда одни и те же кадры, чтобы прогоны можно было сравнивать
+glm::vec3 CameraPath(float t)
+{
+    const float pi = 3.14159265f;
+    return glm::vec3(8.0f * sinf(2.0f * pi * t), 20.0f - 8.0f * t, 30.0f - 50.0f * t);
+}
+
+// Бенчмарк без окна: сцена рисуется в буфер вне экрана, камера летит по CameraPath.
+// Время кадра - от начала RenderScene до glFinish, то есть вместе с работой GPU (или llvmpipe)
+void BenchHeadless(int frames)
+{
+    printf("renderer: %s (%s)\n", (const char*)glGetString(GL_RENDERER), (const char*)glGetString(GL_VERSION));
+
+    OffscreenTarget target;
+    target.Init(width, height);
+    if (!target.Complete())
+    {
+        printf("headless: offscreen framebuffer is incomplete\n");
+        return;
+    }
+    target.Bind();
+
+    glm::vec3 startPosition = camera.position;
+
+    // прогрев: ждём фоновую загрузку текстур (иначе часть кадров рисуется с заглушками)
+    const int warmupFrames = 10;
+    const double streamingTimeoutMs = 30000.0;
+    ScopeTimer warmup;
+    camera.position = CameraPath(0.0f);
+    for (int f = 0; f < warmupFrames || (TextureStreamer::Instance().Pending() > 0 && warmup.ElapsedMs() < streamingTimeoutMs); f++)
+    {
+        RenderScene();
+        glFinish();
+    }
+
+    FrameTimeStats stats;
+    size_t triangles = 0;
+    size_t occluded = 0;
+    for (int f = 0; f < frames; f++)
+    {
+        FinishTraceFrame(false);
+        CpuZone frameZone("frame");
+        camera.position = CameraPath((float)f / frames);
+
+        ScopeTimer timer;
+        RenderScene();
+        glFinish();
+        stats.Add(timer.ElapsedMs());
+        triangles += trianglesDrawn;
+        occluded += occludedObjects;
+    }
+    FinishTraceFrame(true);
+
+    char name[64];
+    snprintf(name, sizeof(name), "headless %dx%d, %d frames", width, height, frames);
+    stats.Print(name);
+    printf("%32s triangles per frame %zu\n", "", frames > 0 ? triangles / frames : 0);
+    if (useOcclusion)
+        printf("%32s occluded objects per frame %.1f\n", "", frames > 0 ? (double)occluded / frames : 0.0);
+    const GlState::FrameStats& gl = GlState::Instance().LastFrame();
+    printf("%32s draw calls %zu, state changes %zu (filtered %zu)\n", "", gl.drawCalls, gl.issued, gl.filtered);
+    GpuProfiler::Instance().Print();
+
+    camera.position = startPosition;
+    GlState::Instance().BindFramebuffer(GL_FRAMEBUFFER, 0);
+    target.Release();
+}
+
+// Бенчмарк программного рендерера (без OpenGL): тот же путь камеры, что и в BenchHeadless,
+// при 1, 2, 4, ... потоках до числа ядер. Картинка первого кадра должна совпадать при любом числе потоков,
+// она же сохраняется в imagePath как эталон
+void BenchSoftware(int frames, const string& imagePath)
+{
+    SoftwareRenderer renderer;
+    renderer.Init(width, height);
+
+    vector<pair<shared_ptr<SoftModel>, glm::mat4>> scene;
+    for (const auto& placement : SceneLayout())
+        scene.push_back(make_pair(renderer.LoadModel(placement.path), placement.matr));
+
+    glm::mat4 proj = glm::perspective(glm::radians(fieldOfView), (float)width / (float)height, 0.1f, 100.0f);
+    glm::vec3 startPosition = camera.position;
+    auto renderFrame = [&](float t)
+    {
+        camera.position = CameraPath(t);
+        renderer.Begin(proj * camera.viewMatrix(), glm::vec3(xpos, ypos, zpos));
+        for (const auto& object : scene)
+            renderer.Add(*object.first, object.second);
+        renderer.Render();
+    };
+
+    vector<int> threadCounts;
+    int cores = max(1, (int)thread::hardware_concurrency());
+    for (int threads = 1; threads < cores; threads *= 2)
+        threadCounts.push_back(threads);
+    threadCounts.push_back(cores);
+
+    vector<uint32_t> reference;
+    for (int threads : threadCounts)
+    {
+        // вызывающий поток тоже работает, поэтому рабочих на один меньше
+        ThreadPool::Instance().Release();
+        if (threads > 1)
+            ThreadPool::Instance().Init(threads - 1);
+
+        renderFrame(0.0f);
+        if (reference.empty())
+        {
+            reference = renderer.Pixels();
+            if (!imagePath.empty() && renderer.SavePpm(imagePath))
+                printf("software image written to %s\n", imagePath.c_str());
+        }
+        else if (renderer.Pixels() != reference)
+            printf("software image with %d threads differs from the 1-thread image\n", threads);
+
+        FrameTimeStats stats;
+        for (int f = 0; f < frames; f++)
+        {
+            ScopeTimer timer;
+            renderFrame((float)f / frames);
+            stats.Add(timer.ElapsedMs());
+        }
+
+        char name[64];
+        snprintf(name, sizeof(name), "software %dx%d, %d threads", width, height, threads);
+        stats.Print(name);
+    }
+    printf("%32s triangles in last frame %zu\n", "", renderer.TriangleCount());
+
+    camera.position = startPosition;
+    ThreadPool::Instance().Release();
+    ThreadPool::Instance().Init();
+}
+
+// Настройки рендеринга из командной строки, которые нужны до загрузки моделей: упакованный формат вершин
+// (16 байт вместо 32); копии геометрии на стороне CPU после загрузки в буфер по умолчанию не хранятся.
+// Там же - предварительный проход глубины и его вершины (чтобы сравнивать их и в режиме без окна)
+void ApplyRenderOptions(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++)
+    {
+        if (strcmp(argv[i], "--depth-prepass") == 0)
+            useDepthPrepass = true;
+        if (strcmp(argv[i], "--packed-vertices") == 0)
+            GeometryPool::Instance().SetFormat(VertexFormat::Packed);
+        if (strcmp(argv[i], "--keep-cpu-geometry") == 0)
+            Mesh::KeepCpuGeometry() = true;
+        if (strcmp(argv[i], "--full-vertices-depth") == 0)
+            Mesh::UsePositionStream() = false;
+        if (strcmp(argv[i], "--occlusion") == 0)
+            useOcclusion = true;
+    }
+}
+
+// Освобождение объектов сцены, шейдеров и glwf реcурсов
 void Release() {
+    // Отпускаем модели объектов сцены: их буферы и текстуры удаляются вместе с последней ссылкой
+    for (auto& go : gameObjects)
+        go.Release();
+    gameObjects.clear();
+    AssetManager::Instance().PrintStats();
+    TextureStreamer::Instance().Release();
+    ThreadPool::Instance().Release();
+    uniformRing.Release();
+    instanceRenderer.Release();
+    GeometryPool::Instance().Release();
+    GpuProfiler::Instance().Release();
+    renderQueue.Release();
+    overdraw.Release();
+    occlusion.Release();
+
     // Передавая ноль, мы отключаем шейдрную программу
-    glUseProgram(0);
-    // Удаляем шейдерную программу
-    glDeleteProgram(Program);
+    GlState::Instance().UseProgram(0);
+    // Удаляем шейдерные программы
+    Program.Reset();
+    InstProgram.Reset();
+    DepthProgram.Reset();
+    InstDepthProgram.Reset();
+    OcclusionProgram.Reset();
     // Освобождение всех glwf реcурсов
     glfwTerminate();
 }
 
-int main()
+int main(int argc, char** argv)
 {
+    cpuProfiler::SetThreadName("main");
+    // бенчмарки, которым не нужно окно
+    if (argc > 1 && strcmp(argv[1], "--bench-culling") == 0)
+    {
+        BenchCulling();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-bvh") == 0)
+    {
+        BenchBvh();
+        return 0;
+    }
+    // подготовка текстур: сжимаем все .png папки (по умолчанию objects) в .ktx
+    if (argc > 1 && strcmp(argv[1], "--cook-textures") == 0)
+    {
+        int cooked = textureCooker::CookDirectory(argc > 2 ? argv[2] : "objects");
+        printf("cooked %d textures\n", cooked);
+        return 0;
+    }
+
+    // трасса с самого запуска: загрузка сцены и первые кадры
+    for (int i = 1; i < argc; i++)
+        if (strcmp(argv[i], "--trace") == 0)
+        {
+            if (i + 1 < argc && argv[i + 1][0] != '-')
+                traceFile = argv[i + 1];
+            cpuProfiler::StartCapture();
+            traceFramesLeft = startupTraceFrames;
+        }
+
+    // программный рендерер, OpenGL не нужен: --bench-software [кадров] [картинка.ppm]
+    if (argc > 1 && strcmp(argv[1], "--bench-software") == 0)
+    {
+        int frames = argc > 2 ? atoi(argv[2]) : 100;
+        ThreadPool::Instance().Init();
+        BenchSoftware(frames, argc > 3 ? argv[3] : "software.ppm");
+        ThreadPool::Instance().Release();
+        return 0;
+    }
+
+    // бенчмарк без окна и дисплея: --bench-headless [кадров], контекст EGL вместо окна glfw
+    if (argc > 1 && strcmp(argv[1], "--bench-headless") == 0)
+    {
+        int frames = argc > 2 && argv[2][0] != '-' ? atoi(argv[2]) : 1000;
+        if (!headless::CreateContext())
+            return 1;
+        gladLoadGLLoader((GLADloadproc)headless::ProcAddress);
+        ApplyRenderOptions(argc, argv);
+        Init();
+        BenchHeadless(frames);
+        Release();
+        headless::DestroyContext();
+        return 0;
+    }
+
     // инициализация glfw
     glfwInit();
+    // от запуска до первого кадра и до загрузки всех текстур
+    ScopeTimer startupTimer;
+    bool texturesReported = false;
+
+    // кольцевому буферу нужен glBufferStorage (OpenGL 4.4+), поэтому просим core-контекст 4.5
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
+    glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
 
     // создание окна
     GLFWwindow* window = glfwCreateWindow(width, height, "Car on the road", NULL, NULL);
@@ -317,34 +1890,128 @@ int main()
     // загружаем указатели на функции opengl
     gladLoadGLLoader((GLADloadproc)glfwGetProcAddress);
 
+    ApplyRenderOptions(argc, argv);
+
+    // загружаем шейдеры и объекты сцены
+    Init();
+
+    // режим бенчмарка: прогоняем стресс-тест и выходим
+    if (argc > 1 && strcmp(argv[1], "--bench-instancing") == 0)
+    {
+        BenchInstancing(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-import") == 0)
+    {
+        BenchImport(argc > 2 ? argv[2] : "objects");
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-lod") == 0)
+    {
+        BenchLod(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-render-queue") == 0)
+    {
+        BenchRenderQueue(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-depth-prepass") == 0)
+    {
+        BenchDepthPrepass(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-position-stream") == 0)
+    {
+        BenchPositionStream(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-occlusion") == 0)
+    {
+        BenchOcclusion(window);
+        Release();
+        return 0;
+    }
+    if (argc > 1 && strcmp(argv[1], "--bench-vertex-format") == 0)
+    {
+        BenchVertexFormat(window);
+        Release();
+        return 0;
+    }
+
+    // время последнего отчёта о видимых объектах
+    double lastReport = glfwGetTime();
+
+    // номер кадра (первые кадры не проверяем на аллокации: драйвер и glfw ещё прогреваются)
+    unsigned long long frame = 0;
+    const unsigned long long warmupFrames = 10;
+
     // пока текущее окно открыто
     while (!glfwWindowShouldClose(window))
     {
+        // зона кадра закрывается в конце итерации, поэтому запись трассы завершается в начале следующей
+        FinishTraceFrame(false);
+        CpuZone frameZone("frame");
+        allocCounter::BeginFrame();
+        // пока приходят текстуры из фоновой загрузки, кадр не считается установившимся
+        bool streaming = TextureStreamer::Instance().Pending() > 0;
+
         // движения камеры влево-вправо
         processInput(window);
 
-        // рендеринг
-        glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
-
-        // устанавливаем шейдерную программу текущей
-        glUseProgram(Program);
+        // рисуем объекты
+        RenderScene();
 
-        // инициализируем всякие штуки
-        Init();
+        // раз в секунду сообщаем, сколько объектов видно и сколько отсечено, и цену смены состояния OpenGL
+        if (glfwGetTime() - lastReport >= 1.0)
+        {
+            lastReport = glfwGetTime();
+            printf("visible %zu, culled %zu, occluded %zu, triangles %zu\n", visibleObjects, gameObjects.size() - visibleObjects,
+                occludedObjects, trianglesDrawn);
+            const GlState::FrameStats& gl = GlState::Instance().LastFrame();
+            printf("draw calls %zu, state changes %zu (filtered %zu), uploaded %.1f KB\n",
+                gl.drawCalls, gl.issued, gl.filtered, gl.bytesUploaded / 1024.0);
+            if (measureOverdraw)
+                printf("overdraw %.2f fragments per pixel, %.2f per covered pixel (depth prepass %s)\n",
+                    overdraw.Last().perPixel, overdraw.Last().perCoveredPixel, useDepthPrepass ? "on" : "off");
+        }
 
-        glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        // обмен содержимым буферов (отслеживание событий ввода/вывода)
+        {
+            CpuZone zone("swap buffers");
+            glfwSwapBuffers(window);
+            glfwPollEvents();
+        }
 
-        // рисуем объекты
-        for (auto go : gameObjects)
+        if (frame == 0)
+            printf("first frame after %.1f ms\n", startupTimer.ElapsedMs());
+        if (!texturesReported && TextureStreamer::Instance().Pending() == 0)
         {
-            setMat4(Program, "object", go.matr);
-            go.Draw(Program);
+            printf("all textures streamed in after %.1f ms (frame %llu)\n", startupTimer.ElapsedMs(), frame);
+            texturesReported = true;
         }
 
-        // обмен содержимым буферов (отслеживание событий ввода/вывода)
-        glfwSwapBuffers(window);
-        glfwPollEvents();
+        // отчёт о выделениях памяти в кадре
+        allocCounter::FrameStats allocs = allocCounter::EndFrame();
+        if (allocCounter::Enabled() && frame >= warmupFrames && !streaming && allocs.allocations > 0)
+        {
+            printf("frame %llu: %zu allocations (%zu bytes), %zu frees\n", frame, allocs.allocations, allocs.bytes, allocs.frees);
+#ifdef ALLOC_COUNTER_STRICT
+            // не assert: он пропадает при NDEBUG, а выделения важнее всего как раз в release-сборке бенчмарков
+            fprintf(stderr, "ALLOC_COUNTER_STRICT: heap allocation in steady-state frame %llu\n", frame);
+            abort();
+#endif
+        }
+        frame++;
     }
+    // окно закрыли во время записи: выгружаем то, что успели записать
+    FinishTraceFrame(true);
 
     // освобождаем шейдеры и glwf ресурсы
     Release();
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+using namespace std;
+
+// Файл, отображённый в память только для чтения (MapViewOfFile в Windows, mmap в остальных системах).
+// Данные читаются прямо со страниц файлового кэша ОС, без копирования в свои буферы.
+class MappedFile
+{
+public:
+    MappedFile() {}
+    ~MappedFile() { Close(); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    // false, если файл не открылся (или он пустой)
+    bool Open(const string& path);
+    void Close();
+
+    const unsigned char* Data() const { return data; }
+    size_t Size() const { return size; }
+
+private:
+    const unsigned char* data = NULL;
+    size_t size = 0;
+#ifdef _WIN32
+    void* file = NULL;
+    void* mapping = NULL;
+#endif
+};
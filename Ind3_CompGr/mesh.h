@@ -1,99 +1,208 @@
+#pragma once
+
 #include <glad/glad.h>
 #include <glm/glm.hpp>
 #include <glm/gtc/matrix_transform.hpp>
 
+#include "glHandle.h"
+#include "vertex.h"
+#include "bounds.h"
+#include "geometryPool.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
 #include <string>
 #include <vector>
 
 using namespace std;
 
-struct Vertex
+struct Texture 
 {
-    glm::vec3 position; // координаты вершины
-    glm::vec3 normal; // нормаль вершины
-    glm::vec2 textureCoord; // текстурные координаты вершины
+    GlTexture texture; // своя текстура видеокарты (пустая, пока идёт фоновая загрузка)
+    unsigned int textureID; // что привязывать при рисовании: своя текстура или общая заглушка
+    string type;
+    string path; // канонический путь к файлу текстуры
+    uint64_t hash; // хэш содержимого файла
 };
 
-struct Texture 
+// ссылка на текстуру, выданную менеджером ресурсов; текстура удаляется вместе с последней ссылкой
+typedef shared_ptr<Texture> TextureHandle;
+
+// поток только позиций меша (см. meshOptimize::BuildPositionStream): уникальные позиции
+// и номер позиции для каждой вершины; positions == NULL - потока нет
+struct PositionStream
 {
-    unsigned int textureID;
-    string type;
-    string path;
+    const glm::vec3* positions = NULL;
+    size_t count = 0;
+    const int* remap = NULL;
+
+    bool Empty() const { return !positions || !remap || count == 0; }
 };
 
 class Mesh 
 {
 public:
     vector<Vertex> vertices; // вершины меша
-    vector<Texture> textures; // текстуры меша
+    vector<TextureHandle> textures; // текстуры меша
     vector<int> indices; // грани меша
-    GLuint VAO; // VAO вершины меша
+    GeometryPool::Range range; // место меша в общем буфере геометрии
+    vector<GeometryPool::Range> lods; // уровни детализации: lods[0] = range, дальше всё более простые наборы индексов
+    vector<GeometryPool::Range> positionLods; // те же уровни в потоке позиций (пустой, если потока нет)
+    BoundingBox bounds; // ограничивающий параллелепипед в координатах меша
+    BoundingSphere sphere; // ограничивающая сфера в координатах меша
+
+    // Конструктор (box - параллелепипед, внутри которого квантуются позиции, если буфер геометрии упакованный;
+    // positions - поток позиций для проходов глубины)
+    Mesh(vector<Vertex> vert, vector<TextureHandle> text, vector<int> ind, const BoundingBox& box = BoundingBox(),
+        const PositionStream& positions = PositionStream())
+    {
+        this->vertices = move(vert);
+        this->textures = move(text);
+        this->indices = move(ind);
+
+        // копируем вершины и индексы в общий буфер геометрии
+        range = GeometryPool::Instance().Add(vertices.data(), vertices.size(), indices.data(), indices.size(), box);
+        lods.push_back(range);
+        AddPositions(positions, indices.data(), indices.size(), box);
+
+        // рисование идёт только из общего буфера, копия на стороне CPU не нужна
+        if (!KeepCpuGeometry())
+        {
+            vertices = vector<Vertex>();
+            indices = vector<int>();
+        }
+    }
 
-    // Конструктор
-    Mesh(vector<Vertex> vert, vector<Texture> text, vector<int> ind)
+    // меш прямо из готовых массивов (кэш моделей): данные сразу уходят в общий буфер,
+    // копия вершин и индексов на стороне CPU не хранится
+    Mesh(const Vertex* vert, size_t vertexCount, const int* ind, size_t indexCount, vector<TextureHandle> text,
+        const BoundingBox& box = BoundingBox(), const PositionStream& positions = PositionStream())
     {
-        this->vertices = vert;
-        this->textures = text;
-        this->indices = ind;
+        this->textures = move(text);
+        range = GeometryPool::Instance().Add(vert, vertexCount, ind, indexCount, box);
+        lods.push_back(range);
+        AddPositions(positions, ind, indexCount, box);
+    }
+
+    // меш владеет своим местом в буфере и текстурами, поэтому его можно только перемещать
+    Mesh(const Mesh&) = delete;
+    Mesh& operator=(const Mesh&) = delete;
+    Mesh(Mesh&&) = default;
+    Mesh& operator=(Mesh&&) = default;
 
-        // устанавливаем вершинные буферы и указатели атрибутов
-        InitPositionBuffers();
+    // оставлять ли копию вершин и индексов в памяти после загрузки в общий буфер (по умолчанию нет)
+    static bool& KeepCpuGeometry()
+    {
+        static bool keep = false;
+        return keep;
     }
 
-    // рисуем меш
-    void Draw(GLuint program)
+    // рисовать ли проходы глубины из потока позиций (иначе - из полных вершин, для сравнения)
+    static bool& UsePositionStream()
     {
-        // Активируем текстурный блок 0, делать этого не обязательно, по умолчанию
-        // и так активирован GL_TEXTURE0, это нужно для использования нескольких текстур
-        glActiveTexture(GL_TEXTURE0);
-
-        // в uniform кладётся текстурный индекс текстурного блока(для GL_TEXTURE0 - 0, для GL_TEXTURE1 - 1 и тд)
-        glUniform1i(glGetUniformLocation(program, textures[0].type.c_str()), 0);
-        // связываем текстуру
-        glBindTexture(GL_TEXTURE_2D, textures[0].textureID);
-
-        // Привязываем вао
-        glBindVertexArray(VAO);
-        // Передаем данные на видеокарту(рисуем)
-        glDrawElements(GL_TRIANGLES, indices.size(), GL_UNSIGNED_INT, 0);
-        glBindVertexArray(0);
+        static bool use = true;
+        return use;
     }
 
-private:
-    // VBO EBO вершины
-    GLuint VBO, EBO;
+    // сколько байт занимает копия геометрии на стороне CPU
+    size_t CpuBytes() const
+    {
+        return vertices.capacity() * sizeof(Vertex) + indices.capacity() * sizeof(int);
+    }
+
+    // добавляем упрощённый уровень детализации: индексы ссылаются на те же вершины
+    // (positionRemap - номера позиций вершин, те же, что при создании меша; NULL - потока позиций нет)
+    void AddLod(const vector<int>& lodIndices, const int* positionRemap = NULL)
+    {
+        AddLod(lodIndices.data(), lodIndices.size(), positionRemap);
+    }
 
-    // инициализируем все буферные объекты
-    void InitPositionBuffers()
+    void AddLod(const int* lodIndices, size_t count, const int* positionRemap = NULL)
     {
-        // создаем буферные объекты
-        glGenVertexArrays(1, &VAO);
-        glGenBuffers(1, &VBO);
-        glGenBuffers(1, &EBO);
+        GeometryPool::Range lodRange = GeometryPool::Instance().AddIndices(lodIndices, count, range.baseVertex);
+        lodRange.vertexCount = range.vertexCount;
+        lods.push_back(lodRange);
+        if (!positionLods.empty() && positionRemap)
+        {
+            const GeometryPool::Range& base = positionLods[0];
+            GeometryPool::Range positionRange = GeometryPool::Instance().AddPositionIndices(positionRemap, lodIndices, count, base.baseVertex);
+            positionRange.vertexCount = base.vertexCount;
+            positionLods.push_back(positionRange);
+        }
+    }
 
-        // привязываем VAO
-        glBindVertexArray(VAO);
+    // место в общем буфере для уровня детализации lod (если такого нет - самый простой из имеющихся)
+    const GeometryPool::Range& Lod(int lod) const
+    {
+        return lods[std::min((size_t)lod, lods.size() - 1)];
+    }
 
-        glEnableVertexAttribArray(0);
-        glEnableVertexAttribArray(2);
+    // есть ли у меша поток позиций для всех уровней детализации, и рисуются ли из него проходы глубины
+    bool DrawsPositions() const
+    {
+        return UsePositionStream() && !positionLods.empty() && positionLods.size() == lods.size();
+    }
 
-        // загружаем данные в вершинный буфер
-        glBindBuffer(GL_ARRAY_BUFFER, VBO);
-        glBufferData(GL_ARRAY_BUFFER, vertices.size() * sizeof(Vertex), &vertices[0], GL_STATIC_DRAW);
+    // место уровня lod для прохода глубины: в потоке позиций или, если его нет, в обычных вершинах
+    const GeometryPool::Range& DepthLod(int lod) const
+    {
+        if (!DrawsPositions())
+            return Lod(lod);
+        return positionLods[std::min((size_t)lod, positionLods.size() - 1)];
+    }
 
-        glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
-        glBufferData(GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
+    // текстура меша (0, если у материала нет диффузной текстуры)
+    GLuint TextureID() const
+    {
+        return textures.empty() ? 0 : textures[0]->textureID;
+    }
 
-        // Устанавливаем указатели вершинных атрибутов
+    // рисуем меш на уровне детализации lod
+    void Draw(int lod = 0)
+    {
+        // связываем текстуру с блоком 0 (сэмплер шейдера привязан к нему один раз после линковки программы);
+        // привязки идут через тень состояния, поэтому у мешей с той же текстурой и VAO до драйвера ничего не доходит
+        GlState::Instance().BindTexture(0, TextureID());
+
+        // Привязываем общий VAO (после рисования он остаётся привязанным: отвязывать его незачем)
+        GeometryPool::Instance().Bind();
+        // Передаем данные на видеокарту(рисуем): индексы меша локальные, поэтому сдвигаем их на baseVertex
+        const GeometryPool::Range& r = Lod(lod);
+        GeometryPool::Instance().BindIndices(r.indexType);
+        GlState::Instance().DrawElementsBaseVertex(GL_TRIANGLES, r.indexCount, r.indexType, r.IndexOffset(), r.baseVertex);
+    }
 
-        // Атрибут с координатами
-        glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)0);
-        // Атрибут с текстурой
-        glVertexAttribPointer(2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (void*)offsetof(Vertex, textureCoord));
+    // рисуем только глубину меша на уровне детализации lod (текстура не нужна): из потока позиций, если он есть
+    void DrawDepth(int lod = 0)
+    {
+        if (DrawsPositions())
+            GeometryPool::Instance().BindPositions();
+        else
+            GeometryPool::Instance().Bind();
+        const GeometryPool::Range& r = DepthLod(lod);
+        GeometryPool::Instance().BindIndices(r.indexType);
+        GlState::Instance().DrawElementsBaseVertex(GL_TRIANGLES, r.indexCount, r.indexType, r.IndexOffset(), r.baseVertex);
+    }
 
-        //Отвязываем VAO
-        glBindVertexArray(0);
-        glDisableVertexAttribArray(0);
-        glDisableVertexAttribArray(2);
+    // возвращаем место меша в общем буфере геометрии: его займут следующие загруженные меши
+    void Release()
+    {
+        GeometryPool::Instance().Free(lods, false);
+        GeometryPool::Instance().Free(positionLods, true);
+        range = GeometryPool::Range();
+        lods.clear();
+        positionLods.clear();
     }
-};
\ No newline at end of file
+
+private:
+    // поток позиций для уровня 0 (уровни детализации добавляет AddLod)
+    void AddPositions(const PositionStream& positions, const int* ind, size_t indexCount, const BoundingBox& box)
+    {
+        if (positions.Empty())
+            return;
+        positionLods.push_back(GeometryPool::Instance().AddPositions(positions.positions, positions.count, positions.remap,
+            ind, indexCount, box));
+    }
+};
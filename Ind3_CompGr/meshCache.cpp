@@ -0,0 +1,304 @@
+#include "meshCache.h"
+#include "cpuProfiler.h"
+#include "mappedFile.h"
+#include "model.h"
+
+#include <atomic>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+#include <thread>
+#include <vector>
+
+// заголовок файла кэша
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t version;
+    uint32_t importFlags;
+    int64_t sourceTime; // время изменения исходного файла
+    uint64_t sourceSize; // размер исходного файла
+    uint32_t vertexSize; // sizeof(Vertex) на момент записи
+    uint32_t pathLength; // длина пути к исходному файлу (путь идёт сразу за заголовком)
+    uint32_t meshCount;
+    uint32_t reserved;
+};
+
+// заголовок меша; за ним идут размеры уровней детализации, пути к текстурам, вершины, индексы, уровни,
+// позиции и номера позиций вершин (vertexCount штук)
+struct CacheMesh
+{
+    uint32_t vertexCount;
+    uint32_t indexCount;
+    uint32_t lodCount;
+    uint32_t textureCount;
+    uint32_t positionCount;
+    uint32_t reserved;
+    float boundsMin[3];
+    float boundsMax[3];
+    float sphere[4]; // центр и радиус
+};
+
+const char CacheMagic[8] = { 'M', 'E', 'S', 'H', 'C', 'A', 'C', 'H' };
+
+// массивы в файле выровнены, чтобы их можно было читать прямо из отображённой памяти
+const size_t CacheAlignment = 16;
+
+static atomic<bool> cacheEnabled{ true };
+
+// размер и время изменения исходного файла; false, если файла нет
+static bool SourceStamp(const string& sourcePath, int64_t& time, uint64_t& size)
+{
+    error_code ec;
+    auto writeTime = filesystem::last_write_time(sourcePath, ec);
+    if (ec)
+        return false;
+    size = (uint64_t)filesystem::file_size(sourcePath, ec);
+    if (ec)
+        return false;
+    time = (int64_t)writeTime.time_since_epoch().count();
+    return true;
+}
+
+// все номера в массиве меньше limit (отрицательные тоже не проходят): номера из кэша уходят прямо в видеокарту,
+// поэтому устаревший или испорченный файл проверяется одним проходом, а не доверяется
+static bool IndicesBelow(const int* values, size_t count, uint32_t limit)
+{
+    for (size_t i = 0; i < count; i++)
+        if ((uint32_t)values[i] >= limit)
+            return false;
+    return true;
+}
+
+// последовательное чтение из отображённого файла с проверкой границ
+class CacheReader
+{
+public:
+    CacheReader(const unsigned char* data, size_t size) : data(data), size(size) {}
+
+    template <class T> const T* Read(size_t count = 1)
+    {
+        size_t bytes = sizeof(T) * count;
+        if (offset + bytes > size)
+            return NULL;
+        const T* result = (const T*)(data + offset);
+        offset += bytes;
+        return result;
+    }
+
+    void Align() { offset = (offset + CacheAlignment - 1) / CacheAlignment * CacheAlignment; }
+    size_t Remaining() const { return offset < size ? size - offset : 0; }
+
+private:
+    const unsigned char* data;
+    size_t size;
+    size_t offset = 0;
+};
+
+// запись в память с теми же правилами выравнивания
+class CacheWriter
+{
+public:
+    void Write(const void* data, size_t bytes)
+    {
+        const unsigned char* p = (const unsigned char*)data;
+        buffer.insert(buffer.end(), p, p + bytes);
+    }
+
+    void Align() { buffer.resize((buffer.size() + CacheAlignment - 1) / CacheAlignment * CacheAlignment); }
+
+    vector<unsigned char> buffer;
+};
+
+namespace meshCache
+{
+    string CachePath(const string& sourcePath)
+    {
+        return sourcePath + ".meshcache";
+    }
+
+    void SetEnabled(bool enabled) { cacheEnabled = enabled; }
+    bool Enabled() { return cacheEnabled; }
+
+    bool Load(const string& sourcePath, uint32_t importFlags, ModelData& data)
+    {
+        CpuZone zone("meshCache::Load");
+        if (!cacheEnabled)
+            return false;
+
+        int64_t sourceTime;
+        uint64_t sourceSize;
+        if (!SourceStamp(sourcePath, sourceTime, sourceSize))
+            return false;
+
+        shared_ptr<MappedFile> file = make_shared<MappedFile>();
+        if (!file->Open(CachePath(sourcePath)))
+            return false;
+
+        CacheReader reader(file->Data(), file->Size());
+        const CacheHeader* header = reader.Read<CacheHeader>();
+        if (!header || memcmp(header->magic, CacheMagic, sizeof(CacheMagic)) != 0 || header->version != Version
+            || header->importFlags != importFlags || header->sourceTime != sourceTime || header->sourceSize != sourceSize
+            || header->vertexSize != sizeof(Vertex))
+            return false;
+        const char* path = reader.Read<char>(header->pathLength);
+        if (!path || string(path, header->pathLength) != sourcePath)
+            return false;
+        reader.Align();
+
+        // число мешей проверяем до выделения памяти: у испорченного файла оно может быть каким угодно
+        if ((uint64_t)header->meshCount * sizeof(CacheMesh) > reader.Remaining())
+            return false;
+
+        ModelData result;
+        result.path = sourcePath;
+        result.directory = sourcePath.substr(0, sourcePath.find_last_of('/'));
+        result.meshes.resize(header->meshCount);
+        for (auto& mesh : result.meshes)
+        {
+            const CacheMesh* info = reader.Read<CacheMesh>();
+            if (!info)
+                return false;
+            const uint32_t* lodSizes = reader.Read<uint32_t>(info->lodCount);
+            if (!lodSizes)
+                return false;
+            for (uint32_t t = 0; t < info->textureCount; t++)
+            {
+                const uint32_t* length = reader.Read<uint32_t>();
+                const char* texturePath = length ? reader.Read<char>(*length) : NULL;
+                if (!texturePath)
+                    return false;
+                mesh.texturePaths.push_back(string(texturePath, *length));
+            }
+            reader.Align();
+
+            mesh.bounds.min = glm::vec3(info->boundsMin[0], info->boundsMin[1], info->boundsMin[2]);
+            mesh.bounds.max = glm::vec3(info->boundsMax[0], info->boundsMax[1], info->boundsMax[2]);
+            mesh.sphere.center = glm::vec3(info->sphere[0], info->sphere[1], info->sphere[2]);
+            mesh.sphere.radius = info->sphere[3];
+
+            mesh.mappedVertexCount = info->vertexCount;
+            mesh.mappedVertices = reader.Read<Vertex>(info->vertexCount);
+            reader.Align();
+            mesh.mappedIndexCount = info->indexCount;
+            mesh.mappedIndices = reader.Read<int>(info->indexCount);
+            reader.Align();
+            if (!mesh.mappedVertices || !mesh.mappedIndices
+                || !IndicesBelow(mesh.mappedIndices, info->indexCount, info->vertexCount))
+                return false;
+            for (uint32_t l = 0; l < info->lodCount; l++)
+            {
+                const int* lod = reader.Read<int>(lodSizes[l]);
+                reader.Align();
+                if (!lod || !IndicesBelow(lod, lodSizes[l], info->vertexCount))
+                    return false;
+                mesh.mappedLods.push_back(make_pair(lod, (size_t)lodSizes[l]));
+            }
+            mesh.mappedPositionCount = info->positionCount;
+            mesh.mappedPositions = reader.Read<glm::vec3>(info->positionCount);
+            reader.Align();
+            mesh.mappedPositionRemap = reader.Read<int>(info->positionCount ? info->vertexCount : 0);
+            reader.Align();
+            if (info->positionCount && (!mesh.mappedPositions || !mesh.mappedPositionRemap
+                || !IndicesBelow(mesh.mappedPositionRemap, info->vertexCount, info->positionCount)))
+                return false;
+        }
+
+        result.cache = file;
+        data = move(result);
+        return true;
+    }
+
+    bool Save(const string& sourcePath, uint32_t importFlags, const ModelData& data)
+    {
+        CpuZone zone("meshCache::Save");
+        if (!cacheEnabled)
+            return false;
+
+        CacheHeader header = {};
+        memcpy(header.magic, CacheMagic, sizeof(CacheMagic));
+        header.version = Version;
+        header.importFlags = importFlags;
+        if (!SourceStamp(sourcePath, header.sourceTime, header.sourceSize))
+            return false;
+        header.vertexSize = sizeof(Vertex);
+        header.pathLength = (uint32_t)sourcePath.size();
+        header.meshCount = (uint32_t)data.meshes.size();
+
+        CacheWriter writer;
+        writer.Write(&header, sizeof(header));
+        writer.Write(sourcePath.data(), sourcePath.size());
+        writer.Align();
+
+        for (const auto& mesh : data.meshes)
+        {
+            CacheMesh info = {};
+            info.vertexCount = (uint32_t)mesh.VertexCount();
+            info.indexCount = (uint32_t)mesh.IndexCount();
+            info.lodCount = (uint32_t)mesh.LodCount();
+            info.textureCount = (uint32_t)mesh.texturePaths.size();
+            PositionStream positions = mesh.Positions();
+            info.positionCount = (uint32_t)positions.count;
+            for (int i = 0; i < 3; i++)
+            {
+                info.boundsMin[i] = mesh.bounds.min[i];
+                info.boundsMax[i] = mesh.bounds.max[i];
+                info.sphere[i] = mesh.sphere.center[i];
+            }
+            info.sphere[3] = mesh.sphere.radius;
+            writer.Write(&info, sizeof(info));
+
+            for (size_t l = 0; l < mesh.LodCount(); l++)
+            {
+                uint32_t size = (uint32_t)mesh.LodSize(l);
+                writer.Write(&size, sizeof(size));
+            }
+            for (const auto& texturePath : mesh.texturePaths)
+            {
+                uint32_t length = (uint32_t)texturePath.size();
+                writer.Write(&length, sizeof(length));
+                writer.Write(texturePath.data(), length);
+            }
+            writer.Align();
+
+            writer.Write(mesh.VertexData(), mesh.VertexCount() * sizeof(Vertex));
+            writer.Align();
+            writer.Write(mesh.IndexData(), mesh.IndexCount() * sizeof(int));
+            writer.Align();
+            for (size_t l = 0; l < mesh.LodCount(); l++)
+            {
+                writer.Write(mesh.LodData(l), mesh.LodSize(l) * sizeof(int));
+                writer.Align();
+            }
+            if (positions.count)
+            {
+                writer.Write(positions.positions, positions.count * sizeof(glm::vec3));
+                writer.Align();
+                writer.Write(positions.remap, mesh.VertexCount() * sizeof(int));
+                writer.Align();
+            }
+        }
+
+        // временный файл у каждого потока свой; готовый файл подменяет старый одним переименованием
+        ostringstream temp;
+        temp << CachePath(sourcePath) << ".tmp" << this_thread::get_id();
+        error_code ec;
+        {
+            ofstream out(temp.str(), ios::binary);
+            if (!out.write((const char*)writer.buffer.data(), writer.buffer.size()))
+            {
+                out.close();
+                filesystem::remove(temp.str(), ec);
+                return false;
+            }
+        }
+        filesystem::rename(temp.str(), CachePath(sourcePath), ec);
+        if (ec)
+        {
+            filesystem::remove(temp.str(), ec);
+            return false;
+        }
+        return true;
+    }
+}
@@ -0,0 +1,32 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+using namespace std;
+
+struct ModelData;
+
+// Двоичный кэш импортированных моделей.
+// После первого импорта готовые массивы вершин и индексов каждого меша (вместе с уровнями детализации,
+// потоком позиций, границами и путями к текстурам) записываются в файл рядом с исходным (<файл>.meshcache).
+// Файл действителен, пока совпадают версия формата, путь к исходному файлу, его размер и время изменения
+// и флаги импорта Assimp. При следующих запусках файл отображается в память, и массивы
+// уходят в общий буфер геометрии прямо из него, без Assimp и без поэлементного перевода.
+namespace meshCache
+{
+    // версия формата: увеличивается при любом изменении раскладки файла, Vertex или обработки мешей при импорте
+    const uint32_t Version = 4;
+
+    string CachePath(const string& sourcePath);
+
+    // загружаем модель из кэша; false, если кэша нет или он устарел
+    bool Load(const string& sourcePath, uint32_t importFlags, ModelData& data);
+
+    // записываем импортированную модель в кэш (через временный файл, чтобы параллельные загрузки не видели половину)
+    bool Save(const string& sourcePath, uint32_t importFlags, const ModelData& data);
+
+    // выключенный кэш не читается и не пишется (для сравнения в бенчмарке)
+    void SetEnabled(bool enabled);
+    bool Enabled();
+}
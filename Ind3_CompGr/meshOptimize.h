@@ -0,0 +1,458 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Оптимизация мешей при импорте:
+// 1. склейка одинаковых вершин (Assimp без aiProcess_JoinIdenticalVertices выдаёт свою вершину на каждый угол грани);
+// 2. порядок треугольников для кэша вершин после преобразования (алгоритм Форсайта);
+// 3. порядок кластеров треугольников против перерисовки: кластеры, смотрящие наружу, рисуются первыми
+//    (Sander, Nehab, Barczak, "Fast Triangle Reordering for Vertex Locality and Reduced Overdraw");
+// 4. порядок вершин по первому использованию, чтобы выборка вершин шла по памяти подряд.
+// Качество порядка оценивается на модели FIFO-кэша: ACMR - промахов на треугольник (минимум около 0.5),
+// ATVR - промахов на вершину (идеал 1.0).
+namespace meshOptimize
+{
+    // размер FIFO-кэша для оценки (типичный для современных видеокарт порядок величины)
+    const unsigned FifoCacheSize = 16;
+    // размер кэша в модели Форсайта
+    const int ForsythCacheSize = 32;
+
+    // FIFO-кэш вершин на отметках времени: вершина в кэше, пока после неё было меньше size промахов
+    class FifoCache
+    {
+    public:
+        FifoCache(size_t vertexCount, unsigned size = FifoCacheSize) : stamps(vertexCount, 0), size(size), time(size + 1) {}
+
+        // true - промах
+        bool Access(int vertex)
+        {
+            if (time - stamps[vertex] > size)
+            {
+                stamps[vertex] = time++;
+                return true;
+            }
+            return false;
+        }
+
+        // очистка кэша
+        void Reset() { time += size + 1; }
+
+    private:
+        vector<unsigned> stamps;
+        unsigned size;
+        unsigned time;
+    };
+
+    // промахи кэша вершин на наборе индексов
+    struct CacheStats
+    {
+        size_t triangles = 0;
+        size_t vertices = 0; // сколько разных вершин используют индексы
+        size_t misses = 0;
+
+        double Acmr() const { return triangles ? (double)misses / triangles : 0.0; }
+        double Atvr() const { return vertices ? (double)misses / vertices : 0.0; }
+
+        void Add(const CacheStats& other)
+        {
+            triangles += other.triangles;
+            vertices += other.vertices;
+            misses += other.misses;
+        }
+    };
+
+    inline CacheStats AnalyzeVertexCache(const int* indices, size_t indexCount, size_t vertexCount)
+    {
+        CacheStats stats;
+        stats.triangles = indexCount / 3;
+        FifoCache cache(vertexCount);
+        vector<char> used(vertexCount, 0);
+        for (size_t i = 0; i < indexCount; i++)
+        {
+            if (cache.Access(indices[i]))
+                stats.misses++;
+            if (!used[indices[i]])
+            {
+                used[indices[i]] = 1;
+                stats.vertices++;
+            }
+        }
+        return stats;
+    }
+
+    // итог оптимизации одного или нескольких мешей
+    struct Report
+    {
+        size_t sourceVertices = 0; // вершин до склейки
+        size_t vertices = 0; // вершин после склейки
+        CacheStats before; // исходный порядок треугольников (после склейки, иначе каждая вершина - промах)
+        CacheStats after;
+
+        void Add(const Report& other)
+        {
+            sourceVertices += other.sourceVertices;
+            vertices += other.vertices;
+            before.Add(other.before);
+            after.Add(other.after);
+        }
+
+        void Print(const string& name) const
+        {
+            printf("%s: vertices %zu -> %zu, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f\n", name.c_str(),
+                sourceVertices, vertices, before.Acmr(), after.Acmr(), before.Atvr(), after.Atvr());
+        }
+    };
+
+    // склейка вершин с побитово одинаковыми атрибутами; индексы переписываются, массив вершин сжимается
+    inline void WeldVertices(vector<Vertex>& vertices, vector<int>& indices)
+    {
+        struct VertexHash
+        {
+            const vector<Vertex>* vertices;
+            size_t operator()(int v) const
+            {
+                // FNV-1a по байтам вершины
+                const unsigned char* p = (const unsigned char*)&(*vertices)[v];
+                uint64_t h = 1469598103934665603ull;
+                for (size_t i = 0; i < sizeof(Vertex); i++)
+                    h = (h ^ p[i]) * 1099511628211ull;
+                return (size_t)h;
+            }
+        };
+        struct VertexEqual
+        {
+            const vector<Vertex>* vertices;
+            bool operator()(int a, int b) const { return memcmp(&(*vertices)[a], &(*vertices)[b], sizeof(Vertex)) == 0; }
+        };
+
+        unordered_map<int, int, VertexHash, VertexEqual> unique(vertices.size() * 2,
+            VertexHash{ &vertices }, VertexEqual{ &vertices });
+        vector<int> remap(vertices.size());
+        int count = 0;
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            auto inserted = unique.insert(make_pair((int)v, count));
+            if (inserted.second)
+                remap[v] = count++;
+            else
+                remap[v] = inserted.first->second;
+        }
+        // вершина всегда переносится на место не дальше своего, поэтому сжимать можно на месте
+        for (size_t v = 0; v < vertices.size(); v++)
+            vertices[remap[v]] = vertices[v];
+        vertices.resize(count);
+        for (auto& index : indices)
+            index = remap[index];
+    }
+
+    // вес вершины в алгоритме Форсайта: недавно использованные и почти исчерпанные вершины выгоднее
+    inline float ForsythVertexScore(int cachePosition, int remaining)
+    {
+        if (remaining == 0)
+            return -1.0f;
+        float score = 0.0f;
+        if (cachePosition >= 0)
+        {
+            // вершины последнего треугольника получают фиксированный вес, чтобы не рисовать полосы
+            if (cachePosition < 3)
+                score = 0.75f;
+            else
+                score = powf(1.0f - (cachePosition - 3) * (1.0f / (ForsythCacheSize - 3)), 1.5f);
+        }
+        // бонус вершинам, у которых осталось мало треугольников, чтобы не оставлять одиночные треугольники
+        score += 2.0f * powf((float)remaining, -0.5f);
+        return score;
+    }
+
+    // порядок треугольников для кэша вершин (Tom Forsyth, "Linear-Speed Vertex Cache Optimisation")
+    inline void OptimizeVertexCache(vector<int>& indices, size_t vertexCount)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        // треугольники каждой вершины (списки подряд в одном массиве)
+        vector<int> remaining(vertexCount, 0);
+        for (int index : indices)
+            remaining[index]++;
+        vector<size_t> offsets(vertexCount + 1, 0);
+        for (size_t v = 0; v < vertexCount; v++)
+            offsets[v + 1] = offsets[v] + remaining[v];
+        vector<int> adjacency(indices.size());
+        {
+            vector<size_t> cursor(offsets.begin(), offsets.end() - 1);
+            for (size_t i = 0; i < indices.size(); i++)
+                adjacency[cursor[indices[i]]++] = (int)(i / 3);
+        }
+
+        vector<int> cachePosition(vertexCount, -1);
+        vector<float> vertexScore(vertexCount);
+        for (size_t v = 0; v < vertexCount; v++)
+            vertexScore[v] = ForsythVertexScore(-1, remaining[v]);
+
+        vector<float> triangleScore(triangleCount);
+        vector<char> emitted(triangleCount, 0);
+        int best = 0;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+            if (triangleScore[t] > triangleScore[best])
+                best = (int)t;
+        }
+
+        vector<int> result;
+        result.reserve(indices.size());
+        int cache[ForsythCacheSize + 3];
+        int cacheCount = 0;
+        size_t cursor = 0;
+
+        while (best >= 0)
+        {
+            emitted[best] = 1;
+            const int* tri = &indices[best * 3];
+            result.insert(result.end(), tri, tri + 3);
+
+            // убираем треугольник из списков его вершин
+            for (int k = 0; k < 3; k++)
+            {
+                int v = tri[k];
+                int* list = &adjacency[offsets[v]];
+                for (int i = 0; i < remaining[v]; i++)
+                    if (list[i] == best)
+                    {
+                        swap(list[i], list[remaining[v] - 1]);
+                        break;
+                    }
+                remaining[v]--;
+            }
+
+            // вершины треугольника встают в начало кэша, остальные сдвигаются
+            int newCache[ForsythCacheSize + 3];
+            int newCount = 0;
+            for (int k = 0; k < 3; k++)
+                if (find(newCache, newCache + newCount, tri[k]) == newCache + newCount)
+                    newCache[newCount++] = tri[k];
+            for (int i = 0; i < cacheCount; i++)
+                if (find(newCache, newCache + newCount, cache[i]) == newCache + newCount)
+                    newCache[newCount++] = cache[i];
+
+            for (int i = 0; i < newCount; i++)
+            {
+                int v = newCache[i];
+                cachePosition[v] = i < ForsythCacheSize ? i : -1;
+                vertexScore[v] = ForsythVertexScore(cachePosition[v], remaining[v]);
+            }
+            cacheCount = std::min(newCount, ForsythCacheSize);
+            copy(newCache, newCache + cacheCount, cache);
+
+            // следующий треугольник ищем среди треугольников вершин в кэше
+            best = -1;
+            float bestScore = -1.0f;
+            for (int i = 0; i < newCount; i++)
+            {
+                int v = newCache[i];
+                const int* list = &adjacency[offsets[v]];
+                for (int j = 0; j < remaining[v]; j++)
+                {
+                    int t = list[j];
+                    triangleScore[t] = vertexScore[indices[t * 3]] + vertexScore[indices[t * 3 + 1]] + vertexScore[indices[t * 3 + 2]];
+                    if (triangleScore[t] > bestScore)
+                    {
+                        bestScore = triangleScore[t];
+                        best = t;
+                    }
+                }
+            }
+            // в кэше ничего не осталось - берём первый ещё не выданный треугольник
+            if (best < 0)
+            {
+                while (cursor < triangleCount && emitted[cursor])
+                    cursor++;
+                best = cursor < triangleCount ? (int)cursor : -1;
+            }
+        }
+
+        indices = move(result);
+    }
+
+    // порядок против перерисовки: список, уже упорядоченный для кэша, режется на кластеры
+    // (жёсткие границы - где кэш начинается заново, мягкие - где ACMR куска не хуже ACMR кластера * threshold),
+    // и кластеры сортируются так, чтобы первыми рисовались те, что смотрят от центра меша наружу
+    inline void OptimizeOverdraw(vector<int>& indices, const vector<Vertex>& vertices, float threshold = 1.05f)
+    {
+        size_t triangleCount = indices.size() / 3;
+        if (triangleCount < 2)
+            return;
+
+        // жёсткие границы: треугольник, у которого промахнулись все три вершины
+        vector<size_t> hard;
+        {
+            FifoCache cache(vertices.size());
+            for (size_t t = 0; t < triangleCount; t++)
+            {
+                int misses = cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+                if (t == 0 || misses == 3)
+                    hard.push_back(t);
+            }
+            hard.push_back(triangleCount);
+        }
+
+        // мягкие границы внутри жёстких кластеров
+        vector<size_t> clusters;
+        FifoCache cache(vertices.size());
+        for (size_t h = 0; h + 1 < hard.size(); h++)
+        {
+            size_t begin = hard[h], end = hard[h + 1];
+            cache.Reset();
+            size_t clusterMisses = 0;
+            for (size_t i = begin * 3; i < end * 3; i++)
+                clusterMisses += cache.Access(indices[i]);
+            double clusterAcmr = (double)clusterMisses / (end - begin);
+
+            cache.Reset();
+            clusters.push_back(begin);
+            size_t start = begin, misses = 0;
+            for (size_t t = begin; t < end; t++)
+            {
+                misses += cache.Access(indices[t * 3]) + cache.Access(indices[t * 3 + 1]) + cache.Access(indices[t * 3 + 2]);
+                if (t + 1 < end && (double)misses / (t + 1 - start) <= clusterAcmr * threshold)
+                {
+                    clusters.push_back(t + 1);
+                    start = t + 1;
+                    misses = 0;
+                    cache.Reset();
+                }
+            }
+        }
+        clusters.push_back(triangleCount);
+
+        // центр меша (по площади)
+        glm::vec3 meshCenter(0.0f);
+        float meshArea = 0.0f;
+        for (size_t t = 0; t < triangleCount; t++)
+        {
+            const glm::vec3& a = vertices[indices[t * 3]].position;
+            const glm::vec3& b = vertices[indices[t * 3 + 1]].position;
+            const glm::vec3& c = vertices[indices[t * 3 + 2]].position;
+            float area = glm::length(glm::cross(b - a, c - a));
+            meshCenter += (a + b + c) * (area / 3.0f);
+            meshArea += area;
+        }
+        if (meshArea > 0.0f)
+            meshCenter /= meshArea;
+
+        // ключ кластера: насколько он смотрит наружу от центра
+        size_t clusterCount = clusters.size() - 1;
+        vector<float> keys(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+        {
+            glm::vec3 center(0.0f), normal(0.0f);
+            float area = 0.0f;
+            for (size_t t = clusters[c]; t < clusters[c + 1]; t++)
+            {
+                const glm::vec3& p0 = vertices[indices[t * 3]].position;
+                const glm::vec3& p1 = vertices[indices[t * 3 + 1]].position;
+                const glm::vec3& p2 = vertices[indices[t * 3 + 2]].position;
+                glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+                float a = glm::length(n);
+                center += (p0 + p1 + p2) * (a / 3.0f);
+                normal += n;
+                area += a;
+            }
+            if (area > 0.0f)
+                center /= area;
+            float length = glm::length(normal);
+            keys[c] = length > 0.0f ? glm::dot(center - meshCenter, normal / length) : 0.0f;
+        }
+
+        vector<size_t> order(clusterCount);
+        for (size_t c = 0; c < clusterCount; c++)
+            order[c] = c;
+        stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) { return keys[a] > keys[b]; });
+
+        vector<int> result;
+        result.reserve(indices.size());
+        for (size_t c : order)
+            result.insert(result.end(), indices.begin() + clusters[c] * 3, indices.begin() + clusters[c + 1] * 3);
+        indices = move(result);
+    }
+
+    // вершины в порядке первого использования индексами (неиспользуемые выбрасываются)
+    inline void OptimizeVertexFetch(vector<Vertex>& vertices, vector<int>& indices)
+    {
+        vector<int> remap(vertices.size(), -1);
+        vector<Vertex> result;
+        result.reserve(vertices.size());
+        for (auto& index : indices)
+        {
+            if (remap[index] < 0)
+            {
+                remap[index] = (int)result.size();
+                result.push_back(vertices[index]);
+            }
+            index = remap[index];
+        }
+        vertices = move(result);
+    }
+
+    // поток только позиций для проходов без закраски (глубина, тени): вершины, которые отличаются только
+    // нормалью или текстурными координатами (швы), получают одну позицию. positions - уникальные позиции
+    // в порядке первого использования вершинами, remap - номер позиции для каждой вершины
+    // (индексы потока позиций - это remap[индекс вершины])
+    inline void BuildPositionStream(const vector<Vertex>& vertices, vector<glm::vec3>& positions, vector<int>& remap)
+    {
+        struct PositionHash
+        {
+            size_t operator()(const glm::vec3& p) const
+            {
+                uint32_t bits[3];
+                memcpy(bits, &p, sizeof(bits));
+                return (size_t)(bits[0] * 73856093u ^ bits[1] * 19349663u ^ bits[2] * 83492791u);
+            }
+        };
+        struct PositionEqual
+        {
+            bool operator()(const glm::vec3& a, const glm::vec3& b) const { return memcmp(&a, &b, sizeof(glm::vec3)) == 0; }
+        };
+
+        unordered_map<glm::vec3, int, PositionHash, PositionEqual> unique(vertices.size() * 2);
+        positions.clear();
+        remap.resize(vertices.size());
+        for (size_t v = 0; v < vertices.size(); v++)
+        {
+            auto inserted = unique.insert(make_pair(vertices[v].position, (int)positions.size()));
+            if (inserted.second)
+                positions.push_back(vertices[v].position);
+            remap[v] = inserted.first->second;
+        }
+    }
+
+    // все шаги подряд; статистика кэша до и после пишется в report
+    inline void Optimize(vector<Vertex>& vertices, vector<int>& indices, Report& report)
+    {
+        report.sourceVertices = vertices.size();
+        WeldVertices(vertices, indices);
+        report.vertices = vertices.size();
+        report.before = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+
+        OptimizeVertexCache(indices, vertices.size());
+        OptimizeOverdraw(indices, vertices);
+        OptimizeVertexFetch(vertices, indices);
+
+        report.vertices = vertices.size();
+        report.after = AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+    }
+}
@@ -0,0 +1,270 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <vector>
+
+using namespace std;
+
+// Упрощение меша стягиванием рёбер по квадрикам ошибки (Garland-Heckbert).
+// Стягивание "половинное": вершина u переносится в уже существующую вершину v,
+// поэтому упрощённые индексы ссылаются на тот же массив вершин, и все уровни детализации
+// могут использовать один вершинный буфер.
+// Швы развёртки и жёсткие рёбра сохраняются: вершины склеиваются для связности только при совпадении позиции,
+// нормали и текстурных координат, а вершины на открытых рёбрах (граница меша, шов UV или жёсткое ребро, где
+// у вершин с одной позицией разные нормали) никогда не удаляются - иначе при смене уровня нормали усреднятся.
+namespace meshSimplify
+{
+    // симметричная матрица 4x4 квадрики хранится 10 коэффициентами
+    struct Quadric
+    {
+        double a[10] = {};
+
+        static Quadric FromPlane(double x, double y, double z, double w, double weight)
+        {
+            Quadric q;
+            q.a[0] = x * x * weight; q.a[1] = x * y * weight; q.a[2] = x * z * weight; q.a[3] = x * w * weight;
+            q.a[4] = y * y * weight; q.a[5] = y * z * weight; q.a[6] = y * w * weight;
+            q.a[7] = z * z * weight; q.a[8] = z * w * weight;
+            q.a[9] = w * w * weight;
+            return q;
+        }
+
+        void Add(const Quadric& o)
+        {
+            for (int i = 0; i < 10; i++)
+                a[i] += o.a[i];
+        }
+
+        // ошибка (квадрат расстояния до плоскостей) в точке p
+        double Error(const glm::vec3& p) const
+        {
+            double x = p.x, y = p.y, z = p.z;
+            return a[0] * x * x + 2 * a[1] * x * y + 2 * a[2] * x * z + 2 * a[3] * x
+                + a[4] * y * y + 2 * a[5] * y * z + 2 * a[6] * y
+                + a[7] * z * z + 2 * a[8] * z
+                + a[9];
+        }
+    };
+
+    // для каждой вершины - её представитель среди вершин с той же позицией, нормалью и UV
+    inline vector<int> WeldForConnectivity(const vector<Vertex>& vertices)
+    {
+        struct Key
+        {
+            float p[8];
+            bool operator==(const Key& o) const { return memcmp(p, o.p, sizeof(p)) == 0; }
+        };
+        struct KeyHash
+        {
+            size_t operator()(const Key& k) const
+            {
+                uint32_t h = 2166136261u;
+                const unsigned char* bytes = (const unsigned char*)k.p;
+                for (size_t i = 0; i < sizeof(k.p); i++)
+                    h = (h ^ bytes[i]) * 16777619u;
+                return h;
+            }
+        };
+
+        unordered_map<Key, int, KeyHash> seen;
+        seen.reserve(vertices.size());
+        vector<int> remap(vertices.size());
+        for (size_t i = 0; i < vertices.size(); i++)
+        {
+            const Vertex& v = vertices[i];
+            Key key = { { v.position.x, v.position.y, v.position.z, v.normal.x, v.normal.y, v.normal.z,
+                v.textureCoord.x, v.textureCoord.y } };
+            auto it = seen.find(key);
+            if (it == seen.end())
+            {
+                seen.emplace(key, (int)i);
+                remap[i] = (int)i;
+            }
+            else
+                remap[i] = it->second;
+        }
+        return remap;
+    }
+
+    // перевернётся ли какой-нибудь треугольник вокруг from, если перенести from в to
+    inline bool Flips(const vector<Vertex>& vertices, const vector<int>& indices,
+        const vector<int>& triangleStart, const vector<int>& triangleList, int from, int to)
+    {
+        const glm::vec3 target = vertices[to].position;
+        for (int i = triangleStart[from]; i < triangleStart[from + 1]; i++)
+        {
+            int t = triangleList[i] * 3;
+            int a = indices[t], b = indices[t + 1], c = indices[t + 2];
+            if (a == to || b == to || c == to)
+                continue; // этот треугольник исчезнет
+
+            glm::vec3 p[3] = { vertices[a].position, vertices[b].position, vertices[c].position };
+            glm::vec3 before = glm::cross(p[1] - p[0], p[2] - p[0]);
+            for (int k = 0; k < 3; k++)
+                if (indices[t + k] == from)
+                    p[k] = target;
+            glm::vec3 after = glm::cross(p[1] - p[0], p[2] - p[0]);
+            if (glm::dot(before, after) <= 0.0f)
+                return true;
+        }
+        return false;
+    }
+
+    // упрощаем меш до targetIndexCount индексов (или меньше, если ошибка не превышает maxError);
+    // результат - новые индексы в тот же массив вершин
+    inline vector<int> Simplify(const vector<Vertex>& vertices, const vector<int>& sourceIndices, size_t targetIndexCount, float maxError, float* resultError = NULL)
+    {
+        const size_t vertexCount = vertices.size();
+
+        // индексы в пространстве склеенных вершин
+        vector<int> weld = WeldForConnectivity(vertices);
+        vector<int> indices(sourceIndices.size());
+        for (size_t i = 0; i < indices.size(); i++)
+            indices[i] = weld[sourceIndices[i]];
+
+        // открытые рёбра: ребро, принадлежащее одному треугольнику, - граница или шов развёртки
+        vector<uint8_t> locked(vertexCount, 0);
+        {
+            unordered_map<uint64_t, int> edgeCount;
+            edgeCount.reserve(indices.size());
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+                for (int e = 0; e < 3; e++)
+                {
+                    uint32_t a = indices[t + e], b = indices[t + (e + 1) % 3];
+                    uint64_t key = a < b ? ((uint64_t)a << 32 | b) : ((uint64_t)b << 32 | a);
+                    edgeCount[key]++;
+                }
+            for (auto& edge : edgeCount)
+                if (edge.second != 2)
+                {
+                    locked[edge.first >> 32] = 1;
+                    locked[edge.first & 0xffffffffu] = 1;
+                }
+        }
+
+        // квадрики вершин: сумма плоскостей соседних треугольников
+        // (без веса по площади, чтобы ошибка измерялась в единицах длины модели)
+        vector<Quadric> quadrics(vertexCount);
+        for (size_t t = 0; t + 2 < indices.size(); t += 3)
+        {
+            glm::vec3 p0 = vertices[indices[t]].position, p1 = vertices[indices[t + 1]].position, p2 = vertices[indices[t + 2]].position;
+            glm::vec3 n = glm::cross(p1 - p0, p2 - p0);
+            float area = glm::length(n);
+            if (area <= 0.0f)
+                continue;
+            n = n / area;
+            Quadric q = Quadric::FromPlane(n.x, n.y, n.z, -glm::dot(n, p0), 1.0);
+            for (int k = 0; k < 3; k++)
+                quadrics[indices[t + k]].Add(q);
+        }
+
+        struct Collapse
+        {
+            int from, to;
+            double error;
+        };
+
+        vector<int> remap(vertexCount);
+        vector<uint8_t> touched(vertexCount);
+        vector<Collapse> collapses;
+        vector<int> triangleStart(vertexCount + 1), triangleList;
+        double achievedError = 0.0;
+        const double errorLimit = (double)maxError * maxError;
+
+        while (indices.size() > targetIndexCount)
+        {
+            // треугольники, примыкающие к каждой вершине (для проверки переворота)
+            fill(triangleStart.begin(), triangleStart.end(), 0);
+            for (int v : indices)
+                triangleStart[v + 1]++;
+            for (size_t v = 0; v < vertexCount; v++)
+                triangleStart[v + 1] += triangleStart[v];
+            triangleList.resize(indices.size());
+            {
+                vector<int> fillPos(triangleStart.begin(), triangleStart.end() - 1);
+                for (size_t i = 0; i < indices.size(); i++)
+                    triangleList[fillPos[indices[i]]++] = (int)(i / 3);
+            }
+
+            // кандидаты: каждое ребро в обе стороны, если удаляемая вершина не заблокирована
+            collapses.clear();
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+                for (int e = 0; e < 3; e++)
+                {
+                    int a = indices[t + e], b = indices[t + (e + 1) % 3];
+                    for (int dir = 0; dir < 2; dir++)
+                    {
+                        int from = dir ? b : a, to = dir ? a : b;
+                        if (locked[from])
+                            continue;
+                        Quadric q = quadrics[from];
+                        q.Add(quadrics[to]);
+                        collapses.push_back(Collapse{ from, to, q.Error(vertices[to].position) });
+                    }
+                }
+            if (collapses.empty())
+                break;
+
+            sort(collapses.begin(), collapses.end(), [](const Collapse& x, const Collapse& y) { return x.error < y.error; });
+
+            // за проход стягиваем рёбра с наименьшей ошибкой, не трогая вершины, уже изменённые в этом проходе
+            for (size_t v = 0; v < vertexCount; v++)
+                remap[v] = (int)v;
+            fill(touched.begin(), touched.end(), 0);
+
+            size_t removeTriangles = (indices.size() - targetIndexCount) / 3;
+            size_t removed = 0;
+            size_t applied = 0;
+            for (const Collapse& c : collapses)
+            {
+                if (removed >= removeTriangles || c.error > errorLimit)
+                    break;
+                if (touched[c.from] || touched[c.to])
+                    continue;
+                if (Flips(vertices, indices, triangleStart, triangleList, c.from, c.to))
+                    continue;
+
+                remap[c.from] = c.to;
+                touched[c.from] = touched[c.to] = 1;
+                for (int i = triangleStart[c.from]; i < triangleStart[c.from + 1]; i++)
+                {
+                    int t = triangleList[i] * 3;
+                    touched[indices[t]] = touched[indices[t + 1]] = touched[indices[t + 2]] = 1;
+                    if (indices[t] == c.to || indices[t + 1] == c.to || indices[t + 2] == c.to)
+                        removed++;
+                }
+                quadrics[c.to].Add(quadrics[c.from]);
+                achievedError = max(achievedError, c.error);
+                applied++;
+            }
+            if (applied == 0)
+                break;
+
+            // переписываем индексы и выбрасываем вырожденные треугольники
+            size_t write = 0;
+            for (size_t t = 0; t + 2 < indices.size(); t += 3)
+            {
+                int a = remap[indices[t]], b = remap[indices[t + 1]], c = remap[indices[t + 2]];
+                if (a == b || b == c || a == c)
+                    continue;
+                indices[write++] = a;
+                indices[write++] = b;
+                indices[write++] = c;
+            }
+            indices.resize(write);
+        }
+
+        if (resultError)
+            *resultError = (float)sqrt(achievedError);
+        return indices;
+    }
+}
@@ -0,0 +1,357 @@
+#pragma once
+
+#include <glad/glad.h> 
+
+#include <glm/glm.hpp>
+#include <glm/gtc/matrix_transform.hpp>
+#include <assimp/Importer.hpp>
+#include <assimp/scene.h>
+#include <assimp/postprocess.h>
+
+#include "mesh.h"
+#include "meshSimplify.h"
+#include "meshOptimize.h"
+#include "assetManager.h"
+#include "threadPool.h"
+#include "meshCache.h"
+#include "mappedFile.h"
+#include "cpuProfiler.h"
+
+#include <algorithm>
+#include <memory>
+#include <string>
+#include <iostream>
+#include <utility>
+#include <vector>
+using namespace std;
+
+// Меш после импорта, ещё без объектов OpenGL: его можно готовить в любом потоке
+struct MeshData
+{
+    vector<Vertex> vertices;
+    vector<int> indices;
+    vector<vector<int>> lods; // упрощённые наборы индексов (уровни 1, 2, ...)
+    vector<glm::vec3> positions; // поток только позиций: уникальные позиции вершин
+    vector<int> positionRemap; // номер позиции в positions для каждой вершины
+    vector<string> texturePaths; // диффузные текстуры материала
+    BoundingBox bounds;
+    BoundingSphere sphere;
+    meshOptimize::Report optimizeReport; // итог оптимизации порядка (только после импорта, у меша из кэша пустой)
+
+    // меш из кэша: массивы не копируются, а указывают в отображённый в память файл (vertices, indices и lods пустые)
+    const Vertex* mappedVertices = NULL;
+    size_t mappedVertexCount = 0;
+    const int* mappedIndices = NULL;
+    size_t mappedIndexCount = 0;
+    vector<pair<const int*, size_t>> mappedLods;
+    const glm::vec3* mappedPositions = NULL;
+    size_t mappedPositionCount = 0;
+    const int* mappedPositionRemap = NULL; // mappedVertexCount номеров
+
+    // доступ к массивам независимо от того, откуда они взялись
+    bool Mapped() const { return mappedVertices != NULL; }
+    const Vertex* VertexData() const { return Mapped() ? mappedVertices : vertices.data(); }
+    size_t VertexCount() const { return Mapped() ? mappedVertexCount : vertices.size(); }
+    const int* IndexData() const { return Mapped() ? mappedIndices : indices.data(); }
+    size_t IndexCount() const { return Mapped() ? mappedIndexCount : indices.size(); }
+    size_t LodCount() const { return Mapped() ? mappedLods.size() : lods.size(); }
+    const int* LodData(size_t lod) const { return Mapped() ? mappedLods[lod].first : lods[lod].data(); }
+    size_t LodSize(size_t lod) const { return Mapped() ? mappedLods[lod].second : lods[lod].size(); }
+    // поток позиций: пустой, если его нет
+    PositionStream Positions() const
+    {
+        if (Mapped())
+            return PositionStream{ mappedPositions, mappedPositionCount, mappedPositionRemap };
+        return PositionStream{ positions.data(), positions.size(), positionRemap.empty() ? NULL : positionRemap.data() };
+    }
+};
+
+// Модель после импорта: всё, что нужно, чтобы создать Model в потоке OpenGL
+struct ModelData
+{
+    string path;
+    string directory;
+    vector<MeshData> meshes;
+    shared_ptr<MappedFile> cache; // отображённый файл кэша, на который указывают меши (если модель из кэша)
+};
+
+// Модель, загруженная из файла: набор мешей с текстурами.
+// Одна модель может использоваться многими объектами сцены, поэтому её экземпляры
+// создаёт и раздаёт AssetManager, а копировать её нельзя (она владеет буферами видеокарты).
+// Загрузка делится на две части: Import (Assimp, перевод мешей, уровни детализации) не трогает OpenGL
+// и может выполняться в любом потоке, а конструктор из ModelData создаёт буферы и текстуры в потоке OpenGL.
+class Model
+{
+public:
+    vector<Mesh> meshes; // вектор мешей  [ (англ. «mesh») — это минимальная единица отрисовки объекта ]
+    string directory; // папка с объектом
+    string path; // путь, по которому модель лежит в кэше менеджера ресурсов
+    BoundingBox bounds; // ограничивающий параллелепипед всех мешей модели
+    int lodCount = 1; // количество уровней детализации (у самого детального меша модели)
+    // перевод позиций из буфера геометрии в координаты модели: в упакованном формате вершины хранят
+    // позицию в [0, 1] внутри bounds, и сдвиг с масштабом добавляются к матрице объекта
+    glm::mat4 positionTransform = glm::mat4(1.0f);
+
+    Model(string const &path) : Model(Import(path))
+    {
+    }
+
+    // создаём объекты OpenGL из импортированных данных (только в потоке OpenGL)
+    explicit Model(ModelData&& data)
+    {
+        CpuZone zone("create model");
+        path = data.path;
+        directory = data.directory;
+
+        // параллелепипед модели объединяет параллелепипеды всех мешей;
+        // все меши квантуются внутри него, чтобы у модели было одно преобразование позиций
+        for (size_t i = 0; i < data.meshes.size(); i++)
+        {
+            if (i == 0)
+                bounds = data.meshes[i].bounds;
+            else
+                bounds.Merge(data.meshes[i].bounds);
+        }
+        if (GeometryPool::Instance().Format() == VertexFormat::Packed)
+            positionTransform = glm::scale(glm::translate(glm::mat4(1.0f), bounds.min), bounds.max - bounds.min);
+
+        meshes.reserve(data.meshes.size());
+        for (auto& meshData : data.meshes)
+        {
+            vector<TextureHandle> textures;
+            for (const auto& texturePath : meshData.texturePaths)
+                textures.push_back(AssetManager::Instance().LoadTexture(texturePath, "texture"));
+
+            if (meshData.Mapped())
+                meshes.push_back(Mesh(meshData.mappedVertices, meshData.mappedVertexCount,
+                    meshData.mappedIndices, meshData.mappedIndexCount, move(textures), bounds, meshData.Positions()));
+            else
+                meshes.push_back(Mesh(move(meshData.vertices), move(textures), move(meshData.indices), bounds, meshData.Positions()));
+
+            Mesh& mesh = meshes.back();
+            mesh.bounds = meshData.bounds;
+            mesh.sphere = meshData.sphere;
+            for (size_t lod = 0; lod < meshData.LodCount(); lod++)
+                mesh.AddLod(meshData.LodData(lod), meshData.LodSize(lod), meshData.Positions().remap);
+        }
+
+        for (const auto& mesh : meshes)
+            lodCount = std::max(lodCount, (int)mesh.lods.size());
+    }
+
+    // дай бог здоровья автору статьи https://ravesli.com/urok-18-zagruzka-modelej-v-opengl/ за загрузку объектов с помощью мешей
+
+    // параметр aiProcess_Triangulate - если модель не состоит полностью из треугольников, то необходимо сначала преобразовать все примитивные формы модели в треугольники
+    // параметр aiProcess_FlipUVs - переворачивает во время обработки координаты текстуры на оси y, где это необходимо
+    static const unsigned int ImportFlags = aiProcess_Triangulate | aiProcess_FlipUVs;
+
+    // загружаем модель с помощью Assimp (без OpenGL, можно вызывать из любого потока).
+    // У каждого вызова свой Assimp::Importer, а меши переводятся параллельно в общем пуле потоков.
+    // Если есть свежий двоичный кэш, Assimp не нужен: массивы берутся прямо из отображённого в память файла
+    static ModelData Import(string const &path)
+    {
+        CpuZone zone("Model::Import");
+        ModelData data;
+        data.path = path;
+        if (meshCache::Load(path, ImportFlags, data))
+            return data;
+
+        // чтение файла с помощью Assimp
+        Assimp::Importer importer;
+        const aiScene* scene = importer.ReadFile(path, ImportFlags);
+		
+        // проверяем, что переменные сцены и корневого узла сцены не являются нулевыми, 
+        // а также с помощью проверки одного из флагов сцены убеждаемся, что возвращаемые данные являются полными
+        if(!scene || scene->mFlags & AI_SCENE_FLAGS_INCOMPLETE || !scene->mRootNode) 
+        {
+            cout << "ERROR::ASSIMP:: " << importer.GetErrorString() << endl;
+            return data;
+        }
+		
+        // путь к файлу с объектом
+        data.directory = path.substr(0, path.find_last_of('/'));
+
+        // начинаем обрабатывать все узлы сцены
+        // передаем первый узел (корневой) рекурсивной функции processNode()
+        // т.к. каждый узел (возможно) содержит набор дочерних элементов, то необходимо сначала обработать выбранный узел, 
+        // а затем продолжить обработку всех его дочерних элементов итд
+        vector<const aiMesh*> sceneMeshes;
+        processNode(scene->mRootNode, scene, sceneMeshes);
+
+        // меши независимы: каждый переводится в своём потоке в заранее выделенный элемент
+        data.meshes.resize(sceneMeshes.size());
+        ThreadPool::Instance().ParallelFor(sceneMeshes.size(), [&](size_t i)
+        {
+            processMesh(sceneMeshes[i], scene, data.directory, data.meshes[i]);
+        });
+
+        // промахи кэша вершин до и после оптимизации по всей модели
+        meshOptimize::Report report;
+        for (const auto& mesh : data.meshes)
+            report.Add(mesh.optimizeReport);
+        report.Print(path);
+
+        meshCache::Save(path, ImportFlags, data);
+        return data;
+    }
+
+    Model(const Model&) = delete;
+    Model& operator=(const Model&) = delete;
+
+    // буферы мешей удаляются, когда модель больше никем не используется
+    ~Model()
+    {
+        for (auto& mesh : meshes)
+            mesh.Release();
+    }
+
+    // рисуем все меши модели на уровне детализации lod
+    void Draw(int lod = 0)
+    {
+        for (auto& mesh : meshes)
+            mesh.Draw(lod);
+    }
+
+    // только глубина всех мешей (потоком позиций, если он есть)
+    void DrawDepth(int lod = 0)
+    {
+        for (auto& mesh : meshes)
+            mesh.DrawDepth(lod);
+    }
+
+    // количество треугольников модели на уровне детализации lod
+    size_t TriangleCount(int lod) const
+    {
+        size_t triangles = 0;
+        for (auto& mesh : meshes)
+            triangles += mesh.Lod(lod).indexCount / 3;
+        return triangles;
+    }
+
+private:
+    // обработка узлов: собираем меши в порядке обхода дерева
+    static void processNode(aiNode *node, const aiScene *scene, vector<const aiMesh*>& sceneMeshes)
+    {
+        // получаем меш-индексы
+        for(int i = 0; i < node->mNumMeshes; i++)
+            sceneMeshes.push_back(scene->mMeshes[node->mMeshes[i]]);
+        // выполняем то же самое для потомков текущего меша
+        for(int i = 0; i < node->mNumChildren; i++)
+            processNode(node->mChildren[i], scene, sceneMeshes);
+    }
+
+    // перевод объекта aiMesh в данные меша (буферы выделяются сразу нужного размера)
+    static void processMesh(const aiMesh *mesh, const aiScene *scene, const string& directory, MeshData& result)
+    {
+        CpuZone zone("processMesh");
+        vector<Vertex>& vertices = result.vertices; // вершины
+        vector<int>& indices = result.indices; // грани
+        BoundingBox& bounds = result.bounds; // ограничивающий параллелепипед
+        if (mesh->mNumVertices > 0)
+            bounds.min = bounds.max = glm::vec3(mesh->mVertices[0].x, mesh->mVertices[0].y, mesh->mVertices[0].z);
+
+        // по всем вершинам текущего меша
+        vertices.resize(mesh->mNumVertices);
+        for(int i = 0; i < mesh->mNumVertices; i++)
+        {
+            Vertex& vert = vertices[i];
+            
+			// координаты вершины меша
+            vert.position = glm::vec3(mesh->mVertices[i].x, mesh->mVertices[i].y, mesh->mVertices[i].z);
+			
+            // нормаль вершины меша
+            if (mesh->mNormals)
+                vert.normal = glm::vec3(mesh->mNormals[i].x, mesh->mNormals[i].y, mesh->mNormals[i].z);
+            else
+                vert.normal = glm::vec3(0.0f, 1.0f, 0.0f);
+			
+            // текстурные координаты вершины меша
+            if(mesh->mTextureCoords[0]) // если меш содержит текстурные координаты		
+                vert.textureCoord = glm::vec2(mesh->mTextureCoords[0][i].x, mesh->mTextureCoords[0][i].y);
+            else
+                vert.textureCoord = glm::vec2(0.0f, 0.0f);
+			
+            // расширяем ограничивающий параллелепипед
+            bounds.min = glm::min(bounds.min, vert.position);
+            bounds.max = glm::max(bounds.max, vert.position);
+        }
+
+        // по каждой треугольной грани меша (из-за параметра aiProcess_Triangulate): сначала считаем индексы, потом копируем
+        size_t indexCount = 0;
+        for(unsigned int i = 0; i < mesh->mNumFaces; i++)
+            indexCount += mesh->mFaces[i].mNumIndices;
+        indices.resize(indexCount);
+        size_t write = 0;
+        for(int i = 0; i < mesh->mNumFaces; i++)
+        {
+            const aiFace& face = mesh->mFaces[i];		
+            for(unsigned int j = 0; j < face.mNumIndices; j++)
+                indices[write++] = face.mIndices[j];
+        }
+		
+        // склейка вершин и порядок треугольников и вершин для кэша вершин и против перерисовки
+        meshOptimize::Optimize(vertices, indices, result.optimizeReport);
+
+        // чтобы получить материал меша, нам нужно проиндексировать массив mMaterials сцены
+        aiMaterial* material = scene->mMaterials[mesh->mMaterialIndex];  
+
+        // диффузные текстуры меша загрузит конструктор модели (текстуры создаются в потоке OpenGL)
+        result.texturePaths = materialTexturePaths(material, aiTextureType_DIFFUSE, directory);
+
+        // позиции без швов для проходов глубины (порядок вершин уже окончательный)
+        meshOptimize::BuildPositionStream(vertices, result.positions, result.positionRemap);
+
+        // сфера с центром в центре параллелепипеда и радиусом до самой дальней вершины
+        result.sphere.center = bounds.Center();
+        for (const auto& v : vertices)
+            result.sphere.radius = std::max(result.sphere.radius, glm::length(v.position - result.sphere.center));
+
+        // цепочка упрощённых уровней детализации
+        generateLods(result);
+    }
+
+    // строим упрощённые наборы индексов: каждый уровень примерно вдвое проще предыдущего.
+    // Цепочка обрывается, если упрощение почти ничего не дало (заблокированы швы) или ошибка слишком велика
+    static void generateLods(MeshData& mesh)
+    {
+        CpuZone zone("generateLods");
+        const int maxLods = 4;
+        const size_t minTriangles = 32;
+        // допустимая ошибка упрощения - доля размера меша
+        const float maxError = mesh.sphere.radius * 0.05f;
+
+        size_t previous = mesh.indices.size();
+        for (int lod = 1; lod < maxLods && previous / 3 > minTriangles; lod++)
+        {
+            size_t target = previous / 2 / 3 * 3;
+            vector<int> simplified = meshSimplify::Simplify(mesh.vertices, mesh.indices, target, maxError);
+            if (simplified.empty() || simplified.size() > previous * 9 / 10)
+                break;
+            previous = simplified.size();
+            // упрощённые индексы тоже переставляем для кэша вершин (вершины у всех уровней общие)
+            meshOptimize::OptimizeVertexCache(simplified, mesh.vertices.size());
+            mesh.lods.push_back(move(simplified));
+        }
+    }
+
+    /// <summary>
+    /// https://learnopengl.com/Model
+    /// Пути ко всем текстурам материала данного типа (сами текстуры загружает менеджер ресурсов,
+    /// повторно текстура не загружается: он вернёт уже загруженную по пути или по содержимому файла)
+    /// </summary>
+    /// <param name="mat"></param>
+    /// <param name="type"></param>
+    /// <param name="directory"></param>
+    /// <returns></returns>
+    static vector<string> materialTexturePaths(aiMaterial *mat, aiTextureType type, const string& directory)
+    {
+        vector<string> paths;
+        for(unsigned int i = 0; i < mat->GetTextureCount(type); i++)
+        {
+            aiString str;
+            mat->GetTexture(type, i, &str);
+            paths.push_back(directory + '/' + str.C_Str());
+        }
+        return paths;
+    }
+};
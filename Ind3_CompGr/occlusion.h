@@ -0,0 +1,232 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "bounds.h"
+#include "glHandle.h"
+#include "glState.h"
+#include "ringBuffer.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+using namespace std;
+
+// Отсечение заслонённых объектов запросами видимости (GL_ANY_SAMPLES_PASSED_CONSERVATIVE).
+// После прохода закраски буфер глубины уже содержит главные заслонители (дорогу, траву, ближние машины);
+// для каждого объекта в пирамиде видимости рисуется его параллелепипед - без записи цвета и глубины, каждый в своём запросе.
+// Если ни один фрагмент параллелепипеда не прошёл тест глубины, объект заслонён и в следующих кадрах не рисуется,
+// но его параллелепипед проверяется каждый кадр, и как только он выглянет, объект рисуется снова.
+// Результаты набора запросов читаются, когда готов последний запрос набора (как в GpuProfiler), через кадр и позже,
+// поэтому чтение никогда не ждёт видеокарту; если все наборы ещё заняты, проверки кадра пропускаются.
+// Объект, который в последнем прочитанном наборе не проверялся (был вне пирамиды или камера внутри его параллелепипеда),
+// считается видимым. Выглянувший объект появляется с опозданием на время готовности результата (обычно 1-2 кадра).
+// glBeginConditionalRender не подходит: объекты рисуются группами через glMultiDrawElementsIndirect,
+// а условие отменяет вызов рисования целиком; к тому же так виден счёт отсечённых объектов.
+class OcclusionCuller
+{
+public:
+    static const int FramesInFlight = 3;
+
+    // maxObjects - сколько объектов в сцене (номера объектов - их номера в сцене)
+    void Init(size_t maxObjects)
+    {
+        Release();
+        this->maxObjects = maxObjects;
+        occluded.assign(maxObjects, 0);
+        resultFrames.assign(maxObjects, 0);
+
+        // параллелепипед - один экземпляр: min и max из атрибутов 0 и 1, углы - по gl_VertexID
+        vao = CreateVertexArray();
+        glEnableVertexArrayAttrib(vao, 0);
+        glVertexArrayAttribFormat(vao, 0, 3, GL_FLOAT, GL_FALSE, offsetof(Box, min));
+        glVertexArrayAttribBinding(vao, 0, 0);
+        glEnableVertexArrayAttrib(vao, 1);
+        glVertexArrayAttribFormat(vao, 1, 3, GL_FLOAT, GL_FALSE, offsetof(Box, max));
+        glVertexArrayAttribBinding(vao, 1, 0);
+        glVertexArrayBindingDivisor(vao, 0, 1);
+    }
+
+    // начало кадра: забираем готовые результаты (без ожидания)
+    void Collect()
+    {
+        for (;;)
+        {
+            // самый старый из ожидающих наборов
+            int slot = -1;
+            for (int i = 0; i < FramesInFlight; i++)
+                if (sets[i].pending && (slot < 0 || sets[i].frameNumber < sets[slot].frameNumber))
+                    slot = i;
+            if (slot < 0)
+                return;
+
+            QuerySet& set = sets[slot];
+            // запросы завершаются по порядку: готов последний - готовы все
+            GLuint available = 0;
+            glGetQueryObjectuiv(set.queries[set.objects.size() - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available)
+                return;
+
+            size_t culled = 0;
+            for (size_t k = 0; k < set.objects.size(); k++)
+            {
+                GLuint samples = 0;
+                glGetQueryObjectuiv(set.queries[k], GL_QUERY_RESULT, &samples);
+                size_t index = set.objects[k];
+                occluded[index] = samples == 0;
+                resultFrames[index] = set.frameNumber;
+                culled += samples == 0;
+            }
+            collectedFrame = set.frameNumber;
+            lastTested = set.objects.size();
+            lastOccluded = culled;
+            set.pending = false;
+        }
+    }
+
+    // заслонён ли объект по последнему прочитанному набору
+    bool Occluded(size_t index) const
+    {
+        return index < maxObjects && occluded[index] && resultFrames[index] == collectedFrame;
+    }
+
+    // проверки кадра: Begin, Add для каждого объекта в пирамиде видимости, Test.
+    // nearMargin - на сколько расширять параллелепипеды при проверке, не внутри ли них камера
+    // (такой параллелепипед обрезается ближней плоскостью, и запрос соврёт)
+    void Begin(const glm::vec3& cameraPos, float nearMargin)
+    {
+        this->cameraPos = cameraPos;
+        this->nearMargin = nearMargin;
+        boxes.clear();
+        objects.clear();
+    }
+
+    void Add(size_t index, const BoundingBox& box)
+    {
+        if (index >= maxObjects)
+            return;
+        bool inside = true;
+        for (int axis = 0; axis < 3; axis++)
+            inside = inside && cameraPos[axis] >= box.min[axis] - nearMargin && cameraPos[axis] <= box.max[axis] + nearMargin;
+        if (inside)
+            return;
+        boxes.push_back(Box{ glm::vec4(box.min, 1.0f), glm::vec4(box.max, 1.0f) });
+        objects.push_back(index);
+    }
+
+    // рисуем параллелепипеды программой program (вершинный шейдер строит полосу из 14 вершин по gl_VertexID),
+    // каждый в своём запросе; цвет и глубина не пишутся, после проверок запись снова включена
+    void Test(GLuint program)
+    {
+        if (boxes.empty())
+            return;
+
+        int slot = -1;
+        for (int i = 0; i < FramesInFlight && slot < 0; i++)
+            if (!sets[i].pending)
+                slot = i;
+        if (slot < 0)
+        {
+            droppedFrames++;
+            return;
+        }
+
+        // кольцевой буфер параллелепипедов создаётся при первой проверке. Его сегмент использовался FramesInFlight
+        // проверок назад, а раз свободен хотя бы один набор, результаты той проверки уже прочитаны: fence не ждёт
+        if (!boxRing.Buffer())
+            boxRing.Init((GLsizeiptr)(maxObjects * sizeof(Box)), sizeof(Box));
+        boxRing.BeginFrame();
+        Box* dst = (Box*)boxRing.Allocate((GLsizeiptr)(boxes.size() * sizeof(Box)));
+        if (!dst)
+        {
+            boxRing.EndFrame();
+            return;
+        }
+        memcpy(dst, boxes.data(), boxes.size() * sizeof(Box));
+        glVertexArrayVertexBuffer(vao, 0, boxRing.Buffer(), boxRing.LastOffset(), sizeof(Box));
+
+        QuerySet& set = sets[slot];
+        while (set.queries.size() < boxes.size())
+            set.queries.push_back(CreateQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE));
+
+        GlState& state = GlState::Instance();
+        state.UseProgram(program);
+        state.BindVertexArray(vao);
+        state.ColorMask(false);
+        state.DepthMask(false);
+        // грани параллелепипеда касаются объекта: равная глубина считается видимой
+        state.DepthFunc(GL_LEQUAL);
+        for (size_t k = 0; k < boxes.size(); k++)
+        {
+            glBeginQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE, set.queries[k]);
+            state.DrawArraysInstancedBaseInstance(GL_TRIANGLE_STRIP, 0, 14, 1, (GLuint)k);
+            glEndQuery(GL_ANY_SAMPLES_PASSED_CONSERVATIVE);
+        }
+        state.ColorMask(true);
+        state.DepthMask(true);
+        state.DepthFunc(GL_LESS);
+        boxRing.EndFrame();
+
+        set.objects.swap(objects);
+        set.frameNumber = ++issuedFrames;
+        set.pending = true;
+    }
+
+    // сколько объектов проверено и сколько из них заслонено в последнем прочитанном наборе
+    size_t LastTested() const { return lastTested; }
+    size_t LastOccluded() const { return lastOccluded; }
+    size_t DroppedFrames() const { return droppedFrames; }
+
+    void Release()
+    {
+        for (auto& set : sets)
+            set = QuerySet();
+        boxRing.Release();
+        vao.Reset();
+        boxes.clear();
+        objects.clear();
+        occluded.clear();
+        resultFrames.clear();
+        maxObjects = 0;
+        issuedFrames = collectedFrame = 0;
+        lastTested = lastOccluded = 0;
+    }
+
+private:
+    // параллелепипед в буфере (атрибуты 0 и 1)
+    struct Box
+    {
+        glm::vec4 min;
+        glm::vec4 max;
+    };
+
+    // запросы одного кадра: queries[k] - объект objects[k]
+    struct QuerySet
+    {
+        vector<GlQuery> queries;
+        vector<size_t> objects;
+        unsigned long long frameNumber = 0;
+        bool pending = false;
+    };
+
+    QuerySet sets[FramesInFlight];
+    RingBuffer boxRing;
+    GlVertexArray vao;
+    // параллелепипеды и номера объектов текущего кадра (векторы не перевыделяются от кадра к кадру)
+    vector<Box> boxes;
+    vector<size_t> objects;
+    // результат по объекту и номер набора, из которого он взят
+    vector<uint8_t> occluded;
+    vector<unsigned long long> resultFrames;
+    size_t maxObjects = 0;
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+    float nearMargin = 0.0f;
+    unsigned long long issuedFrames = 0;
+    unsigned long long collectedFrame = 0;
+    size_t lastTested = 0;
+    size_t lastOccluded = 0;
+    size_t droppedFrames = 0;
+};
@@ -0,0 +1,177 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glHandle.h"
+#include "glState.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <iostream>
+
+// Замер перерисовки: сколько фрагментов в среднем закрашивается на пиксель.
+// Кадр рисуется в свой буфер кадра с глубиной и трафаретом; пока идут проходы закраски (BeginCounting/EndCounting),
+// каждый фрагмент, прошедший тест глубины, увеличивает трафарет своего пикселя на 1 (при раннем тесте глубины
+// закрашиваются как раз такие фрагменты). Предварительный проход глубины не считается.
+// В конце кадра трафарет копируется в буфер упаковки (PBO) и ставится fence; суммируется он через несколько кадров,
+// когда fence уже сигнализирован, поэтому замер никогда не ждёт видеокарту (если все PBO заняты, кадр пропускается).
+// Цвет кадра копируется в буфер окна, так что картинка на экране не меняется.
+// Трафарет 8-битный: больше 255 фрагментов на пиксель не сосчитать.
+class OverdrawMeter
+{
+public:
+    static const int FramesInFlight = 3;
+
+    // результат одного кадра
+    struct Result
+    {
+        double perPixel = 0.0; // на пиксель экрана
+        double perCoveredPixel = 0.0; // на пиксель, где закрашен хотя бы один фрагмент
+        double coverage = 0.0; // доля таких пикселей
+    };
+
+    void Init(int targetWidth, int targetHeight)
+    {
+        Release();
+        width = targetWidth;
+        height = targetHeight;
+
+        color = CreateRenderbuffer();
+        glNamedRenderbufferStorage(color, GL_RGBA8, width, height);
+        depthStencil = CreateRenderbuffer();
+        glNamedRenderbufferStorage(depthStencil, GL_DEPTH24_STENCIL8, width, height);
+        framebuffer = CreateFramebuffer();
+        glNamedFramebufferRenderbuffer(framebuffer, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+        glNamedFramebufferRenderbuffer(framebuffer, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depthStencil);
+        if (glCheckNamedFramebufferStatus(framebuffer, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+            std::cout << "ERROR::OVERDRAW:: framebuffer is incomplete" << std::endl;
+
+        // буфер упаковки на FramesInFlight кадров, отображённый в память на всё время работы
+        const GLbitfield flags = GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        frameBytes = (size_t)width * height;
+        readback = CreateBuffer();
+        glNamedBufferStorage(readback, frameBytes * FramesInFlight, NULL, flags);
+        mapped = (const uint8_t*)glMapNamedBufferRange(readback, 0, frameBytes * FramesInFlight, flags);
+        if (!mapped)
+            std::cout << "ERROR::OVERDRAW:: could not map readback buffer" << std::endl;
+    }
+
+    bool Ready() const { return mapped != NULL; }
+
+    // начало кадра: рисуем в свой буфер (glClear кадра должен очищать и трафарет)
+    void BeginFrame()
+    {
+        GlState::Instance().BindFramebuffer(GL_FRAMEBUFFER, framebuffer);
+        glViewport(0, 0, width, height);
+    }
+
+    // проход закраски: каждый фрагмент, прошедший тест глубины, считается в трафарете
+    void BeginCounting()
+    {
+        GlState::Instance().Enable(GL_STENCIL_TEST);
+        glStencilFunc(GL_ALWAYS, 0, 0xff);
+        glStencilOp(GL_KEEP, GL_KEEP, GL_INCR);
+    }
+
+    void EndCounting()
+    {
+        GlState::Instance().Disable(GL_STENCIL_TEST);
+    }
+
+    // конец кадра: забираем готовые замеры, ставим чтение трафарета этого кадра
+    // и копируем цвет в буфер кадра output (0 - окно)
+    void EndFrame(GLuint output)
+    {
+        Collect();
+
+        int slot = -1;
+        for (int i = 0; i < FramesInFlight && slot < 0; i++)
+            if (!fences[i])
+                slot = i;
+        if (slot < 0)
+            droppedFrames++;
+        else if (mapped)
+        {
+            GlState& state = GlState::Instance();
+            state.BindBuffer(GL_PIXEL_PACK_BUFFER, readback);
+            glPixelStorei(GL_PACK_ALIGNMENT, 1);
+            glReadPixels(0, 0, width, height, GL_STENCIL_INDEX, GL_UNSIGNED_BYTE, (void*)(slot * frameBytes));
+            glPixelStorei(GL_PACK_ALIGNMENT, 4);
+            state.BindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+            fences[slot] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            // замеры суммируются в порядке кадров
+            frameNumbers[slot] = ++issuedFrames;
+        }
+
+        glBlitNamedFramebuffer(framebuffer, output, 0, 0, width, height, 0, 0, width, height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        GlState::Instance().BindFramebuffer(GL_FRAMEBUFFER, output);
+    }
+
+    // последний готовый замер
+    const Result& Last() const { return last; }
+    size_t MeasuredFrames() const { return measuredFrames; }
+    size_t DroppedFrames() const { return droppedFrames; }
+
+    void Release()
+    {
+        for (int i = 0; i < FramesInFlight; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (readback)
+        {
+            glUnmapNamedBuffer(readback);
+            readback.Reset();
+        }
+        mapped = NULL;
+        framebuffer.Reset();
+        color.Reset();
+        depthStencil.Reset();
+    }
+
+private:
+    // суммируем трафарет кадров, чтение которых уже выполнено (без ожидания)
+    void Collect()
+    {
+        for (;;)
+        {
+            // самый старый из ожидающих замеров
+            int slot = -1;
+            for (int i = 0; i < FramesInFlight; i++)
+                if (fences[i] && (slot < 0 || frameNumbers[i] < frameNumbers[slot]))
+                    slot = i;
+            if (slot < 0 || glClientWaitSync(fences[slot], 0, 0) == GL_TIMEOUT_EXPIRED)
+                return;
+            glDeleteSync(fences[slot]);
+            fences[slot] = 0;
+
+            const uint8_t* counts = mapped + slot * frameBytes;
+            size_t total = 0, covered = 0;
+            for (size_t i = 0; i < frameBytes; i++)
+            {
+                total += counts[i];
+                covered += counts[i] != 0;
+            }
+            last.perPixel = (double)total / frameBytes;
+            last.perCoveredPixel = covered ? (double)total / covered : 0.0;
+            last.coverage = (double)covered / frameBytes;
+            measuredFrames++;
+        }
+    }
+
+    GlFramebuffer framebuffer;
+    GlRenderbuffer color;
+    GlRenderbuffer depthStencil;
+    GlBuffer readback;
+    const uint8_t* mapped = NULL;
+    int width = 0, height = 0;
+    size_t frameBytes = 0;
+    GLsync fences[FramesInFlight] = {};
+    unsigned long long frameNumbers[FramesInFlight] = {};
+    unsigned long long issuedFrames = 0;
+    size_t measuredFrames = 0;
+    size_t droppedFrames = 0;
+    Result last;
+};
@@ -0,0 +1,182 @@
+#pragma once
+
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+
+#include "gameObject.h"
+#include "glState.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+using namespace std;
+
+// проход, в котором рисуется меш (старшие биты ключа: проходы идут по порядку)
+enum class RenderPass
+{
+    Depth, // предварительный проход: только глубина
+    Opaque
+};
+
+// Очередь рисования: каждый меш видимого объекта попадает в неё с 64-битным ключом сортировки,
+// в конце кадра ключи сортируются поразрядно (radix sort) и меши рисуются по порядку ключей.
+// Раскладка ключа от старших битов к младшим:
+//   проход (4) | программа (8) | текстура (20) | разрядность индексов (1) | глубина (24) | не заняты (7)
+// Поэтому смены программы и текстуры происходят только на границах групп, а внутри группы
+// непрозрачные меши идут от ближних к дальним (раньше срабатывает тест глубины).
+// VAO у всех мешей общий (GeometryPool), от меша к мешу меняется только буфер индексов - его и различает ключ
+// (в проходе глубины меши с потоком позиций рисуются со своим VAO, см. Mesh::DrawDepth).
+// Имена программ и текстур OpenGL выдаются подряд с маленьких чисел, в ключ идут их младшие биты:
+// совпадение старших битов может только разбить группу, на правильность рисования оно не влияет.
+// Сортировка устойчива, поэтому меши одного объекта с одной текстурой остаются рядом.
+class RenderQueue
+{
+public:
+    static const int PassShift = 60;
+    static const int ProgramShift = 52;
+    static const int TextureShift = 32;
+    static const int IndexTypeShift = 31;
+    static const int DepthShift = 7;
+    static const uint64_t ProgramMask = 0xff;
+    static const uint64_t TextureMask = 0xfffff;
+    static const uint64_t DepthMask = 0xffffff;
+
+    // начало кадра: положение камеры и расстояние, на котором глубина в ключе достигает максимума
+    void Begin(const glm::vec3& cameraPos, float farDistance)
+    {
+        items.clear();
+        this->cameraPos = cameraPos;
+        this->farDistance = farDistance;
+    }
+
+    // все меши объекта на его уровне детализации; objectOffset - данные объекта (блок ObjectData) в кольцевом буфере
+    void Add(RenderPass pass, GLuint program, GameObject& go, GLintptr objectOffset)
+    {
+        if (!go.model)
+            return;
+
+        float distance = glm::length(go.WorldBounds().Center() - cameraPos);
+        uint64_t depth = (uint64_t)(glm::clamp(distance / farDistance, 0.0f, 1.0f) * (float)DepthMask);
+        for (auto& mesh : go.model->meshes)
+        {
+            Item item;
+            // проход глубины текстуру не привязывает и рисует из потока позиций (если он есть)
+            bool depthOnly = pass == RenderPass::Depth;
+            GLenum indexType = depthOnly ? mesh.DepthLod(go.lod).indexType : mesh.Lod(go.lod).indexType;
+            item.key = MakeKey(pass, program, depthOnly ? 0 : mesh.TextureID(), indexType, depth);
+            item.program = program;
+            item.mesh = &mesh;
+            item.lod = go.lod;
+            item.objectOffset = objectOffset;
+            items.push_back(item);
+        }
+    }
+
+    static uint64_t MakeKey(RenderPass pass, GLuint program, GLuint texture, GLenum indexType, uint64_t depth)
+    {
+        return ((uint64_t)pass << PassShift)
+            | (((uint64_t)program & ProgramMask) << ProgramShift)
+            | (((uint64_t)texture & TextureMask) << TextureShift)
+            | ((uint64_t)(indexType == GL_UNSIGNED_INT) << IndexTypeShift)
+            | ((depth & DepthMask) << DepthShift);
+    }
+
+    // поразрядная сортировка ключей по байтам, от младшего к старшему (8 проходов по 256 корзин).
+    // Гистограммы всех байтов считаются за один проход по ключам; байт, одинаковый у всех ключей
+    // (например, незанятые биты или единственная программа), пропускается
+    void Sort()
+    {
+        size_t n = items.size();
+        order.resize(n);
+        scratch.resize(n);
+        for (size_t i = 0; i < n; i++)
+            order[i] = SortEntry{ items[i].key, (uint32_t)i };
+        if (n < 2)
+            return;
+
+        size_t counts[8][256] = {};
+        for (const SortEntry& e : order)
+            for (int b = 0; b < 8; b++)
+                counts[b][(e.key >> (b * 8)) & 0xff]++;
+
+        SortEntry* src = order.data();
+        SortEntry* dst = scratch.data();
+        for (int b = 0; b < 8; b++)
+        {
+            int shift = b * 8;
+            if (counts[b][(src[0].key >> shift) & 0xff] == n)
+                continue;
+
+            size_t offsets[256];
+            size_t sum = 0;
+            for (int d = 0; d < 256; d++)
+            {
+                offsets[d] = sum;
+                sum += counts[b][d];
+            }
+            for (size_t i = 0; i < n; i++)
+                dst[offsets[(src[i].key >> shift) & 0xff]++] = src[i];
+            swap(src, dst);
+        }
+        // после нечётного числа проходов результат оказался во втором массиве
+        if (src != order.data())
+            order.swap(scratch);
+    }
+
+    // рисуем меши прохода pass в порядке ключей (состояние прохода - маски, сравнение глубины - задаёт вызывающий).
+    // Программа и данные объекта привязываются через GlState, поэтому повторные привязки внутри группы отбрасываются;
+    // objectBuffer/objectBinding/objectSize - откуда берётся ObjectData
+    void Draw(RenderPass pass, GLuint objectBuffer, GLuint objectBinding, GLsizeiptr objectSize)
+    {
+        // меши прохода идут подряд: ищем начало по старшим битам ключа
+        uint64_t first = (uint64_t)pass << PassShift;
+        auto it = lower_bound(order.begin(), order.end(), first, [](const SortEntry& e, uint64_t key) { return e.key < key; });
+
+        GlState& state = GlState::Instance();
+        for (; it != order.end() && (it->key >> PassShift) == (uint64_t)pass; ++it)
+        {
+            const Item& item = items[it->index];
+            state.UseProgram(item.program);
+            state.BindBufferRange(GL_UNIFORM_BUFFER, objectBinding, objectBuffer, item.objectOffset, objectSize);
+            if (pass == RenderPass::Depth)
+                item.mesh->DrawDepth(item.lod);
+            else
+                item.mesh->Draw(item.lod);
+        }
+    }
+
+    // сколько мешей в очереди
+    size_t Size() const { return items.size(); }
+
+    void Release()
+    {
+        items = vector<Item>();
+        order = vector<SortEntry>();
+        scratch = vector<SortEntry>();
+    }
+
+private:
+    struct Item
+    {
+        uint64_t key;
+        GLuint program;
+        Mesh* mesh;
+        int lod;
+        GLintptr objectOffset;
+    };
+
+    // ключ и номер меша в items: сортируется только эта пара, сами меши не переставляются
+    struct SortEntry
+    {
+        uint64_t key;
+        uint32_t index;
+    };
+
+    glm::vec3 cameraPos = glm::vec3(0.0f);
+    float farDistance = 1.0f;
+    // векторы не перевыделяются от кадра к кадру
+    vector<Item> items;
+    vector<SortEntry> order;
+    vector<SortEntry> scratch;
+};
@@ -0,0 +1,122 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "glHandle.h"
+
+#include <cstring>
+#include <iostream>
+
+// Кольцевой буфер для данных, которые CPU пишет каждый кадр (uniform-блоки и т.п.).
+// Буфер создаётся через glBufferStorage и отображается в память один раз (persistent + coherent),
+// поэтому запись - это обычный memcpy без glBufferSubData/glMapBuffer.
+// Буфер разбит на framesInFlight сегментов: пока GPU читает сегмент прошлого кадра, CPU пишет в следующий.
+// Перед повторным использованием сегмента ждём его fence, так что запись никогда не затирает данные,
+// которые GPU ещё не прочитал, и не ждёт без необходимости.
+class RingBuffer
+{
+public:
+    static const int framesInFlight = 3;
+
+    // segmentSize - сколько байт можно записать за один кадр
+    // alignment - выравнивание смещений (для uniform-буфера GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT).
+    // Размер сегмента округляется вверх до кратного alignment: иначе выровнено только смещение внутри сегмента,
+    // а начало второго и третьего сегментов - нет
+    void Init(GLsizeiptr segmentSize, GLint alignment)
+    {
+        this->alignment = alignment > 0 ? alignment : 1;
+        this->segmentSize = (segmentSize + this->alignment - 1) / this->alignment * this->alignment;
+        segmentSize = this->segmentSize;
+
+        const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+        buffer = CreateBuffer();
+        glNamedBufferStorage(buffer, segmentSize * framesInFlight, NULL, flags);
+        mapped = (char*)glMapNamedBufferRange(buffer, 0, segmentSize * framesInFlight, flags);
+
+        if (!mapped)
+            std::cout << "ERROR::RING_BUFFER:: could not map buffer" << std::endl;
+
+        for (int i = 0; i < framesInFlight; i++)
+            fences[i] = 0;
+        segment = 0;
+        head = 0;
+    }
+
+    // начало кадра: переходим к следующему сегменту, дождавшись, что GPU закончил его читать
+    void BeginFrame()
+    {
+        segment = (segment + 1) % framesInFlight;
+        head = 0;
+
+        if (fences[segment])
+        {
+            // обычно fence уже сигнализирован (он поставлен framesInFlight кадров назад), и ожидания нет
+            GLenum result = glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 0);
+            while (result == GL_TIMEOUT_EXPIRED)
+                result = glClientWaitSync(fences[segment], GL_SYNC_FLUSH_COMMANDS_BIT, 1000000);
+            glDeleteSync(fences[segment]);
+            fences[segment] = 0;
+        }
+    }
+
+    // копируем данные в текущий сегмент и возвращаем их смещение от начала буфера (-1, если место кончилось)
+    GLintptr Push(const void* data, GLsizeiptr size)
+    {
+        void* dst = Allocate(size);
+        if (!dst)
+            return -1;
+        memcpy(dst, data, size);
+        return lastOffset;
+    }
+
+    // резервируем size байт в текущем сегменте; смещение доступно через LastOffset()
+    void* Allocate(GLsizeiptr size)
+    {
+        GLsizeiptr aligned = (head + alignment - 1) / alignment * alignment;
+        if (!mapped || aligned + size > segmentSize)
+        {
+            std::cout << "ERROR::RING_BUFFER:: segment overflow (" << aligned + size << " > " << segmentSize << ")" << std::endl;
+            return NULL;
+        }
+        head = aligned + size;
+        lastOffset = segment * segmentSize + aligned;
+        // всё выделенное записывается вызывающим и читается видеокартой
+        GlState::Instance().CountUpload((size_t)size);
+        return mapped + lastOffset;
+    }
+
+    // конец кадра: ставим fence после всех команд, читающих текущий сегмент
+    void EndFrame()
+    {
+        fences[segment] = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    }
+
+    GLuint Buffer() const { return buffer; }
+    GLintptr LastOffset() const { return lastOffset; }
+
+    void Release()
+    {
+        for (int i = 0; i < framesInFlight; i++)
+        {
+            if (fences[i])
+                glDeleteSync(fences[i]);
+            fences[i] = 0;
+        }
+        if (buffer)
+        {
+            glUnmapNamedBuffer(buffer);
+            buffer.Reset();
+        }
+        mapped = NULL;
+    }
+
+private:
+    GlBuffer buffer;
+    char* mapped = NULL; // отображённая память всего буфера
+    GLsizeiptr segmentSize = 0;
+    GLint alignment = 1;
+    GLsync fences[framesInFlight] = {};
+    int segment = 0; // текущий сегмент
+    GLsizeiptr head = 0; // занято байт в текущем сегменте
+    GLintptr lastOffset = 0;
+};
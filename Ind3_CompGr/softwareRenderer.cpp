@@ -0,0 +1,583 @@
+#include "softwareRenderer.h"
+#include "cpuProfiler.h"
+#include "gameObject.h"
+#include "threadPool.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#include <xmmintrin.h>
+#define SOFTWARE_RENDERER_SSE
+#endif
+
+// цвет материала из FragShaderSource
+static const glm::vec4 DiffColor(0.9f, 0.9f, 0.9f, 1.0f);
+
+static glm::vec4 Unpack(uint32_t texel)
+{
+    return glm::vec4((float)(texel & 0xff), (float)((texel >> 8) & 0xff), (float)((texel >> 16) & 0xff), (float)(texel >> 24));
+}
+
+static uint32_t Pack(const glm::vec4& c)
+{
+    glm::vec4 v = glm::clamp(c, 0.0f, 1.0f) * 255.0f + 0.5f;
+    return (uint32_t)v.x | ((uint32_t)v.y << 8) | ((uint32_t)v.z << 16) | ((uint32_t)v.w << 24);
+}
+
+bool SoftTexture::Load(const string& path)
+{
+    int width, height, components;
+    unsigned char* data = stbi_load(path.c_str(), &width, &height, &components, 0);
+    if (!data)
+        return false;
+
+    Level base;
+    base.width = width;
+    base.height = height;
+    base.texels.resize((size_t)width * height);
+    for (size_t i = 0; i < base.texels.size(); i++)
+    {
+        const unsigned char* p = data + i * components;
+        // GL_RED: (r, 0, 0, 1), GL_RGB: (r, g, b, 1)
+        uint32_t r = p[0];
+        uint32_t g = components >= 3 ? p[1] : 0;
+        uint32_t b = components >= 3 ? p[2] : 0;
+        uint32_t a = components == 4 ? p[3] : 255;
+        base.texels[i] = r | (g << 8) | (b << 16) | (a << 24);
+    }
+    stbi_image_free(data);
+    levels.clear();
+    levels.push_back(move(base));
+
+    // мип-уровни усреднением 2 x 2 до размера 1 x 1
+    while (levels.back().width > 1 || levels.back().height > 1)
+    {
+        const Level& src = levels.back();
+        Level dst;
+        dst.width = max(1, src.width / 2);
+        dst.height = max(1, src.height / 2);
+        dst.texels.resize((size_t)dst.width * dst.height);
+        for (int y = 0; y < dst.height; y++)
+            for (int x = 0; x < dst.width; x++)
+            {
+                int sx0 = min(2 * x, src.width - 1), sx1 = min(2 * x + 1, src.width - 1);
+                int sy0 = min(2 * y, src.height - 1), sy1 = min(2 * y + 1, src.height - 1);
+                glm::vec4 sum = Unpack(src.texels[(size_t)sy0 * src.width + sx0]) + Unpack(src.texels[(size_t)sy0 * src.width + sx1])
+                    + Unpack(src.texels[(size_t)sy1 * src.width + sx0]) + Unpack(src.texels[(size_t)sy1 * src.width + sx1]);
+                dst.texels[(size_t)y * dst.width + x] = Pack(sum / (4.0f * 255.0f));
+            }
+        levels.push_back(move(dst));
+    }
+    return true;
+}
+
+// билинейная выборка с повторением (GL_REPEAT, GL_LINEAR), результат в [0, 255]
+static glm::vec4 SampleBilinear(const SoftTexture::Level& level, float u, float v)
+{
+    float fx = u * level.width - 0.5f;
+    float fy = v * level.height - 0.5f;
+    float ix = floorf(fx), iy = floorf(fy);
+    float tx = fx - ix, ty = fy - iy;
+
+    int x0 = (int)ix % level.width, y0 = (int)iy % level.height;
+    if (x0 < 0)
+        x0 += level.width;
+    if (y0 < 0)
+        y0 += level.height;
+    int x1 = x0 + 1 == level.width ? 0 : x0 + 1;
+    int y1 = y0 + 1 == level.height ? 0 : y0 + 1;
+
+    const uint32_t* row0 = &level.texels[(size_t)y0 * level.width];
+    const uint32_t* row1 = &level.texels[(size_t)y1 * level.width];
+    glm::vec4 top = glm::mix(Unpack(row0[x0]), Unpack(row0[x1]), tx);
+    glm::vec4 bottom = glm::mix(Unpack(row1[x0]), Unpack(row1[x1]), tx);
+    return glm::mix(top, bottom, ty);
+}
+
+// трилинейная выборка (GL_LINEAR_MIPMAP_LINEAR): lod - log2 размера пикселя в текселях нулевого уровня
+static glm::vec4 SampleTrilinear(const SoftTexture& texture, float u, float v, float lod)
+{
+    if (!(u > -1e6f && u < 1e6f && v > -1e6f && v < 1e6f))
+        u = v = 0.0f;
+    if (lod <= 0.0f)
+        return SampleBilinear(texture.levels[0], u, v);
+    int last = (int)texture.levels.size() - 1;
+    int level = (int)lod;
+    if (level >= last)
+        return SampleBilinear(texture.levels[last], u, v);
+    float t = lod - level;
+    return glm::mix(SampleBilinear(texture.levels[level], u, v), SampleBilinear(texture.levels[level + 1], u, v), t);
+}
+
+// значение плоскости a + dx * x + dy * y
+static inline float Plane(const glm::vec3& plane, float x, float y)
+{
+    return plane.x + plane.y * x + plane.z * y;
+}
+
+void SoftwareRenderer::Init(int width, int height)
+{
+    this->width = width;
+    this->height = height;
+    tilesX = (width + TileSize - 1) / TileSize;
+    tilesY = (height + TileSize - 1) / TileSize;
+    color.assign((size_t)width * height, 0);
+    depth.assign((size_t)width * height, 1.0f);
+    for (auto& batch : batches)
+        batch.tiles.assign((size_t)tilesX * tilesY, vector<uint32_t>());
+}
+
+shared_ptr<SoftModel> SoftwareRenderer::LoadModel(const string& path)
+{
+    auto found = models.find(path);
+    if (found != models.end())
+        return found->second;
+
+    shared_ptr<SoftModel> model = make_shared<SoftModel>();
+    model->data = Model::Import(path);
+    for (const auto& mesh : model->data.meshes)
+    {
+        shared_ptr<SoftTexture> texture;
+        if (!mesh.texturePaths.empty())
+        {
+            const string& texturePath = mesh.texturePaths[0];
+            auto cached = textures.find(texturePath);
+            if (cached != textures.end())
+                texture = cached->second;
+            else
+            {
+                texture = make_shared<SoftTexture>();
+                if (!texture->Load(texturePath))
+                {
+                    printf("Texture failed to load at path: %s\n", texturePath.c_str());
+                    texture.reset();
+                }
+                textures[texturePath] = texture;
+            }
+        }
+        model->textures.push_back(texture);
+    }
+    models[path] = model;
+    return model;
+}
+
+void SoftwareRenderer::Begin(const glm::mat4& viewProjection, const glm::vec3& lightPos)
+{
+    this->viewProjection = viewProjection;
+    this->lightPos = lightPos;
+    draws.clear();
+    vertexCount = 0;
+    triangleTotal = 0;
+}
+
+void SoftwareRenderer::Add(const SoftModel& model, const glm::mat4& matr, int lod)
+{
+    glm::mat4 mvp = viewProjection * matr;
+    glm::mat4 normalMat = glm::mat4(glm::transpose(glm::inverse(glm::mat3(matr))));
+    for (size_t i = 0; i < model.data.meshes.size(); i++)
+    {
+        const MeshData& mesh = model.data.meshes[i];
+        Draw draw;
+        draw.mesh = &mesh;
+        draw.texture = model.textures[i].get();
+        // уровень 0 - полный набор индексов, дальше - упрощённые (если такого нет - самый простой)
+        size_t level = min((size_t)max(lod, 0), mesh.LodCount());
+        draw.indices = level == 0 ? mesh.IndexData() : mesh.LodData(level - 1);
+        draw.indexCount = level == 0 ? mesh.IndexCount() : mesh.LodSize(level - 1);
+        draw.mvp = mvp;
+        draw.model = matr;
+        draw.normalMat = normalMat;
+        draw.firstVertex = vertexCount;
+        draw.firstTriangle = triangleTotal;
+        vertexCount += mesh.VertexCount();
+        triangleTotal += draw.indexCount / 3;
+        draws.push_back(draw);
+    }
+}
+
+void SoftwareRenderer::Add(const GameObject& go)
+{
+    if (go.model)
+        Add(*LoadModel(go.model->path), go.matr, go.lod);
+}
+
+void SoftwareRenderer::Render()
+{
+    CpuZone zone("software render");
+    ThreadPool& pool = ThreadPool::Instance();
+
+    transformed.resize(vertexCount);
+    {
+        CpuZone vertexZone("software vertices");
+        pool.ParallelFor((vertexCount + VerticesPerBatch - 1) / VerticesPerBatch, [&](size_t b) { TransformVertices(b); });
+    }
+
+    size_t batchCount = (triangleTotal + TrianglesPerBatch - 1) / TrianglesPerBatch;
+    if (batches.size() < batchCount)
+    {
+        batches.resize(batchCount);
+        for (auto& batch : batches)
+            batch.tiles.resize((size_t)tilesX * tilesY);
+    }
+    {
+        CpuZone setupZone("software setup");
+        pool.ParallelFor(batchCount, [&](size_t b) { SetupTriangles(b); });
+    }
+    // лишние части с прошлых кадров растеризуются пустыми
+    for (size_t b = batchCount; b < batches.size(); b++)
+    {
+        batches[b].triangles.clear();
+        for (auto& tile : batches[b].tiles)
+            tile.clear();
+    }
+
+    triangleCount = 0;
+    for (size_t b = 0; b < batchCount; b++)
+        triangleCount += batches[b].triangles.size();
+
+    {
+        CpuZone rasterZone("software raster");
+        pool.ParallelFor((size_t)tilesX * tilesY, [&](size_t tile) { RasterTile(tile); });
+    }
+}
+
+void SoftwareRenderer::TransformVertices(size_t batch)
+{
+    size_t begin = batch * VerticesPerBatch;
+    size_t end = min(begin + VerticesPerBatch, vertexCount);
+
+    // меш, в котором лежит первая вершина части
+    size_t d = upper_bound(draws.begin(), draws.end(), begin,
+        [](size_t v, const Draw& draw) { return v < draw.firstVertex; }) - draws.begin() - 1;
+
+    for (size_t v = begin; v < end; d++)
+    {
+        const Draw& draw = draws[d];
+        const Vertex* vertices = draw.mesh->VertexData();
+        size_t last = min(end, draw.firstVertex + draw.mesh->VertexCount());
+
+#ifdef SOFTWARE_RENDERER_SSE
+        // позиция, мировая позиция и нормаль - столбцы матрицы, умноженные на координаты, по четыре числа сразу
+        __m128 mvp[4], model[4], normal[3];
+        for (int c = 0; c < 4; c++)
+        {
+            mvp[c] = _mm_loadu_ps(&draw.mvp[c][0]);
+            model[c] = _mm_loadu_ps(&draw.model[c][0]);
+        }
+        for (int c = 0; c < 3; c++)
+            normal[c] = _mm_loadu_ps(&draw.normalMat[c][0]);
+        __m128 light = _mm_set_ps(0.0f, lightPos.z, lightPos.y, lightPos.x);
+
+        for (; v < last; v++)
+        {
+            const Vertex& in = vertices[v - draw.firstVertex];
+            ClipVertex& out = transformed[v];
+            __m128 x = _mm_set1_ps(in.position.x), y = _mm_set1_ps(in.position.y), z = _mm_set1_ps(in.position.z);
+            __m128 clip = _mm_add_ps(_mm_add_ps(_mm_mul_ps(mvp[0], x), _mm_mul_ps(mvp[1], y)), _mm_add_ps(_mm_mul_ps(mvp[2], z), mvp[3]));
+            __m128 world = _mm_add_ps(_mm_add_ps(_mm_mul_ps(model[0], x), _mm_mul_ps(model[1], y)), _mm_add_ps(_mm_mul_ps(model[2], z), model[3]));
+            __m128 n = _mm_add_ps(_mm_add_ps(_mm_mul_ps(normal[0], _mm_set1_ps(in.normal.x)), _mm_mul_ps(normal[1], _mm_set1_ps(in.normal.y))),
+                _mm_mul_ps(normal[2], _mm_set1_ps(in.normal.z)));
+
+            float nl[8];
+            _mm_storeu_ps(&out.position.x, clip);
+            _mm_storeu_ps(nl, n);
+            _mm_storeu_ps(nl + 4, _mm_sub_ps(light, world));
+            out.attributes[0] = in.textureCoord.x;
+            out.attributes[1] = in.textureCoord.y;
+            out.attributes[2] = nl[0];
+            out.attributes[3] = nl[1];
+            out.attributes[4] = nl[2];
+            out.attributes[5] = nl[4];
+            out.attributes[6] = nl[5];
+            out.attributes[7] = nl[6];
+        }
+#else
+        glm::mat3 normalMat(draw.normalMat);
+        for (; v < last; v++)
+        {
+            const Vertex& in = vertices[v - draw.firstVertex];
+            ClipVertex& out = transformed[v];
+            glm::vec4 position(in.position, 1.0f);
+            out.position = draw.mvp * position;
+            glm::vec3 n = normalMat * in.normal;
+            glm::vec3 l = lightPos - glm::vec3(draw.model * position);
+            out.attributes[0] = in.textureCoord.x;
+            out.attributes[1] = in.textureCoord.y;
+            out.attributes[2] = n.x;
+            out.attributes[3] = n.y;
+            out.attributes[4] = n.z;
+            out.attributes[5] = l.x;
+            out.attributes[6] = l.y;
+            out.attributes[7] = l.z;
+        }
+#endif
+    }
+}
+
+// расстояние до плоскости отсечения (внутри - не меньше нуля): -w <= x, y, z <= w
+static inline float ClipDistance(const glm::vec4& p, int plane)
+{
+    switch (plane)
+    {
+    case 0: return p.w + p.x;
+    case 1: return p.w - p.x;
+    case 2: return p.w + p.y;
+    case 3: return p.w - p.y;
+    case 4: return p.w + p.z;
+    default: return p.w - p.z;
+    }
+}
+
+void SoftwareRenderer::SetupTriangles(size_t batchIndex)
+{
+    Batch& batch = batches[batchIndex];
+    batch.triangles.clear();
+    for (auto& tile : batch.tiles)
+        tile.clear();
+
+    size_t begin = batchIndex * TrianglesPerBatch;
+    size_t end = min(begin + TrianglesPerBatch, triangleTotal);
+    size_t d = upper_bound(draws.begin(), draws.end(), begin,
+        [](size_t t, const Draw& draw) { return t < draw.firstTriangle; }) - draws.begin() - 1;
+
+    for (size_t t = begin; t < end; d++)
+    {
+        const Draw& draw = draws[d];
+        size_t last = min(end, draw.firstTriangle + draw.indexCount / 3);
+        for (; t < last; t++)
+        {
+            const int* index = draw.indices + (t - draw.firstTriangle) * 3;
+            const ClipVertex* v[3] = { &transformed[draw.firstVertex + index[0]], &transformed[draw.firstVertex + index[1]],
+                &transformed[draw.firstVertex + index[2]] };
+
+            // по какую сторону каждой плоскости лежат вершины
+            int outside[3] = { 0, 0, 0 };
+            for (int i = 0; i < 3; i++)
+                for (int plane = 0; plane < 6; plane++)
+                    if (ClipDistance(v[i]->position, plane) < 0.0f)
+                        outside[i] |= 1 << plane;
+            if (outside[0] & outside[1] & outside[2])
+                continue;
+            if ((outside[0] | outside[1] | outside[2]) == 0)
+            {
+                EmitTriangle(*v[0], *v[1], *v[2], draw.texture, batch);
+                continue;
+            }
+
+            // отсечение многоугольника плоскостями, которые треугольник пересекает (Сазерленд - Ходжмен)
+            ClipVertex polygon[2][9];
+            int count = 3;
+            for (int i = 0; i < 3; i++)
+                polygon[0][i] = *v[i];
+            int current = 0;
+            int crossed = outside[0] | outside[1] | outside[2];
+            for (int plane = 0; plane < 6 && count >= 3; plane++)
+            {
+                if (!(crossed & (1 << plane)))
+                    continue;
+                const ClipVertex* in = polygon[current];
+                ClipVertex* out = polygon[1 - current];
+                int outCount = 0;
+                for (int i = 0; i < count; i++)
+                {
+                    const ClipVertex& a = in[i];
+                    const ClipVertex& b = in[(i + 1) % count];
+                    float da = ClipDistance(a.position, plane);
+                    float db = ClipDistance(b.position, plane);
+                    if (da >= 0.0f)
+                        out[outCount++] = a;
+                    if ((da >= 0.0f) != (db >= 0.0f))
+                    {
+                        float s = da / (da - db);
+                        ClipVertex& c = out[outCount++];
+                        c.position = glm::mix(a.position, b.position, s);
+                        for (int k = 0; k < AttributeCount; k++)
+                            c.attributes[k] = a.attributes[k] + (b.attributes[k] - a.attributes[k]) * s;
+                    }
+                }
+                count = outCount;
+                current = 1 - current;
+            }
+            for (int i = 1; i + 1 < count; i++)
+                EmitTriangle(polygon[current][0], polygon[current][i], polygon[current][i + 1], draw.texture, batch);
+        }
+    }
+}
+
+void SoftwareRenderer::EmitTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const SoftTexture* texture, Batch& out)
+{
+    const ClipVertex* v[3] = { &a, &b, &c };
+    Triangle triangle;
+    float sx[3], sy[3], invW[3];
+    for (int i = 0; i < 3; i++)
+    {
+        // экранные координаты: строки сверху вниз, 4 бита дробной части
+        invW[i] = 1.0f / v[i]->position.w;
+        triangle.x[i] = (int32_t)lroundf((v[i]->position.x * invW[i] * 0.5f + 0.5f) * width * 16.0f);
+        triangle.y[i] = (int32_t)lroundf((0.5f - v[i]->position.y * invW[i] * 0.5f) * height * 16.0f);
+        sx[i] = triangle.x[i] / 16.0f;
+        sy[i] = triangle.y[i] / 16.0f;
+    }
+
+    int64_t area = (int64_t)(triangle.x[1] - triangle.x[0]) * (triangle.y[2] - triangle.y[0])
+        - (int64_t)(triangle.x[2] - triangle.x[0]) * (triangle.y[1] - triangle.y[0]);
+    if (area == 0)
+        return;
+    // отсечения нелицевых граней нет (как и в OpenGL-пути), поэтому обход приводим к положительной площади
+    int order[3] = { 0, 1, 2 };
+    if (area < 0)
+    {
+        swap(order[1], order[2]);
+        swap(triangle.x[1], triangle.x[2]);
+        swap(triangle.y[1], triangle.y[2]);
+        swap(sx[1], sx[2]);
+        swap(sy[1], sy[2]);
+    }
+
+    triangle.minX = max(0, min({ triangle.x[0], triangle.x[1], triangle.x[2] }) >> 4);
+    triangle.minY = max(0, min({ triangle.y[0], triangle.y[1], triangle.y[2] }) >> 4);
+    triangle.maxX = min(width - 1, max({ triangle.x[0], triangle.x[1], triangle.x[2] }) >> 4);
+    triangle.maxY = min(height - 1, max({ triangle.y[0], triangle.y[1], triangle.y[2] }) >> 4);
+    if (triangle.minX > triangle.maxX || triangle.minY > triangle.maxY)
+        return;
+
+    // плоскости интерполяции по трём значениям в вершинах
+    float det = (sx[1] - sx[0]) * (sy[2] - sy[0]) - (sx[2] - sx[0]) * (sy[1] - sy[0]);
+    auto plane = [&](float v0, float v1, float v2)
+    {
+        float dx = ((v1 - v0) * (sy[2] - sy[0]) - (v2 - v0) * (sy[1] - sy[0])) / det;
+        float dy = ((v2 - v0) * (sx[1] - sx[0]) - (v1 - v0) * (sx[2] - sx[0])) / det;
+        return glm::vec3(v0 - dx * sx[0] - dy * sy[0], dx, dy);
+    };
+    const ClipVertex& v0 = *v[order[0]];
+    const ClipVertex& v1 = *v[order[1]];
+    const ClipVertex& v2 = *v[order[2]];
+    float w0 = invW[order[0]], w1 = invW[order[1]], w2 = invW[order[2]];
+    triangle.depth = plane(v0.position.z * w0 * 0.5f + 0.5f, v1.position.z * w1 * 0.5f + 0.5f, v2.position.z * w2 * 0.5f + 0.5f);
+    triangle.invW = plane(w0, w1, w2);
+    for (int k = 0; k < AttributeCount; k++)
+        triangle.attributes[k] = plane(v0.attributes[k] * w0, v1.attributes[k] * w1, v2.attributes[k] * w2);
+    triangle.texture = texture;
+
+    uint32_t index = (uint32_t)out.triangles.size();
+    out.triangles.push_back(triangle);
+    for (int ty = triangle.minY / TileSize; ty <= triangle.maxY / TileSize; ty++)
+        for (int tx = triangle.minX / TileSize; tx <= triangle.maxX / TileSize; tx++)
+            out.tiles[(size_t)ty * tilesX + tx].push_back(index);
+}
+
+void SoftwareRenderer::RasterTile(size_t tile)
+{
+    int x0 = (int)(tile % tilesX) * TileSize;
+    int y0 = (int)(tile / tilesX) * TileSize;
+    int x1 = min(x0 + TileSize, width);
+    int y1 = min(y0 + TileSize, height);
+
+    // очистка своей плитки (glClear: цвет (0, 0, 0, 0), глубина 1)
+    for (int y = y0; y < y1; y++)
+    {
+        fill(color.begin() + (size_t)y * width + x0, color.begin() + (size_t)y * width + x1, 0u);
+        fill(depth.begin() + (size_t)y * width + x0, depth.begin() + (size_t)y * width + x1, 1.0f);
+    }
+
+    for (const auto& batch : batches)
+        for (uint32_t index : batch.tiles[tile])
+            RasterTriangle(batch.triangles[index], x0, y0, x1, y1);
+}
+
+void SoftwareRenderer::RasterTriangle(const Triangle& tri, int x0, int y0, int x1, int y1)
+{
+    int minX = max(tri.minX, x0), maxX = min(tri.maxX, x1 - 1);
+    int minY = max(tri.minY, y0), maxY = min(tri.maxY, y1 - 1);
+    if (minX > maxX || minY > maxY)
+        return;
+
+    // функции рёбер в центре первого пикселя и их приращения на пиксель по x и по y.
+    // Пиксель на самом ребре принадлежит треугольнику, только если ребро верхнее или левое,
+    // поэтому у общего ребра двух треугольников пиксель рисуется ровно один раз
+    int64_t rowEdge[3], stepX[3], stepY[3];
+    int64_t px = (int64_t)minX * 16 + 8, py = (int64_t)minY * 16 + 8;
+    for (int i = 0; i < 3; i++)
+    {
+        int a = i, b = (i + 1) % 3;
+        int64_t dx = tri.x[b] - tri.x[a], dy = tri.y[b] - tri.y[a];
+        bool topLeft = dy < 0 || (dy == 0 && dx > 0);
+        rowEdge[i] = dx * (py - tri.y[a]) - dy * (px - tri.x[a]) + (topLeft ? 0 : -1);
+        stepX[i] = -dy * 16;
+        stepY[i] = dx * 16;
+    }
+
+    const SoftTexture* texture = tri.texture;
+    for (int y = minY; y <= maxY; y++)
+    {
+        int64_t e0 = rowEdge[0], e1 = rowEdge[1], e2 = rowEdge[2];
+        float fy = y + 0.5f;
+        uint32_t* colorRow = &color[(size_t)y * width];
+        float* depthRow = &depth[(size_t)y * width];
+        for (int x = minX; x <= maxX; x++, e0 += stepX[0], e1 += stepX[1], e2 += stepX[2])
+        {
+            if ((e0 | e1 | e2) < 0)
+                continue;
+            float fx = x + 0.5f;
+            float z = Plane(tri.depth, fx, fy);
+            if (!(z < depthRow[x]))
+                continue;
+            depthRow[x] = z;
+
+            // признаки, интерполированные перспективно-корректно
+            float q = Plane(tri.invW, fx, fy);
+            float w = 1.0f / q;
+            float attr[AttributeCount];
+            for (int k = 0; k < AttributeCount; k++)
+                attr[k] = Plane(tri.attributes[k], fx, fy) * w;
+
+            glm::vec4 texel(0.0f, 0.0f, 0.0f, 1.0f); // текстура 0 в OpenGL тоже даёт (0, 0, 0, 1)
+            if (texture)
+            {
+                // производные u и v по экрану - из тех же плоскостей: d(a / q) = (da - a dq) / q
+                float dudx = (tri.attributes[0].y - attr[0] * tri.invW.y) * w;
+                float dudy = (tri.attributes[0].z - attr[0] * tri.invW.z) * w;
+                float dvdx = (tri.attributes[1].y - attr[1] * tri.invW.y) * w;
+                float dvdy = (tri.attributes[1].z - attr[1] * tri.invW.z) * w;
+                float tw = (float)texture->levels[0].width, th = (float)texture->levels[0].height;
+                float footprint = max((dudx * dudx * tw * tw + dvdx * dvdx * th * th), (dudy * dudy * tw * tw + dvdy * dvdy * th * th));
+                float lod = footprint > 0.0f ? 0.5f * log2f(footprint) : 0.0f;
+                texel = SampleTrilinear(*texture, attr[0], attr[1], lod) / 255.0f;
+            }
+
+            glm::vec3 n = glm::normalize(glm::vec3(attr[2], attr[3], attr[4]));
+            glm::vec3 l = glm::normalize(glm::vec3(attr[5], attr[6], attr[7]));
+            glm::vec4 diff = DiffColor * max(glm::dot(n, l), 0.0f);
+            colorRow[x] = Pack(texel * diff);
+        }
+        rowEdge[0] += stepY[0];
+        rowEdge[1] += stepY[1];
+        rowEdge[2] += stepY[2];
+    }
+}
+
+bool SoftwareRenderer::SavePpm(const string& path) const
+{
+    FILE* file = fopen(path.c_str(), "wb");
+    if (!file)
+        return false;
+    fprintf(file, "P6\n%d %d\n255\n", width, height);
+    vector<unsigned char> row((size_t)width * 3);
+    for (int y = 0; y < height; y++)
+    {
+        for (int x = 0; x < width; x++)
+        {
+            uint32_t c = color[(size_t)y * width + x];
+            row[x * 3 + 0] = (unsigned char)(c & 0xff);
+            row[x * 3 + 1] = (unsigned char)((c >> 8) & 0xff);
+            row[x * 3 + 2] = (unsigned char)((c >> 16) & 0xff);
+        }
+        fwrite(row.data(), 1, row.size(), file);
+    }
+    bool ok = !ferror(file);
+    fclose(file);
+    return ok;
+}
@@ -0,0 +1,146 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "model.h"
+
+#include <cstddef>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+
+using namespace std;
+
+class GameObject;
+
+// Текстура программного рендерера: RGBA8 и цепочка мип-уровней (как после glGenerateMipmap)
+struct SoftTexture
+{
+    struct Level
+    {
+        int width = 0, height = 0;
+        vector<uint32_t> texels; // RGBA8, строки в порядке файла (как их получает glTexImage2D)
+    };
+    vector<Level> levels;
+
+    // загрузка через stb_image; каналы раскладываются так же, как форматы GL_RED / GL_RGB / GL_RGBA
+    bool Load(const string& path);
+};
+
+// Модель программного рендерера: импортированные меши (Model::Import, без OpenGL) и их текстуры
+struct SoftModel
+{
+    ModelData data;
+    vector<shared_ptr<SoftTexture>> textures; // диффузная текстура каждого меша (NULL, если её нет)
+};
+
+// Программный рендерер той же сцены без OpenGL: для картинок на серверах без GPU и как эталон для сравнения.
+// Кадр проходит три этапа, каждый делится на части и выполняется в общем пуле потоков:
+// 1) преобразование вершин (SSE, если есть) - части по VerticesPerBatch вершин;
+// 2) отсечение по пирамиде видимости, перевод в экран и раскладка треугольников по плиткам TileSize x TileSize -
+//    части по TrianglesPerBatch треугольников, у каждой части свои списки плиток, поэтому блокировок нет;
+// 3) растеризация - по плитке на задачу: функции рёбер в фиксированной точке (правило верхнего левого ребра),
+//    тест глубины, перспективно-корректные текстурные координаты, трилинейная выборка из мип-уровней
+//    и диффузное освещение из FragShaderSource.
+// Плитка обходит части в порядке добавления объектов, поэтому картинка не зависит от числа потоков.
+class SoftwareRenderer
+{
+public:
+    static const int TileSize = 64;
+    static const size_t VerticesPerBatch = 4096;
+    static const size_t TrianglesPerBatch = 1024;
+
+    // буферы цвета и глубины размером width x height
+    void Init(int width, int height);
+
+    // модель по пути (импорт и текстуры загружаются один раз)
+    shared_ptr<SoftModel> LoadModel(const string& path);
+
+    // начало кадра: матрица proj * view и положение источника света
+    void Begin(const glm::mat4& viewProjection, const glm::vec3& lightPos);
+    // все меши модели с матрицей объекта на уровне детализации lod
+    void Add(const SoftModel& model, const glm::mat4& matr, int lod = 0);
+    // объект сцены OpenGL: та же модель (по её пути), матрица и уровень детализации
+    void Add(const GameObject& go);
+    // рисуем добавленное и ждём окончания
+    void Render();
+
+    int Width() const { return width; }
+    int Height() const { return height; }
+    // RGBA8 (r в младшем байте), строки сверху вниз
+    const vector<uint32_t>& Pixels() const { return color; }
+    // картинка в двоичный PPM (альфа отбрасывается)
+    bool SavePpm(const string& path) const;
+
+    // сколько треугольников дошло до растеризации в последнем кадре (после отсечения)
+    size_t TriangleCount() const { return triangleCount; }
+
+    // сколько величин вершины интерполируется по треугольнику: u, v, нормаль (3), направление на свет (3)
+    static const int AttributeCount = 8;
+
+private:
+    // меш объекта в кадре
+    struct Draw
+    {
+        const MeshData* mesh;
+        const SoftTexture* texture;
+        const int* indices;
+        size_t indexCount;
+        glm::mat4 mvp;
+        glm::mat4 model;
+        glm::mat4 normalMat;
+        size_t firstVertex; // начало вершин меша в transformed
+        size_t firstTriangle; // номер первого треугольника меша среди всех треугольников кадра
+    };
+
+    // вершина после преобразования
+    struct ClipVertex
+    {
+        glm::vec4 position; // в отсекающих координатах
+        float attributes[AttributeCount];
+    };
+
+    // треугольник в координатах экрана, готовый к растеризации
+    struct Triangle
+    {
+        int32_t x[3], y[3]; // вершины в 1/16 пикселя, обход с положительной площадью
+        int minX, minY, maxX, maxY; // ограничивающий прямоугольник в пикселях (внутри экрана)
+        // плоскости a + dx * x + dy * y для интерполяции по экрану: глубина, 1/w и величины вершин, делённые на w
+        glm::vec3 depth;
+        glm::vec3 invW;
+        glm::vec3 attributes[AttributeCount];
+        const SoftTexture* texture;
+    };
+
+    // результат этапа раскладки по плиткам для одной части треугольников
+    struct Batch
+    {
+        vector<Triangle> triangles;
+        vector<vector<uint32_t>> tiles; // номера треугольников части в каждой плитке
+    };
+
+    void TransformVertices(size_t batch);
+    void SetupTriangles(size_t batch);
+    void EmitTriangle(const ClipVertex& a, const ClipVertex& b, const ClipVertex& c, const SoftTexture* texture, Batch& out);
+    void RasterTile(size_t tile);
+    void RasterTriangle(const Triangle& triangle, int x0, int y0, int x1, int y1);
+
+    int width = 0, height = 0;
+    int tilesX = 0, tilesY = 0;
+    vector<uint32_t> color;
+    vector<float> depth;
+
+    glm::mat4 viewProjection = glm::mat4(1.0f);
+    glm::vec3 lightPos = glm::vec3(0.0f);
+    vector<Draw> draws;
+    size_t vertexCount = 0;
+    size_t triangleTotal = 0;
+    vector<ClipVertex> transformed;
+    vector<Batch> batches;
+    size_t triangleCount = 0;
+
+    map<string, shared_ptr<SoftModel>> models;
+    map<string, shared_ptr<SoftTexture>> textures;
+};
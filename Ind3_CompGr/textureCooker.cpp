@@ -0,0 +1,315 @@
+#include "textureCooker.h"
+#include "ktx.h"
+#include "stb_image.h"
+
+#include <glm/glm.hpp>
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <vector>
+
+// базовые форматы для заголовка KTX
+const uint32_t BaseFormatRGB = 0x1907;
+const uint32_t BaseFormatRGBA = 0x1908;
+
+// картинка RGBA8, строки сверху вниз (как их отдаёт stb_image и как они загружались раньше)
+struct Image
+{
+    int width = 0;
+    int height = 0;
+    vector<unsigned char> pixels;
+};
+
+// следующий мип-уровень: среднее 2x2 пикселей (у нечётной стороны последний ряд повторяется)
+static Image Downsample(const Image& src)
+{
+    Image dst;
+    dst.width = max(1, src.width / 2);
+    dst.height = max(1, src.height / 2);
+    dst.pixels.resize((size_t)dst.width * dst.height * 4);
+    for (int y = 0; y < dst.height; y++)
+        for (int x = 0; x < dst.width; x++)
+        {
+            int x0 = min(x * 2, src.width - 1), x1 = min(x * 2 + 1, src.width - 1);
+            int y0 = min(y * 2, src.height - 1), y1 = min(y * 2 + 1, src.height - 1);
+            for (int c = 0; c < 4; c++)
+            {
+                int sum = src.pixels[((size_t)y0 * src.width + x0) * 4 + c] + src.pixels[((size_t)y0 * src.width + x1) * 4 + c]
+                    + src.pixels[((size_t)y1 * src.width + x0) * 4 + c] + src.pixels[((size_t)y1 * src.width + x1) * 4 + c];
+                dst.pixels[((size_t)y * dst.width + x) * 4 + c] = (unsigned char)((sum + 2) / 4);
+            }
+        }
+    return dst;
+}
+
+static uint16_t PackColor565(const glm::vec3& c)
+{
+    int r = (int)(glm::clamp(c.x, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    int g = (int)(glm::clamp(c.y, 0.0f, 255.0f) * 63.0f / 255.0f + 0.5f);
+    int b = (int)(glm::clamp(c.z, 0.0f, 255.0f) * 31.0f / 255.0f + 0.5f);
+    return (uint16_t)((r << 11) | (g << 5) | b);
+}
+
+static glm::vec3 UnpackColor565(uint16_t c)
+{
+    int r = (c >> 11) & 31, g = (c >> 5) & 63, b = c & 31;
+    return glm::vec3((float)((r << 3) | (r >> 2)), (float)((g << 2) | (g >> 4)), (float)((b << 3) | (b >> 2)));
+}
+
+// упорядочиваем концы (color0 > color1) и выбираем для каждого пикселя ближайший из 4 цветов; возвращает суммарную ошибку
+static float ChooseIndices(const glm::vec3 colors[16], uint16_t& c0, uint16_t& c1, uint32_t& indices)
+{
+    if (c0 < c1)
+        swap(c0, c1);
+    indices = 0;
+
+    glm::vec3 palette[4];
+    palette[0] = UnpackColor565(c0);
+    palette[1] = UnpackColor565(c1);
+    palette[2] = (palette[0] * 2.0f + palette[1]) / 3.0f;
+    palette[3] = (palette[0] + palette[1] * 2.0f) / 3.0f;
+    // при равных концах блок в режиме из 3 цветов, но индекс 0 всё равно даёт color0
+    int paletteSize = c0 != c1 ? 4 : 1;
+
+    float error = 0.0f;
+    for (int i = 0; i < 16; i++)
+    {
+        int best = 0;
+        float bestDist = 1e30f;
+        for (int k = 0; k < paletteSize; k++)
+        {
+            glm::vec3 d = colors[i] - palette[k];
+            float dist = glm::dot(d, d);
+            if (dist < bestDist)
+            {
+                bestDist = dist;
+                best = k;
+            }
+        }
+        indices |= (uint32_t)best << (i * 2);
+        error += bestDist;
+    }
+    return error;
+}
+
+// цветовой блок BC1 (8 байт): концы отрезка по главной оси разброса цветов блока, 2 бита индекса на пиксель.
+// Используется режим из 4 цветов (color0 > color1), он же единственный в цветовой части BC3
+static void EncodeColorBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    glm::vec3 colors[16];
+    glm::vec3 mean(0.0f);
+    for (int i = 0; i < 16; i++)
+    {
+        colors[i] = glm::vec3(block[i][0], block[i][1], block[i][2]);
+        mean += colors[i];
+    }
+    mean /= 16.0f;
+
+    // главная ось: несколько шагов степенного метода по ковариационной матрице
+    float cov[6] = {};
+    for (int i = 0; i < 16; i++)
+    {
+        glm::vec3 d = colors[i] - mean;
+        cov[0] += d.x * d.x; cov[1] += d.x * d.y; cov[2] += d.x * d.z;
+        cov[3] += d.y * d.y; cov[4] += d.y * d.z; cov[5] += d.z * d.z;
+    }
+    glm::vec3 axis(1.0f, 1.0f, 1.0f);
+    for (int iter = 0; iter < 8; iter++)
+    {
+        glm::vec3 next(cov[0] * axis.x + cov[1] * axis.y + cov[2] * axis.z,
+            cov[1] * axis.x + cov[3] * axis.y + cov[4] * axis.z,
+            cov[2] * axis.x + cov[4] * axis.y + cov[5] * axis.z);
+        float len = glm::length(next);
+        if (len < 1e-6f)
+            break;
+        axis = next / len;
+    }
+
+    // концы - крайние проекции цветов блока на ось
+    float minProj = 1e30f, maxProj = -1e30f;
+    for (int i = 0; i < 16; i++)
+    {
+        float p = glm::dot(colors[i] - mean, axis);
+        minProj = min(minProj, p);
+        maxProj = max(maxProj, p);
+    }
+    uint16_t c0 = PackColor565(mean + axis * maxProj);
+    uint16_t c1 = PackColor565(mean + axis * minProj);
+    uint32_t indices;
+    float error = ChooseIndices(colors, c0, c1, indices);
+
+    // уточняем концы методом наименьших квадратов при найденных индексах (вес color0 у индексов 0, 1, 2, 3)
+    static const float weights[4] = { 1.0f, 0.0f, 2.0f / 3.0f, 1.0f / 3.0f };
+    float aa = 0.0f, ab = 0.0f, bb = 0.0f;
+    glm::vec3 ax(0.0f), bx(0.0f);
+    for (int i = 0; i < 16; i++)
+    {
+        float a = weights[(indices >> (i * 2)) & 3], b = 1.0f - a;
+        aa += a * a; ab += a * b; bb += b * b;
+        ax += colors[i] * a; bx += colors[i] * b;
+    }
+    float det = aa * bb - ab * ab;
+    if (fabsf(det) > 1e-6f)
+    {
+        uint16_t r0 = PackColor565((ax * bb - bx * ab) / det);
+        uint16_t r1 = PackColor565((bx * aa - ax * ab) / det);
+        uint32_t refined;
+        if (ChooseIndices(colors, r0, r1, refined) < error)
+        {
+            c0 = r0;
+            c1 = r1;
+            indices = refined;
+        }
+    }
+
+    out[0] = (unsigned char)(c0 & 0xff); out[1] = (unsigned char)(c0 >> 8);
+    out[2] = (unsigned char)(c1 & 0xff); out[3] = (unsigned char)(c1 >> 8);
+    for (int i = 0; i < 4; i++)
+        out[4 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// блок альфа-канала BC3 (8 байт): два конца и 3 бита индекса на пиксель, режим из 8 значений (alpha0 > alpha1)
+static void EncodeAlphaBlock(const unsigned char block[16][4], unsigned char* out)
+{
+    int a0 = 0, a1 = 255;
+    for (int i = 0; i < 16; i++)
+    {
+        a0 = max(a0, (int)block[i][3]);
+        a1 = min(a1, (int)block[i][3]);
+    }
+
+    uint64_t indices = 0;
+    if (a0 != a1)
+    {
+        int palette[8] = { a0, a1 };
+        for (int k = 1; k < 7; k++)
+            palette[k + 1] = ((7 - k) * a0 + k * a1) / 7;
+        for (int i = 0; i < 16; i++)
+        {
+            int best = 0;
+            for (int k = 1; k < 8; k++)
+                if (abs(block[i][3] - palette[k]) < abs(block[i][3] - palette[best]))
+                    best = k;
+            indices |= (uint64_t)best << (i * 3);
+        }
+    }
+
+    out[0] = (unsigned char)a0;
+    out[1] = (unsigned char)a1;
+    for (int i = 0; i < 6; i++)
+        out[2 + i] = (unsigned char)(indices >> (i * 8));
+}
+
+// сжимаем один мип-уровень блоками 4x4 (у краёв, не кратных 4, повторяется последний пиксель)
+static vector<unsigned char> CompressLevel(const Image& image, bool alpha)
+{
+    int blocksX = (image.width + 3) / 4, blocksY = (image.height + 3) / 4;
+    size_t blockSize = alpha ? 16 : 8;
+    vector<unsigned char> out((size_t)blocksX * blocksY * blockSize);
+
+    unsigned char block[16][4];
+    unsigned char* dst = out.data();
+    for (int by = 0; by < blocksY; by++)
+        for (int bx = 0; bx < blocksX; bx++)
+        {
+            for (int i = 0; i < 16; i++)
+            {
+                int x = min(bx * 4 + i % 4, image.width - 1);
+                int y = min(by * 4 + i / 4, image.height - 1);
+                memcpy(block[i], &image.pixels[((size_t)y * image.width + x) * 4], 4);
+            }
+            if (alpha)
+            {
+                EncodeAlphaBlock(block, dst);
+                EncodeColorBlock(block, dst + 8);
+            }
+            else
+                EncodeColorBlock(block, dst);
+            dst += blockSize;
+        }
+    return out;
+}
+
+namespace textureCooker
+{
+    string CookedPath(const string& sourcePath)
+    {
+        return filesystem::path(sourcePath).replace_extension(".ktx").string();
+    }
+
+    bool CookTexture(const string& sourcePath, const string& cookedPath)
+    {
+        Image image;
+        int channels;
+        unsigned char* data = stbi_load(sourcePath.c_str(), &image.width, &image.height, &channels, 4);
+        if (!data)
+        {
+            printf("cook: failed to load %s\n", sourcePath.c_str());
+            return false;
+        }
+        image.pixels.assign(data, data + (size_t)image.width * image.height * 4);
+        stbi_image_free(data);
+
+        // BC3 нужен, только если в картинке действительно есть прозрачность
+        bool alpha = false;
+        for (size_t i = 3; i < image.pixels.size() && !alpha; i += 4)
+            alpha = image.pixels[i] != 255;
+
+        vector<vector<unsigned char>> levels;
+        size_t sourceBytes = 0;
+        Image level = image;
+        while (true)
+        {
+            levels.push_back(CompressLevel(level, alpha));
+            sourceBytes += level.pixels.size();
+            if (level.width == 1 && level.height == 1)
+                break;
+            level = Downsample(level);
+        }
+
+        vector<unsigned char> file = ktx::Write(alpha ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGB_S3TC_DXT1_EXT,
+            alpha ? BaseFormatRGBA : BaseFormatRGB, (uint32_t)image.width, (uint32_t)image.height, levels);
+
+        ofstream out(cookedPath, ios::binary);
+        if (!out.write((const char*)file.data(), file.size()))
+        {
+            printf("cook: failed to write %s\n", cookedPath.c_str());
+            return false;
+        }
+
+        printf("cook: %s -> %s: %dx%d %s, %zu mips, %zu KB (%zu KB as RGBA8)\n", sourcePath.c_str(), cookedPath.c_str(),
+            image.width, image.height, alpha ? "BC3" : "BC1", levels.size(), file.size() / 1024, sourceBytes / 1024);
+        return true;
+    }
+
+    int CookDirectory(const string& directory)
+    {
+        int cooked = 0;
+        error_code ec;
+        for (const auto& entry : filesystem::directory_iterator(directory, ec))
+        {
+            if (!entry.is_regular_file() || entry.path().extension() != ".png")
+                continue;
+
+            string source = entry.path().string();
+            string target = CookedPath(source);
+            if (filesystem::exists(target, ec) && filesystem::last_write_time(target, ec) >= entry.last_write_time(ec))
+                continue;
+
+            auto start = chrono::steady_clock::now();
+            if (CookTexture(source, target))
+            {
+                cooked++;
+                printf("cook: %.1f ms\n", chrono::duration<double, milli>(chrono::steady_clock::now() - start).count());
+            }
+        }
+        return cooked;
+    }
+}
@@ -0,0 +1,20 @@
+#pragma once
+
+#include <string>
+
+using namespace std;
+
+// Подготовка текстур заранее (без OpenGL): картинка декодируется, для неё строится цепочка мип-уровней,
+// каждый уровень сжимается в BC1 (без прозрачности) или BC3 (с альфа-каналом) и записывается в KTX.
+// Готовый файл кладётся рядом с исходным с расширением .ktx, и менеджер ресурсов загружает его вместо картинки.
+namespace textureCooker
+{
+    // путь к подготовленному файлу для исходной картинки
+    string CookedPath(const string& sourcePath);
+
+    // подготавливаем одну картинку; false, если её не удалось прочитать или записать
+    bool CookTexture(const string& sourcePath, const string& cookedPath);
+
+    // подготавливаем все .png в папке (пропуская те, у которых .ktx новее картинки); возвращает число подготовленных
+    int CookDirectory(const string& directory);
+}
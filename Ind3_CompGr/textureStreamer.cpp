@@ -0,0 +1,372 @@
+#include "textureStreamer.h"
+#include "cpuProfiler.h"
+#include "ktx.h"
+#include "stb_image.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+
+// выравнивание кусков буфера распаковки
+const size_t StagingAlignment = 64;
+
+TextureStreamer& TextureStreamer::Instance()
+{
+    static TextureStreamer instance;
+    return instance;
+}
+
+void TextureStreamer::Init(int workerCount, size_t stagingBytes)
+{
+    // заглушка: белый пиксель, чтобы меш выглядел как с неосвещённой текстурой
+    const unsigned char white[4] = { 255, 255, 255, 255 };
+    placeholder = CreateTexture(GL_TEXTURE_2D);
+    GlState& state = GlState::Instance();
+    state.BindTexture(0, placeholder);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, 1, 1);
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 1, 1, GL_RGBA, GL_UNSIGNED_BYTE, white);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    state.BindTexture(0, 0);
+
+    // общий буфер распаковки, отображённый в память на всё время работы
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    stagingCapacity = stagingBytes;
+    staging = CreateBuffer();
+    glNamedBufferStorage(staging, stagingCapacity, NULL, flags);
+    stagingMapped = (unsigned char*)glMapNamedBufferRange(staging, 0, stagingCapacity, flags);
+    if (!stagingMapped)
+    {
+        std::cout << "ERROR::TEXTURE_STREAMER:: could not map staging buffer" << std::endl;
+        stagingCapacity = 0;
+    }
+
+    if (workerCount <= 0)
+        workerCount = max(1, min(4, (int)thread::hardware_concurrency() - 1));
+    stopping = false;
+    for (int i = 0; i < workerCount; i++)
+        workers.emplace_back(&TextureStreamer::WorkerLoop, this);
+}
+
+void TextureStreamer::Request(const TextureHandle& texture, vector<unsigned char>&& fileData, bool cooked, const string& path,
+    const string& sourcePath)
+{
+    unique_ptr<Job> job(new Job());
+    job->texture = texture;
+    job->fileData = move(fileData);
+    job->cooked = cooked;
+    job->path = path;
+    job->sourcePath = sourcePath;
+
+    lock_guard<mutex> lock(queueMutex);
+    requests.push_back(move(job));
+    pending++;
+    queueReady.notify_one();
+}
+
+size_t TextureStreamer::Pending()
+{
+    lock_guard<mutex> lock(queueMutex);
+    return pending;
+}
+
+void TextureStreamer::WorkerLoop()
+{
+    cpuProfiler::SetThreadName("texture worker");
+    while (true)
+    {
+        unique_ptr<Job> job;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this] { return stopping || !requests.empty(); });
+            if (stopping)
+                return;
+            job = move(requests.front());
+            requests.pop_front();
+        }
+
+        Decode(*job);
+
+        lock_guard<mutex> lock(queueMutex);
+        decoded.push_back(move(job));
+    }
+}
+
+// рабочий поток: декодируем файл и кладём пиксели в буфер распаковки
+void TextureStreamer::Decode(Job& job)
+{
+    CpuZone zone("decode texture");
+    vector<unsigned char> fileData = move(job.fileData);
+
+    if (job.cooked)
+    {
+        // подготовленная текстура: сжатые уровни копируются как есть
+        ktx::Header header;
+        vector<ktx::Level> levels;
+        if (ktx::Read(fileData, header, levels))
+        {
+            size_t total = 0;
+            for (const auto& level : levels)
+            {
+                job.levels.push_back(Level{ (int)level.width, (int)level.height, total, level.size });
+                total += (level.size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+            }
+            job.internalFormat = header.glInternalFormat;
+
+            unsigned char* dst;
+            job.stagingOffset = AllocateStaging(total);
+            if (job.stagingOffset != SIZE_MAX)
+                dst = stagingMapped + job.stagingOffset;
+            else
+            {
+                job.heapPixels.resize(total);
+                dst = job.heapPixels.data();
+            }
+            for (size_t i = 0; i < levels.size(); i++)
+                memcpy(dst + job.levels[i].offset, levels[i].data, levels[i].size);
+            job.decoded = true;
+            return;
+        }
+
+        // испорченный KTX: как и при синхронной загрузке, берём исходную картинку
+        std::cout << "Cooked texture is broken: " << job.path << std::endl;
+        ifstream file(job.sourcePath, ios::binary);
+        fileData.assign(istreambuf_iterator<char>(file), istreambuf_iterator<char>());
+        job.cooked = false;
+        job.path = job.sourcePath;
+    }
+
+    int width, height, components;
+    if (!stbi_info_from_memory(fileData.data(), (int)fileData.size(), &width, &height, &components))
+    {
+        std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        return;
+    }
+    // двухканальные картинки (яркость + альфа) грузим как RGBA
+    if (components == 2)
+        components = 4;
+
+    size_t size = (size_t)width * height * components;
+    job.stagingOffset = AllocateStaging(size);
+
+    unsigned char* data = stbi_load_from_memory(fileData.data(), (int)fileData.size(), &width, &height, &components, components);
+    if (!data)
+    {
+        std::cout << "Texture failed to load at path: " << job.path << std::endl;
+        if (job.stagingOffset != SIZE_MAX)
+            FreeStaging(job.stagingOffset);
+        job.stagingOffset = SIZE_MAX;
+        return;
+    }
+    if (job.stagingOffset != SIZE_MAX)
+        memcpy(stagingMapped + job.stagingOffset, data, size);
+    else
+        job.heapPixels.assign(data, data + size);
+    stbi_image_free(data);
+
+    if (components == 1)
+    {
+        job.internalFormat = GL_R8;
+        job.format = GL_RED;
+    }
+    else if (components == 3)
+    {
+        job.internalFormat = GL_RGB8;
+        job.format = GL_RGB;
+    }
+    else
+    {
+        job.internalFormat = GL_RGBA8;
+        job.format = GL_RGBA;
+    }
+    job.levels.push_back(Level{ width, height, 0, size });
+    job.decoded = true;
+}
+
+// поток OpenGL: создаём текстуру из готовых пикселей и подменяем ею заглушку
+void TextureStreamer::Upload(Job& job)
+{
+    CpuZone zone("upload texture");
+    TextureHandle texture = job.texture.lock();
+    if (!job.decoded || !texture)
+    {
+        // текстура не нужна (или файл не прочитан): команд OpenGL не было, место можно вернуть сразу
+        if (job.stagingOffset != SIZE_MAX)
+            FreeStaging(job.stagingOffset);
+        return;
+    }
+
+    bool staged = job.stagingOffset != SIZE_MAX;
+    const unsigned char* base = staged ? (const unsigned char*)job.stagingOffset : job.heapPixels.data();
+    GlState& state = GlState::Instance();
+    state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, staged ? staging : 0);
+
+    const Level& top = job.levels[0];
+    GLsizei levelCount = (GLsizei)job.levels.size();
+    // у картинки цепочку мип-уровней строит видеокарта
+    if (!job.cooked)
+        levelCount = 1 + (GLsizei)floor(log2((double)max(top.width, top.height)));
+
+    GlTexture uploaded = CreateTexture(GL_TEXTURE_2D);
+    state.BindTexture(0, uploaded);
+    glTexStorage2D(GL_TEXTURE_2D, levelCount, job.internalFormat, top.width, top.height);
+    if (job.cooked)
+    {
+        for (size_t i = 0; i < job.levels.size(); i++)
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, (GLint)i, 0, 0, job.levels[i].width, job.levels[i].height,
+                job.internalFormat, (GLsizei)job.levels[i].size, base + job.levels[i].offset);
+    }
+    else
+    {
+        // строки RGB и R не выровнены на 4 байта
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, top.width, top.height, job.format, GL_UNSIGNED_BYTE, base);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glGenerateMipmap(GL_TEXTURE_2D);
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, levelCount > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    state.BindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    for (const Level& level : job.levels)
+        state.CountUpload(level.size);
+
+    if (staged)
+        uploads.push_back(PendingUpload{ glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0), job.stagingOffset });
+    texture->textureID = uploaded;
+    texture->texture = move(uploaded);
+}
+
+void TextureStreamer::Update(double budgetMs)
+{
+    auto start = chrono::steady_clock::now();
+
+    // место завершённых загрузок возвращаем рабочим потокам
+    while (!uploads.empty())
+    {
+        GLenum status = glClientWaitSync(uploads.front().fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+            break;
+        glDeleteSync(uploads.front().fence);
+        FreeStaging(uploads.front().stagingOffset);
+        uploads.pop_front();
+    }
+
+    // создаём текстуры, пока не кончился бюджет кадра
+    while (true)
+    {
+        unique_ptr<Job> job;
+        {
+            lock_guard<mutex> lock(queueMutex);
+            if (decoded.empty())
+                break;
+            job = move(decoded.front());
+            decoded.pop_front();
+        }
+
+        Upload(*job);
+        {
+            lock_guard<mutex> lock(queueMutex);
+            pending--;
+        }
+
+        if (chrono::duration<double, milli>(chrono::steady_clock::now() - start).count() >= budgetMs)
+            break;
+    }
+}
+
+size_t TextureStreamer::AllocateStaging(size_t size)
+{
+    size = (size + StagingAlignment - 1) / StagingAlignment * StagingAlignment;
+    if (size == 0 || size > stagingCapacity)
+        return SIZE_MAX;
+
+    unique_lock<mutex> lock(stagingMutex);
+    while (true)
+    {
+        if (stopping)
+            return SIZE_MAX;
+
+        size_t offset = SIZE_MAX;
+        if (regions.empty())
+        {
+            stagingHead = 0;
+            offset = 0;
+        }
+        else
+        {
+            size_t tail = regions.front().offset;
+            if (stagingHead > tail)
+            {
+                // занято [tail, head): пишем в конец, а если не помещается - в начало перед хвостом
+                if (stagingHead + size <= stagingCapacity)
+                    offset = stagingHead;
+                else if (size <= tail)
+                    offset = 0;
+            }
+            else if (stagingHead + size <= tail)
+                offset = stagingHead; // кольцо уже перешло через начало: свободно [head, tail)
+        }
+
+        if (offset != SIZE_MAX)
+        {
+            regions.push_back(Region{ offset, size, false });
+            stagingHead = offset + size;
+            return offset;
+        }
+        stagingFreed.wait(lock);
+    }
+}
+
+void TextureStreamer::FreeStaging(size_t offset)
+{
+    lock_guard<mutex> lock(stagingMutex);
+    for (auto& region : regions)
+        if (region.offset == offset && !region.freed)
+        {
+            region.freed = true;
+            break;
+        }
+    while (!regions.empty() && regions.front().freed)
+        regions.pop_front();
+    stagingFreed.notify_all();
+}
+
+void TextureStreamer::Release()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    // рабочий поток может ждать места в буфере распаковки
+    {
+        lock_guard<mutex> lock(stagingMutex);
+        stagingFreed.notify_all();
+    }
+    queueReady.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+
+    requests.clear();
+    decoded.clear();
+    pending = 0;
+    for (auto& upload : uploads)
+        glDeleteSync(upload.fence);
+    uploads.clear();
+    regions.clear();
+
+    if (staging)
+    {
+        glUnmapNamedBuffer(staging);
+        staging.Reset();
+    }
+    placeholder.Reset();
+    stagingMapped = NULL;
+}
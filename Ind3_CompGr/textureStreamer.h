@@ -0,0 +1,127 @@
+#pragma once
+
+#include <glad/glad.h>
+
+#include "mesh.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Фоновая загрузка текстур.
+// Менеджер ресурсов сразу выдаёт текстуру с общей заглушкой 1x1, а файл отдаёт в очередь.
+// Рабочие потоки декодируют картинку (stb_image) или разбирают подготовленный KTX и копируют пиксели
+// прямо в отображённый в память буфер распаковки (GL_PIXEL_UNPACK_BUFFER), общий для всех загрузок.
+// Поток OpenGL раз в кадр (Update) создаёт текстуры из готовых пикселей, пока не исчерпан бюджет времени,
+// и подменяет заглушку настоящей текстурой; место в буфере освобождается, когда fence загрузки сигнализирован.
+// Поэтому время до первого кадра не зависит от размера текстур.
+class TextureStreamer
+{
+public:
+    static TextureStreamer& Instance();
+
+    // workerCount = 0 - по числу ядер; stagingBytes - размер общего буфера распаковки
+    void Init(int workerCount = 0, size_t stagingBytes = 64 << 20);
+    bool Enabled() const { return !workers.empty(); }
+
+    // общая заглушка (белый пиксель), которую рисуют меши, пока их текстура не загружена
+    GLuint Placeholder() const { return placeholder; }
+
+    // ставим текстуру в очередь; fileData - содержимое файла (картинки или KTX, если cooked).
+    // sourcePath - исходная картинка: её читает рабочий поток, если KTX оказался испорчен
+    void Request(const TextureHandle& texture, vector<unsigned char>&& fileData, bool cooked, const string& path,
+        const string& sourcePath);
+
+    // вызывается потоком OpenGL раз в кадр: освобождает место завершённых загрузок
+    // и создаёт текстуры из готовых пикселей, пока не пройдёт budgetMs миллисекунд (хотя бы одну)
+    void Update(double budgetMs);
+
+    // сколько текстур ещё не загружено
+    size_t Pending();
+
+    void Release();
+
+private:
+    TextureStreamer() {}
+    TextureStreamer(const TextureStreamer&) = delete;
+    TextureStreamer& operator=(const TextureStreamer&) = delete;
+
+    // мип-уровень в буфере распаковки
+    struct Level
+    {
+        int width;
+        int height;
+        size_t offset; // смещение в буфере распаковки (или в heapPixels)
+        size_t size;
+    };
+
+    struct Job
+    {
+        weak_ptr<Texture> texture; // рабочие потоки не держат текстуру: её удаление должно быть в потоке OpenGL
+        string path;
+        string sourcePath;
+        vector<unsigned char> fileData;
+        bool cooked = false;
+
+        // результат декодирования
+        bool decoded = false;
+        GLenum internalFormat = 0; // GL_R8/GL_RGB8/GL_RGBA8 или сжатый формат из KTX
+        GLenum format = 0; // формат пикселей (0 у сжатых)
+        vector<Level> levels; // у картинки один уровень, остальные строит glGenerateMipmap
+        size_t stagingOffset = SIZE_MAX; // место в буфере распаковки (SIZE_MAX - пиксели в heapPixels)
+        vector<unsigned char> heapPixels; // если картинка не помещается в буфер распаковки целиком
+    };
+
+    // загрузка, отправленная в OpenGL: место в буфере освобождается по fence
+    struct PendingUpload
+    {
+        GLsync fence;
+        size_t stagingOffset;
+    };
+
+    // выделенный кусок буфера распаковки
+    struct Region
+    {
+        size_t offset;
+        size_t size;
+        bool freed;
+    };
+
+    void WorkerLoop();
+    void Decode(Job& job);
+    void Upload(Job& job);
+
+    // место в буфере распаковки: ждёт, пока не освободится; SIZE_MAX, если не поместится никогда или идёт остановка
+    size_t AllocateStaging(size_t size);
+    void FreeStaging(size_t offset);
+
+    GlTexture placeholder;
+    GlBuffer staging;
+    unsigned char* stagingMapped = NULL;
+    size_t stagingCapacity = 0;
+
+    // буфер распаковки используется как кольцо: куски освобождаются в произвольном порядке,
+    // но хвост сдвигается только через подряд идущие освобождённые
+    mutex stagingMutex;
+    condition_variable stagingFreed;
+    deque<Region> regions;
+    size_t stagingHead = 0;
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<unique_ptr<Job>> requests; // ждут декодирования
+    deque<unique_ptr<Job>> decoded; // ждут загрузки в OpenGL
+    size_t pending = 0;
+    atomic<bool> stopping{ false };
+
+    deque<PendingUpload> uploads; // отправлены в OpenGL, ждут fence
+    vector<thread> workers;
+};
@@ -0,0 +1,98 @@
+#include "threadPool.h"
+#include "cpuProfiler.h"
+
+#include <algorithm>
+
+ThreadPool& ThreadPool::Instance()
+{
+    static ThreadPool instance;
+    return instance;
+}
+
+void ThreadPool::Init(int threadCount)
+{
+    if (!workers.empty())
+        return;
+    // вызывающий поток тоже работает, поэтому рабочих на один меньше, чем ядер
+    if (threadCount <= 0)
+        threadCount = max(1, (int)thread::hardware_concurrency() - 1);
+    stopping = false;
+    for (int i = 0; i < threadCount; i++)
+        workers.emplace_back(&ThreadPool::WorkerLoop, this);
+}
+
+void ThreadPool::Run(Loop& loop)
+{
+    while (true)
+    {
+        size_t i = loop.next.fetch_add(1);
+        if (i >= loop.count)
+            return;
+        (*loop.body)(i);
+        if (loop.done.fetch_add(1) + 1 == loop.count)
+        {
+            lock_guard<mutex> lock(loop.doneMutex);
+            loop.finished.notify_all();
+        }
+    }
+}
+
+void ThreadPool::ParallelFor(size_t count, const function<void(size_t)>& body)
+{
+    if (count == 0)
+        return;
+    if (count == 1 || !Parallel())
+    {
+        for (size_t i = 0; i < count; i++)
+            body(i);
+        return;
+    }
+
+    shared_ptr<Loop> loop = make_shared<Loop>();
+    loop->body = &body;
+    loop->count = count;
+    {
+        lock_guard<mutex> lock(queueMutex);
+        size_t helpers = min(count - 1, workers.size());
+        for (size_t i = 0; i < helpers; i++)
+            queue.push_back(loop);
+    }
+    queueReady.notify_all();
+
+    Run(*loop);
+
+    // номера кончились, но рабочие потоки могут ещё выполнять взятые
+    unique_lock<mutex> lock(loop->doneMutex);
+    loop->finished.wait(lock, [&] { return loop->done.load() == count; });
+}
+
+void ThreadPool::WorkerLoop()
+{
+    cpuProfiler::SetThreadName("pool worker");
+    while (true)
+    {
+        shared_ptr<Loop> loop;
+        {
+            unique_lock<mutex> lock(queueMutex);
+            queueReady.wait(lock, [this] { return stopping || !queue.empty(); });
+            if (stopping)
+                return;
+            loop = move(queue.front());
+            queue.pop_front();
+        }
+        Run(*loop);
+    }
+}
+
+void ThreadPool::Release()
+{
+    {
+        lock_guard<mutex> lock(queueMutex);
+        stopping = true;
+    }
+    queueReady.notify_all();
+    for (auto& worker : workers)
+        worker.join();
+    workers.clear();
+    queue.clear();
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+using namespace std;
+
+// Общий пул потоков для работы на CPU, которая делится на независимые части (импорт моделей, обработка мешей).
+// ParallelFor раздаёт номера 0..count-1 рабочим потокам и сам вызывающему потоку,
+// поэтому его можно вызывать изнутри другого ParallelFor: вызывающий поток никогда не ждёт без дела,
+// и вложенный цикл выполнится, даже если все рабочие потоки заняты.
+class ThreadPool
+{
+public:
+    static ThreadPool& Instance();
+
+    // запуск рабочих потоков (threadCount = 0 - по числу ядер)
+    void Init(int threadCount = 0);
+
+    // вызываем body(i) для всех i из [0, count) и ждём завершения
+    void ParallelFor(size_t count, const function<void(size_t)>& body);
+
+    // false - ParallelFor выполняет всё в вызывающем потоке (для сравнения в бенчмарках)
+    void SetParallel(bool parallel) { this->parallel = parallel; }
+    bool Parallel() const { return parallel && !workers.empty(); }
+
+    size_t ThreadCount() const { return workers.size(); }
+
+    void Release();
+
+private:
+    ThreadPool() {}
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // один вызов ParallelFor: номера разбираются атомарным счётчиком
+    struct Loop
+    {
+        const function<void(size_t)>* body;
+        size_t count;
+        atomic<size_t> next{ 0 };
+        atomic<size_t> done{ 0 };
+        mutex doneMutex;
+        condition_variable finished;
+    };
+
+    // выполняем номера цикла, пока они не кончатся
+    static void Run(Loop& loop);
+
+    void WorkerLoop();
+
+    mutex queueMutex;
+    condition_variable queueReady;
+    deque<shared_ptr<Loop>> queue; // цикл лежит здесь по разу на каждый поток, который может ему помочь
+    vector<thread> workers;
+    bool stopping = false;
+    bool parallel = true;
+};
@@ -0,0 +1,10 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+struct Vertex
+{
+    glm::vec3 position; // координаты вершины
+    glm::vec3 normal; // нормаль вершины
+    glm::vec2 textureCoord; // текстурные координаты вершины
+};
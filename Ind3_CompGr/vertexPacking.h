@@ -0,0 +1,209 @@
+#pragma once
+
+#include <glm/glm.hpp>
+
+#include "vertex.h"
+#include "bounds.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+
+using namespace std;
+
+// Упакованная вершина (16 байт вместо 32):
+// позиция - три 16-битных беззнаковых нормированных числа внутри параллелепипеда модели,
+// нормаль - октаэдрическая развёртка в два 16-битных знаковых нормированных числа,
+// текстурные координаты - два half-float.
+// Позиция распаковывается в [0, 1]; перевод в координаты модели (сдвиг и масштаб по параллелепипеду)
+// добавляется к матрице объекта, поэтому шейдеру нужна только распаковка нормали.
+struct PackedVertex
+{
+    uint16_t position[3];
+    uint16_t padding; // выравнивание нормали на 4 байта
+    int16_t normal[2];
+    uint16_t textureCoord[2];
+};
+
+// упакованная позиция потока только позиций (8 байт): те же числа, что в начале PackedVertex
+struct PackedPosition
+{
+    uint16_t position[3];
+    uint16_t padding; // выравнивание следующей позиции на 4 байта
+};
+
+// ошибка квантования по всем упакованным вершинам
+struct QuantizationError
+{
+    size_t vertices = 0;
+    double maxPosition = 0.0; // в единицах модели
+    double sumPosition = 0.0;
+    double maxNormalDegrees = 0.0;
+    double sumNormalDegrees = 0.0;
+    double maxTextureCoord = 0.0;
+
+    void Print() const
+    {
+        if (vertices == 0)
+            return;
+        printf("vertex quantization over %zu vertices: position max %.6f mean %.6f, normal max %.3f deg mean %.3f deg, uv max %.6f\n",
+            vertices, maxPosition, sumPosition / vertices, maxNormalDegrees, sumNormalDegrees / vertices, maxTextureCoord);
+    }
+};
+
+namespace vertexPacking
+{
+    inline uint16_t FloatToHalf(float value)
+    {
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        uint32_t sign = (bits >> 16) & 0x8000;
+        int exponent = (int)((bits >> 23) & 0xff) - 127 + 15;
+        uint32_t mantissa = bits & 0x7fffff;
+
+        if (((bits >> 23) & 0xff) == 0xff)
+            return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // бесконечность или NaN
+        if (exponent >= 31)
+            return (uint16_t)(sign | 0x7c00); // слишком большое: бесконечность
+        if (exponent <= 0)
+        {
+            // денормализованное half (или ноль)
+            if (exponent < -10)
+                return (uint16_t)sign;
+            mantissa |= 0x800000;
+            int shift = 14 - exponent;
+            uint32_t half = mantissa >> shift;
+            // округление к ближайшему
+            if ((mantissa >> (shift - 1)) & 1)
+                half++;
+            return (uint16_t)(sign | half);
+        }
+        uint32_t half = sign | ((uint32_t)exponent << 10) | (mantissa >> 13);
+        // округление к ближайшему (перенос в порядок тоже корректен)
+        if (mantissa & 0x1000)
+            half++;
+        return (uint16_t)half;
+    }
+
+    inline float HalfToFloat(uint16_t half)
+    {
+        uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+        int exponent = (half >> 10) & 0x1f;
+        uint32_t mantissa = half & 0x3ff;
+        float value;
+        if (exponent == 0)
+            value = ldexpf((float)mantissa, -24);
+        else if (exponent == 31)
+            value = mantissa ? NAN : INFINITY;
+        else
+            value = ldexpf((float)(mantissa | 0x400), exponent - 25);
+        uint32_t bits;
+        memcpy(&bits, &value, sizeof(bits));
+        bits |= sign;
+        memcpy(&value, &bits, sizeof(bits));
+        return value;
+    }
+
+    // нормаль -> точка квадрата [-1, 1]^2 (октаэдрическая развёртка)
+    inline glm::vec2 OctEncode(glm::vec3 n)
+    {
+        n /= fabsf(n.x) + fabsf(n.y) + fabsf(n.z) + 1e-20f;
+        glm::vec2 e(n.x, n.y);
+        if (n.z < 0.0f)
+        {
+            e.x = (1.0f - fabsf(n.y)) * (n.x >= 0.0f ? 1.0f : -1.0f);
+            e.y = (1.0f - fabsf(n.x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return e;
+    }
+
+    // обратное преобразование (то же, что делает шейдер)
+    inline glm::vec3 OctDecode(glm::vec2 e)
+    {
+        glm::vec3 n(e.x, e.y, 1.0f - fabsf(e.x) - fabsf(e.y));
+        if (n.z < 0.0f)
+        {
+            float x = n.x;
+            n.x = (1.0f - fabsf(n.y)) * (x >= 0.0f ? 1.0f : -1.0f);
+            n.y = (1.0f - fabsf(x)) * (n.y >= 0.0f ? 1.0f : -1.0f);
+        }
+        return glm::normalize(n);
+    }
+
+    inline int16_t PackSnorm16(float v)
+    {
+        return (int16_t)lroundf(glm::clamp(v, -1.0f, 1.0f) * 32767.0f);
+    }
+
+    inline uint16_t PackUnorm16(float v)
+    {
+        return (uint16_t)lroundf(glm::clamp(v, 0.0f, 1.0f) * 65535.0f);
+    }
+
+    // упаковываем count вершин относительно параллелепипеда box; ошибка квантования добавляется в error
+    inline void Pack(const Vertex* vertices, size_t count, const BoundingBox& box, PackedVertex* out, QuantizationError& error)
+    {
+        glm::vec3 extent = box.max - box.min;
+        glm::vec3 scale;
+        for (int a = 0; a < 3; a++)
+            scale[a] = extent[a] > 0.0f ? 1.0f / extent[a] : 0.0f;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            const Vertex& v = vertices[i];
+            PackedVertex& p = out[i];
+
+            glm::vec3 unit = (v.position - box.min) * scale;
+            for (int a = 0; a < 3; a++)
+                p.position[a] = PackUnorm16(unit[a]);
+            p.padding = 0;
+
+            float length = glm::length(v.normal);
+            glm::vec3 normal = length > 0.0f ? v.normal / length : glm::vec3(0.0f, 0.0f, 1.0f);
+            glm::vec2 oct = OctEncode(normal);
+            p.normal[0] = PackSnorm16(oct.x);
+            p.normal[1] = PackSnorm16(oct.y);
+
+            p.textureCoord[0] = FloatToHalf(v.textureCoord.x);
+            p.textureCoord[1] = FloatToHalf(v.textureCoord.y);
+
+            // ошибка: распаковываем так же, как это сделает видеокарта
+            glm::vec3 decoded;
+            for (int a = 0; a < 3; a++)
+                decoded[a] = box.min[a] + p.position[a] / 65535.0f * extent[a];
+            double positionError = glm::length(decoded - v.position);
+
+            glm::vec3 decodedNormal = OctDecode(glm::vec2(max(p.normal[0] / 32767.0f, -1.0f), max(p.normal[1] / 32767.0f, -1.0f)));
+            double normalError = acos(glm::clamp((double)glm::dot(decodedNormal, normal), -1.0, 1.0)) * 180.0 / 3.14159265358979;
+
+            double uvError = max(fabs(HalfToFloat(p.textureCoord[0]) - v.textureCoord.x), fabs(HalfToFloat(p.textureCoord[1]) - v.textureCoord.y));
+
+            error.vertices++;
+            error.maxPosition = max(error.maxPosition, positionError);
+            error.sumPosition += positionError;
+            error.maxNormalDegrees = max(error.maxNormalDegrees, normalError);
+            error.sumNormalDegrees += normalError;
+            error.maxTextureCoord = max(error.maxTextureCoord, uvError);
+        }
+    }
+
+    // упаковываем count позиций так же, как Pack упаковывает позиции вершин: числа совпадают бит в бит,
+    // поэтому глубина из потока позиций равна глубине из полных вершин (ошибку уже посчитал Pack)
+    inline void PackPositions(const glm::vec3* positions, size_t count, const BoundingBox& box, PackedPosition* out)
+    {
+        glm::vec3 extent = box.max - box.min;
+        glm::vec3 scale;
+        for (int a = 0; a < 3; a++)
+            scale[a] = extent[a] > 0.0f ? 1.0f / extent[a] : 0.0f;
+
+        for (size_t i = 0; i < count; i++)
+        {
+            glm::vec3 unit = (positions[i] - box.min) * scale;
+            for (int a = 0; a < 3; a++)
+                out[i].position[a] = PackUnorm16(unit[a]);
+            out[i].padding = 0;
+        }
+    }
+}